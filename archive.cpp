@@ -0,0 +1,545 @@
+
+#include "archive.h"
+#include "parallel.h"
+#include "rle.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <stdexcept>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace {
+	constexpr const char magic[4] = { 'M', 'B', 'A', 'F' };
+	constexpr const uint32_t version = 1;
+
+	constexpr const size_t header_size = 80;
+	constexpr const size_t entry_size = 16;
+
+	constexpr const uint16_t uint16_inside = 0xffff;
+
+	template<typename T>
+	void put(uint8_t* at, T value) { std::memcpy(at, &value, sizeof(T)); }
+
+	template<typename T>
+	T get(const uint8_t* at)
+	{
+		T value;
+		std::memcpy(&value, at, sizeof(T));
+		return value;
+	}
+
+	size_t sample_size(archive::sample_type sample)
+	{
+		return sample == archive::sample_type::uint16 ? sizeof(uint16_t) : sizeof(float);
+	}
+
+	void check_layout(const archive::layout& layout)
+	{
+		if (layout.width == 0 || layout.height == 0 || layout.tile_size == 0) {
+			throw std::runtime_error("archive layout must not be empty");
+		}
+		if (layout.levels == 0 || layout.levels > 32) {
+			throw std::runtime_error("archive needs between 1 and 32 levels");
+		}
+	}
+
+	// per thread scratch so tile coding does not allocate once warmed up
+	struct scratch {
+		std::vector<uint8_t> raw, shuffled, coded;
+	};
+
+	scratch& thread_scratch()
+	{
+		thread_local scratch buffers;
+		return buffers;
+	}
+
+	// groups byte b of every sample together so runs in the high bytes are found
+	void shuffle(const uint8_t* in, size_t samples, size_t size, uint8_t* out)
+	{
+		for (size_t b = 0; b < size; b++) {
+			for (size_t i = 0; i < samples; i++) {
+				out[b * samples + i] = in[i * size + b];
+			}
+		}
+	}
+
+	void unshuffle(const uint8_t* in, size_t samples, size_t size, uint8_t* out)
+	{
+		for (size_t b = 0; b < size; b++) {
+			for (size_t i = 0; i < samples; i++) {
+				out[i * size + b] = in[b * samples + i];
+			}
+		}
+	}
+}
+
+struct archive::writer::entry {
+	uint64_t offset{ 0 };
+	uint32_t size{ 0 };
+	uint32_t compression{ 0 };
+};
+
+// file written positionally from several threads
+class archive::writer::file {
+private:
+#ifdef _WIN32
+	HANDLE _handle;
+#else
+	int _fd;
+#endif
+public:
+	file(const std::string& filename)
+	{
+#ifdef _WIN32
+		_handle = CreateFileA(filename.c_str(), GENERIC_WRITE, 0, NULL, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, NULL);
+		if (_handle == INVALID_HANDLE_VALUE) {
+			throw std::runtime_error("unable to create " + filename);
+		}
+#else
+		_fd = ::open(filename.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+		if (_fd < 0) {
+			throw std::runtime_error("unable to create " + filename);
+		}
+#endif
+	}
+
+	~file()
+	{
+#ifdef _WIN32
+		CloseHandle(_handle);
+#else
+		::close(_fd);
+#endif
+	}
+
+	void write_at(uint64_t offset, const void* data, size_t size)
+	{
+		const char* bytes = static_cast<const char*>(data);
+		while (size > 0) {
+#ifdef _WIN32
+			OVERLAPPED position{};
+			position.Offset = static_cast<DWORD>(offset);
+			position.OffsetHigh = static_cast<DWORD>(offset >> 32);
+			DWORD written = 0;
+			const DWORD chunk = static_cast<DWORD>(std::min<size_t>(size, 1u << 30));
+			if (!WriteFile(_handle, bytes, chunk, &written, &position) || written == 0) {
+				throw std::runtime_error("archive write failed");
+			}
+#else
+			const ssize_t written = ::pwrite(_fd, bytes, size, static_cast<off_t>(offset));
+			if (written <= 0) {
+				throw std::runtime_error("archive write failed");
+			}
+#endif
+			bytes += written;
+			offset += written;
+			size -= written;
+		}
+	}
+};
+
+// read only mapping of a whole file
+class archive::reader::mapping {
+private:
+	const uint8_t* _data{ nullptr };
+	size_t _size{ 0 };
+#ifdef _WIN32
+	HANDLE _file{ INVALID_HANDLE_VALUE };
+	HANDLE _map{ NULL };
+#endif
+public:
+	mapping(const std::string& filename)
+	{
+#ifdef _WIN32
+		_file = CreateFileA(filename.c_str(), GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+		LARGE_INTEGER size{};
+		if (_file == INVALID_HANDLE_VALUE || !GetFileSizeEx(_file, &size)) {
+			throw std::runtime_error("unable to open " + filename);
+		}
+		_size = static_cast<size_t>(size.QuadPart);
+		_map = CreateFileMappingA(_file, NULL, PAGE_READONLY, 0, 0, NULL);
+		_data = _map ? static_cast<const uint8_t*>(MapViewOfFile(_map, FILE_MAP_READ, 0, 0, 0)) : nullptr;
+		if (!_data) {
+			if (_map) CloseHandle(_map);
+			CloseHandle(_file);
+			throw std::runtime_error("unable to map " + filename);
+		}
+#else
+		const int fd = ::open(filename.c_str(), O_RDONLY);
+		struct stat info{};
+		if (fd < 0 || ::fstat(fd, &info) != 0) {
+			if (fd >= 0) ::close(fd);
+			throw std::runtime_error("unable to open " + filename);
+		}
+		_size = static_cast<size_t>(info.st_size);
+		void* data = _size ? ::mmap(nullptr, _size, PROT_READ, MAP_SHARED, fd, 0) : MAP_FAILED;
+		// the mapping keeps the file alive
+		::close(fd);
+		if (data == MAP_FAILED) {
+			throw std::runtime_error("unable to map " + filename);
+		}
+		_data = static_cast<const uint8_t*>(data);
+#endif
+	}
+
+	~mapping()
+	{
+#ifdef _WIN32
+		UnmapViewOfFile(_data);
+		CloseHandle(_map);
+		CloseHandle(_file);
+#else
+		::munmap(const_cast<uint8_t*>(_data), _size);
+#endif
+	}
+
+	const uint8_t* data() const { return _data; }
+	size_t size() const { return _size; }
+};
+
+// layout
+size_t archive::layout::tile_count() const
+{
+	size_t count = 0;
+	for (size_t level = 0; level < levels; level++) {
+		count += tiles_x(level) * tiles_y(level);
+	}
+	return count;
+}
+
+size_t archive::layout::tile_index(size_t level, size_t tx, size_t ty) const
+{
+	if (level >= levels || tx >= tiles_x(level) || ty >= tiles_y(level)) {
+		throw std::out_of_range("tile outside the archive");
+	}
+
+	size_t index = 0;
+	for (size_t l = 0; l < level; l++) {
+		index += tiles_x(l) * tiles_y(l);
+	}
+	return index + ty * tiles_x(level) + tx;
+}
+
+size_t archive::layout::tile_width(size_t level, size_t tx) const
+{
+	return std::min(tile_size, level_width(level) - tx * tile_size);
+}
+
+size_t archive::layout::tile_height(size_t level, size_t ty) const
+{
+	return std::min(tile_size, level_height(level) - ty * tile_size);
+}
+
+archive::metadata archive::from_spec(const mandelbrot::input_spec& spec)
+{
+	metadata result;
+	result.center = spec.center;
+	result.zoom_level = spec.zoom_level;
+	result.max_iterations = spec.max_iterations;
+	return result;
+}
+
+std::vector<float> archive::downsample(const std::vector<float>& field, size_t width, size_t height)
+{
+	std::vector<float> result(((width + 1) / 2) * ((height + 1) / 2));
+	downsample(field.data(), width, height, result.data());
+	return result;
+}
+
+void archive::downsample(const float* field, size_t width, size_t height, float* half)
+{
+	const size_t half_width = (width + 1) / 2;
+	const size_t half_height = (height + 1) / 2;
+
+	util::parallel_for(half_height, 16u, [&](size_t begin, size_t end, size_t) {
+		for (size_t y = begin; y < end; y++) {
+			for (size_t x = 0; x < half_width; x++) {
+				size_t samples = 0, exterior = 0;
+				float sum = 0.0f;
+
+				for (size_t sy = 2 * y; sy < std::min(2 * y + 2, height); sy++) {
+					for (size_t sx = 2 * x; sx < std::min(2 * x + 2, width); sx++) {
+						const float value = field[sy * width + sx];
+						samples++;
+						if (value >= 0.0f) {
+							exterior++;
+							sum += value;
+						}
+					}
+				}
+
+				half[y * half_width + x] = 2 * exterior >= samples && exterior > 0 ? sum / exterior : -1.0f;
+			}
+		}
+	});
+}
+
+// writer
+archive::writer::writer(const std::string& filename, const archive::layout& layout, const archive::metadata& metadata)
+	: _layout{ layout }, _metadata{ metadata }
+{
+	check_layout(_layout);
+
+	_file = std::make_unique<file>(filename);
+	_index = std::make_unique<entry[]>(_layout.tile_count());
+	_end = header_size + entry_size * _layout.tile_count();
+}
+
+archive::writer::~writer()
+{
+	if (!_closed) {
+		try {
+			close();
+		}
+		catch (const std::exception&) {
+			// nothing sensible to do while unwinding
+		}
+	}
+}
+
+void archive::writer::write_tile(size_t level, size_t tx, size_t ty, const float* samples)
+{
+	const size_t index = _layout.tile_index(level, tx, ty);
+	const size_t count = _layout.tile_width(level, tx) * _layout.tile_height(level, ty);
+	const size_t size = sample_size(_layout.sample);
+
+	scratch& buffers = thread_scratch();
+
+	buffers.raw.resize(count * size);
+	if (_layout.sample == sample_type::uint16) {
+		for (size_t i = 0; i < count; i++) {
+			const uint16_t value = samples[i] < 0.0f ? uint16_inside
+				: static_cast<uint16_t>(std::min(std::lround(samples[i]), long(uint16_inside - 1)));
+			put(buffers.raw.data() + i * size, value);
+		}
+	}
+	else {
+		std::memcpy(buffers.raw.data(), samples, count * size);
+	}
+
+	const std::vector<uint8_t>* stored = &buffers.raw;
+	compression stored_compression = compression::none;
+
+	if (_layout.compression == compression::rle) {
+		buffers.shuffled.resize(buffers.raw.size());
+		shuffle(buffers.raw.data(), count, size, buffers.shuffled.data());
+
+		buffers.coded.clear();
+		rle::encode(buffers.shuffled.data(), buffers.shuffled.size(), buffers.coded);
+
+		if (buffers.coded.size() < buffers.raw.size()) {
+			stored = &buffers.coded;
+			stored_compression = compression::rle;
+		}
+	}
+
+	const uint64_t offset = _end.fetch_add(stored->size());
+	_file->write_at(offset, stored->data(), stored->size());
+
+	_index[index].offset = offset;
+	_index[index].size = static_cast<uint32_t>(stored->size());
+	_index[index].compression = static_cast<uint32_t>(stored_compression);
+}
+
+void archive::writer::write_field(const float* escape, size_t count)
+{
+	if (count != _layout.width * _layout.height) {
+		throw std::runtime_error("field size does not match the archive");
+	}
+
+	// level 0 tiles are read straight from escape
+	_levels.resize(_layout.levels - 1);
+	auto samples = [&](size_t level) { return level == 0 ? escape : _levels[level - 1].data(); };
+	for (size_t level = 1; level < _layout.levels; level++) {
+		_levels[level - 1].resize(_layout.level_width(level) * _layout.level_height(level));
+		downsample(samples(level - 1), _layout.level_width(level - 1), _layout.level_height(level - 1), _levels[level - 1].data());
+	}
+
+	_tiles.resize(util::workers());
+
+	util::parallel_for(_layout.tile_count(), 1u, [&](size_t begin, size_t end, size_t worker) {
+		for (size_t index = begin; index < end; index++) {
+			// find the level and position of the tile
+			size_t level = 0, first = 0;
+			while (index - first >= _layout.tiles_x(level) * _layout.tiles_y(level)) {
+				first += _layout.tiles_x(level) * _layout.tiles_y(level);
+				level++;
+			}
+			const size_t tx = (index - first) % _layout.tiles_x(level);
+			const size_t ty = (index - first) / _layout.tiles_x(level);
+
+			const size_t width = _layout.tile_width(level, tx);
+			const size_t height = _layout.tile_height(level, ty);
+			const size_t level_width = _layout.level_width(level);
+
+			util::buffer<float>& tile = _tiles[worker];
+			tile.resize(_layout.tile_size * _layout.tile_size);
+			for (size_t y = 0; y < height; y++) {
+				const float* row = samples(level) + (ty * _layout.tile_size + y) * level_width + tx * _layout.tile_size;
+				std::copy(row, row + width, tile.data() + y * width);
+			}
+
+			write_tile(level, tx, ty, tile.data());
+		}
+	});
+}
+
+void archive::writer::close()
+{
+	const size_t tiles = _layout.tile_count();
+
+	std::vector<uint8_t> index(entry_size * tiles);
+	for (size_t i = 0; i < tiles; i++) {
+		uint8_t* at = index.data() + i * entry_size;
+		put<uint64_t>(at, _index[i].offset);
+		put<uint32_t>(at + 8, _index[i].size);
+		put<uint32_t>(at + 12, _index[i].compression);
+	}
+
+	uint8_t header[header_size] = {};
+	std::memcpy(header, magic, sizeof(magic));
+	put<uint32_t>(header + 4, version);
+	put<uint32_t>(header + 8, static_cast<uint32_t>(_layout.width));
+	put<uint32_t>(header + 12, static_cast<uint32_t>(_layout.height));
+	put<uint32_t>(header + 16, static_cast<uint32_t>(_layout.tile_size));
+	put<uint32_t>(header + 20, static_cast<uint32_t>(_layout.levels));
+	put<uint32_t>(header + 24, static_cast<uint32_t>(_layout.sample));
+	put<uint32_t>(header + 28, static_cast<uint32_t>(_layout.compression));
+	put<uint64_t>(header + 32, tiles);
+	put<uint64_t>(header + 40, header_size);
+	put<double>(header + 48, _metadata.center.real());
+	put<double>(header + 56, _metadata.center.imag());
+	put<float>(header + 64, _metadata.zoom_level);
+	put<uint32_t>(header + 68, static_cast<uint32_t>(_metadata.max_iterations));
+
+	_closed = true;
+	_file->write_at(header_size, index.data(), index.size());
+	_file->write_at(0, header, header_size);
+}
+
+// reader
+archive::reader::reader(const std::string& filename)
+	: _mapping{ std::make_unique<mapping>(filename) }
+{
+	const uint8_t* data = _mapping->data();
+
+	if (_mapping->size() < header_size || !std::equal(magic, magic + sizeof(magic), data)) {
+		throw std::runtime_error(filename + " is not an escape count archive");
+	}
+	if (get<uint32_t>(data + 4) != version) {
+		throw std::runtime_error(filename + " has an unsupported archive version");
+	}
+
+	_layout.width = get<uint32_t>(data + 8);
+	_layout.height = get<uint32_t>(data + 12);
+	_layout.tile_size = get<uint32_t>(data + 16);
+	_layout.levels = get<uint32_t>(data + 20);
+	_layout.sample = static_cast<sample_type>(get<uint32_t>(data + 24));
+	_layout.compression = static_cast<compression>(get<uint32_t>(data + 28));
+	check_layout(_layout);
+
+	const uint64_t tiles = get<uint64_t>(data + 32);
+	const uint64_t index_offset = get<uint64_t>(data + 40);
+	if (tiles != _layout.tile_count() || index_offset + tiles * entry_size > _mapping->size()) {
+		throw std::runtime_error(filename + " has a corrupt tile index");
+	}
+	_index = data + index_offset;
+
+	_metadata.center = { get<double>(data + 48), get<double>(data + 56) };
+	_metadata.zoom_level = get<float>(data + 64);
+	_metadata.max_iterations = get<uint32_t>(data + 68);
+}
+
+archive::reader::~reader() = default;
+
+std::vector<float> archive::reader::tile(size_t level, size_t tx, size_t ty) const
+{
+	std::vector<float> result(_layout.tile_width(level, tx) * _layout.tile_height(level, ty));
+	read_tile(level, tx, ty, result.data());
+	return result;
+}
+
+void archive::reader::read_tile(size_t level, size_t tx, size_t ty, float* out) const
+{
+	const uint8_t* at = _index + entry_size * _layout.tile_index(level, tx, ty);
+	const uint64_t offset = get<uint64_t>(at);
+	const uint32_t stored_size = get<uint32_t>(at + 8);
+	const compression stored_compression = static_cast<compression>(get<uint32_t>(at + 12));
+
+	if (offset == 0) {
+		throw std::runtime_error("tile was never written");
+	}
+	if (offset + stored_size > _mapping->size()) {
+		throw std::runtime_error("tile lies outside the archive");
+	}
+
+	const size_t count = _layout.tile_width(level, tx) * _layout.tile_height(level, ty);
+	const size_t size = sample_size(_layout.sample);
+	const uint8_t* stored = _mapping->data() + offset;
+
+	scratch& buffers = thread_scratch();
+	const uint8_t* raw = stored;
+
+	if (stored_compression == compression::rle) {
+		buffers.shuffled.resize(count * size);
+		rle::decode(stored, stored + stored_size, buffers.shuffled.data(), buffers.shuffled.size());
+
+		buffers.raw.resize(count * size);
+		unshuffle(buffers.shuffled.data(), count, size, buffers.raw.data());
+		raw = buffers.raw.data();
+	}
+	else if (stored_size != count * size) {
+		throw std::runtime_error("raw tile has the wrong size");
+	}
+
+	if (_layout.sample == sample_type::uint16) {
+		for (size_t i = 0; i < count; i++) {
+			const uint16_t value = get<uint16_t>(raw + i * size);
+			out[i] = value == uint16_inside ? -1.0f : static_cast<float>(value);
+		}
+	}
+	else {
+		std::memcpy(out, raw, count * size);
+	}
+}
+
+std::vector<float> archive::reader::level(size_t level) const
+{
+	if (level >= _layout.levels) {
+		throw std::out_of_range("level outside the archive");
+	}
+
+	const size_t width = _layout.level_width(level);
+	std::vector<float> result(width * _layout.level_height(level));
+
+	const size_t tiles_x = _layout.tiles_x(level);
+	util::parallel_for(tiles_x * _layout.tiles_y(level), 1u, [&](size_t begin, size_t end, size_t) {
+		std::vector<float> tile;
+		for (size_t i = begin; i < end; i++) {
+			const size_t tx = i % tiles_x, ty = i / tiles_x;
+			const size_t tile_width = _layout.tile_width(level, tx);
+
+			tile.resize(tile_width * _layout.tile_height(level, ty));
+			read_tile(level, tx, ty, tile.data());
+
+			for (size_t y = 0; y < _layout.tile_height(level, ty); y++) {
+				std::copy(tile.data() + y * tile_width, tile.data() + (y + 1) * tile_width,
+					result.data() + (ty * _layout.tile_size + y) * width + tx * _layout.tile_size);
+			}
+		}
+	});
+
+	return result;
+}
@@ -0,0 +1,135 @@
+#include "archive.h"
+#include "parallel.h"
+
+#include <gtest/gtest.h>
+
+#include <cmath>
+#include <cstdio>
+
+namespace {
+	// smooth exterior with an interior disc, like a rendered field
+	std::vector<float> test_field(size_t width, size_t height)
+	{
+		std::vector<float> field(width * height);
+		for (size_t y = 0; y < height; y++) {
+			for (size_t x = 0; x < width; x++) {
+				const float dx = x - width / 2.0f, dy = y - height / 2.0f;
+				const float r = std::sqrt(dx * dx + dy * dy);
+				field[y * width + x] = r < height / 4.0f ? -1.0f : 1000.0f / r;
+			}
+		}
+		return field;
+	}
+
+	struct temp_file {
+		std::string name;
+		temp_file(const std::string& base) : name{ testing::TempDir() + base } {}
+		~temp_file() { std::remove(name.c_str()); }
+	};
+}
+
+TEST(Archive, FloatRoundTrip)
+{
+	temp_file file{ "float.mbf" };
+
+	archive::layout layout;
+	layout.width = 300;
+	layout.height = 200;
+	layout.tile_size = 64;
+	layout.levels = 3;
+
+	mandelbrot::input_spec spec;
+	spec.center = { -0.75, 0.1 };
+	spec.zoom_level = 2.5f;
+
+	const std::vector<float> field = test_field(300, 200);
+	{
+		archive::writer writer{ file.name, layout, archive::from_spec(spec) };
+		writer.write_field(field.data(), field.size());
+		writer.close();
+	}
+
+	archive::reader reader{ file.name };
+	ASSERT_EQ(300u, reader.layout().width);
+	ASSERT_EQ(3u, reader.layout().levels);
+	ASSERT_DOUBLE_EQ(-0.75, reader.metadata().center.real());
+	ASSERT_FLOAT_EQ(2.5f, reader.metadata().zoom_level);
+
+	ASSERT_EQ(field, reader.level(0));
+
+	// edge tile is clipped
+	std::vector<float> corner = reader.tile(0, 4, 3);
+	ASSERT_EQ(44u * 8u, corner.size());
+	ASSERT_EQ(field[199 * 300 + 299], corner.back());
+
+	std::vector<float> half = archive::downsample(field, 300, 200);
+	ASSERT_EQ(half, reader.level(1));
+	ASSERT_EQ(archive::downsample(half, 150, 100), reader.level(2));
+}
+
+TEST(Archive, Uint16RoundTrip)
+{
+	temp_file file{ "uint16.mbf" };
+
+	archive::layout layout;
+	layout.width = 100;
+	layout.height = 100;
+	layout.tile_size = 32;
+	layout.sample = archive::sample_type::uint16;
+
+	const std::vector<float> field = test_field(100, 100);
+	{
+		archive::writer writer{ file.name, layout };
+		writer.write_field(field.data(), field.size());
+	}
+
+	std::vector<float> read = archive::reader{ file.name }.level(0);
+	for (size_t i = 0; i < field.size(); i++) {
+		if (field[i] < 0.0f) {
+			ASSERT_LT(read[i], 0.0f);
+		}
+		else {
+			ASSERT_NEAR(field[i], read[i], 0.5f);
+		}
+	}
+}
+
+TEST(Archive, ParallelTiles)
+{
+	temp_file file{ "tiles.mbf" };
+
+	archive::layout layout;
+	layout.width = 64;
+	layout.height = 64;
+	layout.tile_size = 16;
+	layout.compression = archive::compression::none;
+
+	// each tile a constant, appended from all workers at once
+	{
+		archive::writer writer{ file.name, layout };
+		util::parallel_for(16u, 1u, [&](size_t begin, size_t end, size_t) {
+			std::vector<float> tile(16 * 16);
+			for (size_t i = begin; i < end; i++) {
+				std::fill(tile.begin(), tile.end(), float(i));
+				writer.write_tile(0, i % 4, i / 4, tile.data());
+			}
+		});
+		writer.close();
+	}
+
+	archive::reader reader{ file.name };
+	ASSERT_EQ(std::vector<float>(16 * 16, 6.0f), reader.tile(0, 2, 1));
+	ASSERT_THROW(reader.tile(0, 4, 0), std::out_of_range);
+}
+
+TEST(Archive, RejectsOtherFiles)
+{
+	temp_file file{ "not_an_archive.mbf" };
+	{
+		std::FILE* out = std::fopen(file.name.c_str(), "wb");
+		std::fputs("definitely not an archive, but long enough to hold a header of eighty bytes....", out);
+		std::fclose(out);
+	}
+
+	ASSERT_THROW(archive::reader{ file.name }, std::runtime_error);
+}
@@ -0,0 +1,121 @@
+#pragma once
+
+#include "mandelbrot.h"
+
+#include <atomic>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace archive {
+	// how samples are stored, uint16 keeps the whole escape count with 0xffff inside the set
+	enum class sample_type : uint32_t { float32 = 0, uint16 = 1 };
+
+	// per tile, tiles that do not shrink are stored raw whatever the archive asks for
+	enum class compression : uint32_t { none = 0, rle = 1 };
+
+	struct layout {
+		size_t width{ 0 }, height{ 0 };
+		size_t tile_size{ 256 };
+		// level 0 is full resolution, each further level halves both axes
+		size_t levels{ 1 };
+		archive::sample_type sample{ archive::sample_type::float32 };
+		archive::compression compression{ archive::compression::rle };
+
+		size_t level_width(size_t level) const { return (width + (size_t(1) << level) - 1) >> level; }
+		size_t level_height(size_t level) const { return (height + (size_t(1) << level) - 1) >> level; }
+		size_t tiles_x(size_t level) const { return (level_width(level) + tile_size - 1) / tile_size; }
+		size_t tiles_y(size_t level) const { return (level_height(level) + tile_size - 1) / tile_size; }
+
+		// tiles are indexed level by level, row by row
+		size_t tile_count() const;
+		size_t tile_index(size_t level, size_t tx, size_t ty) const;
+
+		// edge tiles are clipped to the level
+		size_t tile_width(size_t level, size_t tx) const;
+		size_t tile_height(size_t level, size_t ty) const;
+	};
+
+	// what the field was rendered from, so it can be recoloured later
+	struct metadata {
+		std::complex<double> center;
+		float zoom_level{ 0.0f };
+		size_t max_iterations{ 0 };
+	};
+
+	metadata from_spec(const mandelbrot::input_spec& spec);
+
+	// File layout, little endian
+	//
+	//   header   magic "MBAF", version, layout, metadata, index offset
+	//   index    per tile: data offset, stored size, compression
+	//   tiles    appended in the order they were written
+	//
+	// The index sits right after the header so readers find any tile with
+	// two lookups. Tiles may be written from several threads at once, each
+	// takes its offset from an atomic end of file and writes positionally.
+	class writer {
+	private:
+		class file;
+		struct entry;
+
+		std::unique_ptr<file> _file;
+		archive::layout _layout;
+		archive::metadata _metadata;
+		std::unique_ptr<entry[]> _index;
+		std::atomic<uint64_t> _end;
+		bool _closed{ false };
+		// scratch of write_field, the levels from 1 down and a tile per worker
+		std::vector<util::buffer<float>> _levels;
+		std::vector<util::buffer<float>> _tiles;
+
+	public:
+		writer(const std::string& filename, const archive::layout& layout, const archive::metadata& metadata = {});
+		~writer();
+
+		writer(const writer&) = delete;
+		writer& operator=(const writer&) = delete;
+
+		const archive::layout& layout() const { return _layout; }
+
+		// thread safe, samples are tile_width x tile_height row major escape counts
+		void write_tile(size_t level, size_t tx, size_t ty, const float* samples);
+
+		// builds every level from a level 0 field and writes all tiles in parallel
+		void write_field(const float* escape, size_t count);
+
+		// writes the index and header, the file is not readable before
+		void close();
+	};
+
+	// Maps an archive read only, tiles are decoded on demand so only the
+	// pages of the requested tiles are touched.
+	class reader {
+	private:
+		class mapping;
+
+		std::unique_ptr<mapping> _mapping;
+		archive::layout _layout;
+		archive::metadata _metadata;
+		const uint8_t* _index{ nullptr };
+
+	public:
+		reader(const std::string& filename);
+		~reader();
+
+		const archive::layout& layout() const { return _layout; }
+		const archive::metadata& metadata() const { return _metadata; }
+
+		// escape counts of one tile, negative inside the set
+		std::vector<float> tile(size_t level, size_t tx, size_t ty) const;
+		void read_tile(size_t level, size_t tx, size_t ty, float* out) const;
+
+		// a whole level assembled from its tiles
+		std::vector<float> level(size_t level) const;
+	};
+
+	// halves a field on each axis, a pixel stays exterior when at least half of its samples are
+	std::vector<float> downsample(const std::vector<float>& field, size_t width, size_t height);
+	// into half, (width + 1) / 2 x (height + 1) / 2 samples
+	void downsample(const float* field, size_t width, size_t height, float* half);
+}
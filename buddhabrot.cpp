@@ -0,0 +1,463 @@
+
+#include "buddhabrot.h"
+#include "coloring.h"
+#include "parallel.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <stdexcept>
+
+namespace {
+	constexpr const char magic[4] = { 'M', 'B', 'O', 'D' };
+	constexpr const uint32_t version = 1;
+
+	constexpr const size_t header_size = 112;
+
+	// orbits per chunk of work, each chunk of orbit numbers draws from its own
+	// seed wherever runs start and stop, so a run resumed after any number of
+	// orbits draws what a straight run would
+	constexpr const uint64_t chunk_orbits = 4096;
+
+	// orbit weights are summed in fixed point, so the density does not depend
+	// on which worker ran which chunk or on how the orbits were split into runs
+	constexpr const double weight_scale = double(1 << 20);
+
+	// bytes of private worker densities at most, about 4 Mpixel for one worker
+	constexpr const size_t private_budget = size_t(1) << 27;
+
+	// starting points are drawn from [-domain, domain]^2
+	constexpr const double domain = 2.0;
+
+	// importance map over the domain, probed with a few orbits per cell
+	constexpr const size_t cells_per_axis = 128;
+	constexpr const size_t probes_per_cell = 4;
+
+	// importance of a cell without contributing probes, keeps every start reachable
+	constexpr const double floor_importance = 0.02;
+
+	template<typename T>
+	void put(uint8_t* at, T value) { std::memcpy(at, &value, sizeof(T)); }
+
+	template<typename T>
+	T get(const uint8_t* at)
+	{
+		T value;
+		std::memcpy(&value, at, sizeof(T));
+		return value;
+	}
+
+	// splitmix64, one per chunk so the draws do not depend on scheduling
+	struct splitmix {
+		uint64_t state;
+
+		uint64_t next()
+		{
+			uint64_t z = (state += 0x9e3779b97f4a7c15ull);
+			z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ull;
+			z = (z ^ (z >> 27)) * 0x94d049bb133111ebull;
+			return z ^ (z >> 31);
+		}
+
+		// as if count draws were made
+		void skip(uint64_t count) { state += count * 0x9e3779b97f4a7c15ull; }
+
+		// [0, 1)
+		double uniform() { return static_cast<double>(next() >> 11) * (1.0 / 9007199254740992.0); }
+	};
+
+	uint64_t seed_of(uint64_t seed, uint64_t stream)
+	{
+		return splitmix{ seed ^ (stream * 0xd1b54a32d192ed03ull) }.next();
+	}
+
+	// main cardioid and period 2 bulb, their orbits never escape
+	bool in_main_bulbs(double re, double im)
+	{
+		const double x = re - 0.25;
+		const double q = x * x + im * im;
+		if (q * (q + x) <= 0.25 * im * im) {
+			return true;
+		}
+		return (re + 1.0) * (re + 1.0) + im * im <= 1.0 / 16.0;
+	}
+
+	// iterations until |z| > 2, 0 when c does not escape within max_iterations,
+	// the orbit is kept in orbit when given
+	size_t escape_time(double cr, double ci, size_t max_iterations, std::complex<double>* orbit)
+	{
+		double zr = 0.0, zi = 0.0;
+		for (size_t i = 0; i < max_iterations; i++) {
+			const double r = zr * zr - zi * zi + cr;
+			zi = 2.0 * zr * zi + ci;
+			zr = r;
+			if (orbit) {
+				orbit[i] = { zr, zi };
+			}
+			if (zr * zr + zi * zi > 4.0) {
+				return i + 1;
+			}
+		}
+		return 0;
+	}
+
+	bool contributes(const buddhabrot::channel& channel, size_t escaped_after)
+	{
+		return escaped_after != 0 && escaped_after >= channel.min_iterations && escaped_after < channel.max_iterations;
+	}
+
+	size_t longest(const buddhabrot::channels& channels)
+	{
+		size_t result = 0;
+		for (const buddhabrot::channel& channel : channels) {
+			result = std::max(result, channel.max_iterations);
+		}
+		return result;
+	}
+
+	// cumulative, normalised importance of each cell, row major
+	std::vector<double> importance_map(const buddhabrot::settings& settings)
+	{
+		const size_t cells = cells_per_axis * cells_per_axis;
+		const double cell_size = 2.0 * domain / cells_per_axis;
+		const size_t max_iterations = longest(settings.channels);
+
+		std::vector<double> importance(cells);
+		util::parallel_for(cells, 64u, [&](size_t begin, size_t end, size_t) {
+			for (size_t cell = begin; cell < end; cell++) {
+				splitmix rng{ seed_of(settings.seed, ~uint64_t(cell)) };
+				size_t hits = 0;
+
+				for (size_t probe = 0; probe < probes_per_cell; probe++) {
+					const double re = -domain + (cell % cells_per_axis + rng.uniform()) * cell_size;
+					const double im = -domain + (cell / cells_per_axis + rng.uniform()) * cell_size;
+					if (in_main_bulbs(re, im)) {
+						continue;
+					}
+
+					const size_t escaped_after = escape_time(re, im, max_iterations, nullptr);
+					for (const buddhabrot::channel& channel : settings.channels) {
+						if (contributes(channel, escaped_after)) {
+							hits++;
+							break;
+						}
+					}
+				}
+
+				importance[cell] = double(hits) / probes_per_cell + floor_importance;
+			}
+		});
+
+		double total = 0.0;
+		for (double& value : importance) {
+			total += value;
+			value = total;
+		}
+		for (double& value : importance) {
+			value /= total;
+		}
+		return importance;
+	}
+}
+
+buddhabrot::channels buddhabrot::buddhabrot_channels(size_t max_iterations)
+{
+	const channel all{ 0, max_iterations };
+	return { all, all, all };
+}
+
+buddhabrot::channels buddhabrot::nebulabrot_channels(size_t max_iterations)
+{
+	return { {
+		{ 0, max_iterations },
+		{ 0, std::max<size_t>(max_iterations / 10, 1) },
+		{ 0, std::max<size_t>(max_iterations / 100, 1) },
+	} };
+}
+
+bool buddhabrot::compatible(const settings& a, const settings& b)
+{
+	for (size_t channel = 0; channel < a.channels.size(); channel++) {
+		if (a.channels[channel].min_iterations != b.channels[channel].min_iterations
+			|| a.channels[channel].max_iterations != b.channels[channel].max_iterations) {
+			return false;
+		}
+	}
+
+	return a.view.output_width == b.view.output_width
+		&& a.view.output_height == b.view.output_height
+		&& a.view.center == b.view.center
+		&& a.view.zoom_level == b.view.zoom_level
+		&& a.seed == b.seed
+		&& a.importance == b.importance;
+}
+
+buddhabrot::accumulator::accumulator(const buddhabrot::settings& settings)
+	: _settings{ settings }
+{
+	if (settings.view.output_width == 0 || settings.view.output_height == 0) {
+		throw std::runtime_error("buddhabrot image must not be empty");
+	}
+
+	_fixed = std::vector<std::atomic<uint64_t>>(3 * settings.view.output_width * settings.view.output_height);
+
+	if (settings.importance) {
+		_cells = importance_map(settings);
+	}
+}
+
+void buddhabrot::accumulator::run(uint64_t count)
+{
+	const size_t width = _settings.view.output_width;
+	const size_t height = _settings.view.output_height;
+	const size_t pixels = width * height;
+	const size_t max_iterations = longest(_settings.channels);
+
+	const double step = util::step_size(_settings.view.zoom_level);
+	const double left = _settings.view.center.real() - (width / 2) * step - 0.5 * step;
+	const double top = _settings.view.center.imag() - (height / 2) * step - 0.5 * step;
+
+	const size_t cells = _cells.size();
+	const double cell_size = 2.0 * domain / cells_per_axis;
+
+	if (_workers.empty()) {
+		_workers.resize(util::workers());
+	}
+	const bool private_densities = _workers.size() * 3 * pixels * sizeof(uint64_t) <= private_budget;
+
+	// draws of one starting point
+	const uint64_t draws = cells == 0 ? 2 : 3;
+
+	// chunks of orbit numbers the run overlaps, the first and last may be partial
+	const uint64_t first = _orbits;
+	const uint64_t last = first + count;
+	const uint64_t first_chunk = first / chunk_orbits;
+	const uint64_t chunks = count == 0 ? 0 : (last + chunk_orbits - 1) / chunk_orbits - first_chunk;
+
+	util::parallel_for(static_cast<size_t>(chunks), 1u, [&](size_t begin, size_t end, size_t worker) {
+		accumulator::worker& own = _workers[worker];
+		if (own.orbit.empty()) {
+			own.orbit.resize(max_iterations);
+		}
+		if (private_densities && own.density.empty()) {
+			own.density.assign(3 * pixels, 0u);
+		}
+
+		for (size_t chunk = begin; chunk < end; chunk++) {
+			const uint64_t chunk_start = (first_chunk + chunk) * chunk_orbits;
+			const uint64_t start = std::max(chunk_start, first);
+			const uint64_t stop = std::min(chunk_start + chunk_orbits, last);
+			splitmix rng{ seed_of(_settings.seed, chunk_start) };
+			rng.skip((start - chunk_start) * draws);
+
+			for (uint64_t sample = start; sample < stop; sample++) {
+				double re, im, weight = 1.0;
+				if (cells == 0) {
+					re = -domain + 2.0 * domain * rng.uniform();
+					im = -domain + 2.0 * domain * rng.uniform();
+				}
+				else {
+					// cell drawn by importance, weighted back to a uniform draw
+					const size_t cell = std::min<size_t>(cells - 1,
+						std::upper_bound(_cells.begin(), _cells.end(), rng.uniform()) - _cells.begin());
+					const double probability = _cells[cell] - (cell > 0 ? _cells[cell - 1] : 0.0);
+					weight = 1.0 / (probability * cells);
+					re = -domain + (cell % cells_per_axis + rng.uniform()) * cell_size;
+					im = -domain + (cell / cells_per_axis + rng.uniform()) * cell_size;
+				}
+
+				if (in_main_bulbs(re, im)) {
+					continue;
+				}
+
+				const size_t escaped_after = escape_time(re, im, max_iterations, own.orbit.data());
+
+				bool use[3];
+				bool any = false;
+				for (size_t channel = 0; channel < 3; channel++) {
+					use[channel] = contributes(_settings.channels[channel], escaped_after);
+					any |= use[channel];
+				}
+				if (!any) {
+					continue;
+				}
+				const uint64_t fixed_weight = static_cast<uint64_t>(weight * weight_scale + 0.5);
+
+				for (size_t i = 0; i < escaped_after; i++) {
+					const double x = std::floor((own.orbit[i].real() - left) / step);
+					const double y = std::floor((own.orbit[i].imag() - top) / step);
+					if (x < 0.0 || y < 0.0 || x >= double(width) || y >= double(height)) {
+						continue;
+					}
+
+					const size_t index = 3 * (static_cast<size_t>(y) * width + static_cast<size_t>(x));
+					for (size_t channel = 0; channel < 3; channel++) {
+						if (!use[channel]) {
+							continue;
+						}
+						if (private_densities) {
+							own.density[index + channel] += fixed_weight;
+						}
+						else {
+							_fixed[index + channel].fetch_add(fixed_weight, std::memory_order_relaxed);
+						}
+					}
+				}
+			}
+		}
+	});
+
+	_orbits += count;
+	_unflushed = private_densities;
+}
+
+void buddhabrot::accumulator::flush()
+{
+	if (!_unflushed) {
+		return;
+	}
+
+	// reduction of the worker buffers, parallel over pixels
+	util::parallel_for(_fixed.size(), 4096u, [&](size_t begin, size_t end, size_t) {
+		for (size_t i = begin; i < end; i++) {
+			uint64_t sum = 0;
+			for (worker& own : _workers) {
+				if (!own.density.empty()) {
+					sum += own.density[i];
+					own.density[i] = 0u;
+				}
+			}
+			_fixed[i].fetch_add(sum, std::memory_order_relaxed);
+		}
+	});
+
+	_unflushed = false;
+}
+
+void buddhabrot::accumulator::check_flushed() const
+{
+	if (_unflushed) {
+		throw std::runtime_error("buddhabrot densities read before flush");
+	}
+}
+
+std::vector<double> buddhabrot::accumulator::density(size_t channel) const
+{
+	check_flushed();
+
+	std::vector<double> result(_fixed.size() / 3);
+	for (size_t i = 0; i < result.size(); i++) {
+		result[i] = double(_fixed[3 * i + channel].load(std::memory_order_relaxed)) / weight_scale;
+	}
+	return result;
+}
+
+void buddhabrot::accumulator::save(const std::string& filename) const
+{
+	std::vector<uint8_t> header(header_size, 0);
+	std::memcpy(header.data(), magic, sizeof(magic));
+	put<uint32_t>(header.data() + 4, version);
+	put<uint64_t>(header.data() + 8, _settings.view.output_width);
+	put<uint64_t>(header.data() + 16, _settings.view.output_height);
+	put<double>(header.data() + 24, _settings.view.center.real());
+	put<double>(header.data() + 32, _settings.view.center.imag());
+	put<float>(header.data() + 40, _settings.view.zoom_level);
+	put<uint32_t>(header.data() + 44, _settings.importance ? 1 : 0);
+	put<uint64_t>(header.data() + 48, _settings.seed);
+	for (size_t channel = 0; channel < 3; channel++) {
+		put<uint64_t>(header.data() + 56 + channel * 16, _settings.channels[channel].min_iterations);
+		put<uint64_t>(header.data() + 64 + channel * 16, _settings.channels[channel].max_iterations);
+	}
+	put<uint64_t>(header.data() + 104, _orbits);
+
+	check_flushed();
+
+	const std::string temporary = filename + ".tmp";
+	{
+		std::ofstream out{ temporary, std::ios_base::out | std::ios_base::binary | std::ios_base::trunc };
+		out.write(reinterpret_cast<const char*>(header.data()), header.size());
+		for (size_t channel = 0; channel < 3; channel++) {
+			const std::vector<double> density = this->density(channel);
+			out.write(reinterpret_cast<const char*>(density.data()), density.size() * sizeof(double));
+		}
+		if (!out.flush()) {
+			throw std::runtime_error("unable to write checkpoint " + temporary);
+		}
+	}
+
+	std::filesystem::rename(temporary, filename);
+}
+
+buddhabrot::accumulator buddhabrot::accumulator::load(const std::string& filename)
+{
+	std::ifstream in{ filename, std::ios_base::in | std::ios_base::binary };
+	if (!in) {
+		throw std::runtime_error("unable to open checkpoint " + filename);
+	}
+
+	std::vector<uint8_t> header(header_size);
+	if (!in.read(reinterpret_cast<char*>(header.data()), header.size()) || std::memcmp(header.data(), magic, sizeof(magic)) != 0) {
+		throw std::runtime_error(filename + " is not a buddhabrot checkpoint");
+	}
+	if (get<uint32_t>(header.data() + 4) != version) {
+		throw std::runtime_error(filename + " has an unsupported checkpoint version");
+	}
+
+	buddhabrot::settings settings;
+	settings.view.output_width = static_cast<size_t>(get<uint64_t>(header.data() + 8));
+	settings.view.output_height = static_cast<size_t>(get<uint64_t>(header.data() + 16));
+	settings.view.center = { get<double>(header.data() + 24), get<double>(header.data() + 32) };
+	settings.view.zoom_level = get<float>(header.data() + 40);
+	settings.importance = get<uint32_t>(header.data() + 44) != 0;
+	settings.seed = get<uint64_t>(header.data() + 48);
+	for (size_t channel = 0; channel < 3; channel++) {
+		settings.channels[channel].min_iterations = static_cast<size_t>(get<uint64_t>(header.data() + 56 + channel * 16));
+		settings.channels[channel].max_iterations = static_cast<size_t>(get<uint64_t>(header.data() + 64 + channel * 16));
+	}
+	settings.view.max_iterations = settings.channels[0].max_iterations;
+
+	accumulator result{ settings };
+	result._orbits = get<uint64_t>(header.data() + 104);
+	// saved densities are whole multiples of the fixed point step
+	std::vector<double> density(result._fixed.size() / 3);
+	for (size_t channel = 0; channel < 3; channel++) {
+		if (!in.read(reinterpret_cast<char*>(density.data()), density.size() * sizeof(double))) {
+			throw std::runtime_error(filename + " is truncated");
+		}
+		for (size_t i = 0; i < density.size(); i++) {
+			result._fixed[3 * i + channel].store(static_cast<uint64_t>(std::llround(density[i] * weight_scale)), std::memory_order_relaxed);
+		}
+	}
+
+	return result;
+}
+
+void buddhabrot::accumulator::render(mandelbrot::host_output& output, float gamma) const
+{
+	if (output.width != _settings.view.output_width || output.height != _settings.view.output_height) {
+		throw std::runtime_error("output size does not match the buddhabrot");
+	}
+
+	check_flushed();
+
+	std::array<uint64_t, 3> brightest{};
+	for (size_t i = 0; i < _fixed.size(); i++) {
+		brightest[i % 3] = std::max(brightest[i % 3], _fixed[i].load(std::memory_order_relaxed));
+	}
+	std::array<double, 3> scale{};
+	for (size_t channel = 0; channel < 3; channel++) {
+		scale[channel] = brightest[channel] > 0 ? 1.0 / double(brightest[channel]) : 0.0;
+	}
+
+	util::parallel_for(output.out.size(), 4096u, [&](size_t begin, size_t end, size_t) {
+		for (size_t i = begin; i < end; i++) {
+			float value[3];
+			for (size_t channel = 0; channel < 3; channel++) {
+				value[channel] = std::pow(static_cast<float>(double(_fixed[3 * i + channel].load(std::memory_order_relaxed)) * scale[channel]), gamma);
+			}
+			output.out[i] = coloring::pack(value[0], value[1], value[2]);
+		}
+	});
+}
@@ -0,0 +1,147 @@
+#include "buddhabrot.h"
+
+#include <gtest/gtest.h>
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <numeric>
+
+namespace {
+	buddhabrot::settings test_settings()
+	{
+		buddhabrot::settings settings;
+		settings.view.center = { -0.5, 0.0 };
+		settings.view.output_width = 48;
+		settings.view.output_height = 48;
+		// 0.08 per pixel, the whole set
+		settings.view.zoom_level = -1.6f;
+		settings.channels = buddhabrot::buddhabrot_channels(200);
+		return settings;
+	}
+
+	double total(const std::vector<double>& density)
+	{
+		return std::accumulate(density.begin(), density.end(), 0.0);
+	}
+
+	struct temp_file {
+		std::string name;
+		temp_file(const std::string& base) : name{ testing::TempDir() + base } {}
+		~temp_file() { std::remove(name.c_str()); }
+	};
+}
+
+TEST(Buddhabrot, SymmetricAboutTheRealAxis)
+{
+	buddhabrot::accumulator density{ test_settings() };
+	density.run(50000);
+	density.flush();
+
+	ASSERT_EQ(50000u, density.orbits());
+
+	// rows mirrored about row 24, which is centred on the axis, get about the same orbit points
+	const std::vector<double>& field = density.density(0);
+	double upper = 0.0, lower = 0.0;
+	for (size_t y = 1; y < 24; y++) {
+		for (size_t x = 0; x < 48; x++) {
+			lower += field[y * 48 + x];
+			upper += field[(48 - y) * 48 + x];
+		}
+	}
+	ASSERT_GT(upper, 0.0);
+	ASSERT_NEAR(1.0, upper / lower, 0.1);
+}
+
+TEST(Buddhabrot, ImportanceSamplingIsUnbiased)
+{
+	buddhabrot::settings settings = test_settings();
+	settings.importance = false;
+	buddhabrot::accumulator uniform{ settings };
+	uniform.run(200000);
+	uniform.flush();
+
+	settings.importance = true;
+	buddhabrot::accumulator importance{ settings };
+	importance.run(200000);
+	importance.flush();
+
+	// same expected density per orbit sampled
+	ASSERT_NEAR(1.0, total(importance.density(0)) / total(uniform.density(0)), 0.1);
+}
+
+TEST(Buddhabrot, NebulabrotChannels)
+{
+	buddhabrot::settings settings = test_settings();
+	settings.channels = buddhabrot::nebulabrot_channels(1000);
+	buddhabrot::accumulator density{ settings };
+	density.run(20000);
+	density.flush();
+
+	// shorter orbit limits keep a subset of the orbits
+	ASSERT_GT(total(density.density(0)), total(density.density(1)));
+	ASSERT_GT(total(density.density(1)), total(density.density(2)));
+	ASSERT_GT(total(density.density(2)), 0.0);
+}
+
+TEST(Buddhabrot, LargeImagesShareTheirDensities)
+{
+	buddhabrot::accumulator small{ test_settings() };
+	small.run(20000);
+	small.flush();
+
+	// 32 times the pixels along each side, too many for private worker densities
+	buddhabrot::settings settings = test_settings();
+	settings.view.output_width *= 32;
+	settings.view.output_height *= 32;
+	settings.view.zoom_level += static_cast<float>(std::log10(32.0));
+	buddhabrot::accumulator large{ settings };
+	large.run(20000);
+
+	// nothing left to flush, same orbits over nearly the same region
+	ASSERT_NEAR(1.0, total(large.density(0)) / total(small.density(0)), 0.05);
+}
+
+TEST(Buddhabrot, CheckpointResumes)
+{
+	temp_file file{ "buddhabrot_test.mbod" };
+
+	buddhabrot::accumulator straight{ test_settings() };
+	straight.run(16384);
+	straight.flush();
+
+	// stopped within a chunk
+	buddhabrot::accumulator first{ test_settings() };
+	first.run(3000);
+	first.run(2000);
+	first.flush();
+	first.save(file.name);
+
+	buddhabrot::accumulator resumed = buddhabrot::accumulator::load(file.name);
+	ASSERT_TRUE(buddhabrot::compatible(resumed.settings(), test_settings()));
+	ASSERT_EQ(5000u, resumed.orbits());
+	ASSERT_EQ(first.density(0), resumed.density(0));
+
+	// chunks of orbit numbers draw from their own seeds so resuming continues the same sequence
+	resumed.run(11384);
+	resumed.flush();
+	ASSERT_EQ(straight.density(0), resumed.density(0));
+}
+
+TEST(Buddhabrot, Render)
+{
+	buddhabrot::accumulator density{ test_settings() };
+	density.run(10000);
+
+	// the orbits of the run are still in the worker buffers
+	mandelbrot::host_output output{ 48, 48 };
+	ASSERT_THROW(density.render(output), std::runtime_error);
+
+	density.flush();
+	density.render(output);
+
+	ASSERT_NE(output.out.end(), std::find_if(output.out.begin(), output.out.end(), [](uint32_t pixel) { return pixel != 0u; }));
+
+	mandelbrot::host_output wrong{ 10, 10 };
+	ASSERT_THROW(density.render(wrong), std::runtime_error);
+}
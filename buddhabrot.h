@@ -0,0 +1,98 @@
+#pragma once
+
+#include "mandelbrot.h"
+
+#include <array>
+#include <atomic>
+#include <string>
+
+namespace buddhabrot {
+	// orbits escaping after [min_iterations, max_iterations) iterations are accumulated into a channel
+	struct channel {
+		size_t min_iterations{ 0 };
+		size_t max_iterations{ 1000 };
+	};
+
+	// red, green and blue, all alike for a buddhabrot
+	using channels = std::array<channel, 3>;
+
+	channels buddhabrot_channels(size_t max_iterations);
+
+	// red keeps max_iterations, green and blue a tenth and a hundredth of it
+	channels nebulabrot_channels(size_t max_iterations);
+
+	struct settings {
+		// centre, zoom and size of the image the orbits are plotted into
+		mandelbrot::input_spec view;
+		buddhabrot::channels channels;
+		uint64_t seed{ 1 };
+		// sample starting points where contributing orbits were found, weighted back to uniform
+		bool importance{ true };
+	};
+
+	// checkpoints can only be resumed with the settings they were started with
+	bool compatible(const settings& a, const settings& b);
+
+	// Orbit densities of starting points sampled over |c| < 2, summed in
+	// fixed point. While every worker's private buffer fits a fixed budget,
+	// orbits are traced into those, kept across runs and added to the shared
+	// densities by a parallel reduction in flush(). Larger images are traced
+	// straight into the shared densities with atomic adds. Each chunk of
+	// orbits draws from its own seed, so densities do not depend on the
+	// number of workers.
+	class accumulator {
+	private:
+		// private densities and orbit scratch of one worker, the three channels
+		// of a pixel are adjacent so a point touches one cache line
+		struct worker {
+			std::vector<uint64_t> density;
+			std::vector<std::complex<double>> orbit;
+		};
+
+		buddhabrot::settings _settings;
+		uint64_t _orbits{ 0 };
+		// fixed point densities up to the last flush, channels interleaved
+		std::vector<std::atomic<uint64_t>> _fixed;
+		// cumulative importance of the cells starting points are drawn from
+		std::vector<double> _cells;
+		// orbits traced since the last flush, no densities for workers that
+		// ran none or when the image is over the budget
+		std::vector<worker> _workers;
+		bool _unflushed{ false };
+
+		// reading the densities before flush() would miss orbits
+		void check_flushed() const;
+
+	public:
+		accumulator(const buddhabrot::settings& settings);
+
+		const buddhabrot::settings& settings() const { return _settings; }
+
+		// orbits sampled so far
+		uint64_t orbits() const { return _orbits; }
+
+		// samples count more orbits into the worker buffers
+		void run(uint64_t count);
+
+		// adds the worker buffers to the densities and clears them, the
+		// densities, save and render throw std::runtime_error until the
+		// orbits of every run are flushed
+		void flush();
+
+		// per pixel density of channel, weighted orbit points
+		std::vector<double> density(size_t channel) const;
+
+		// File layout, little endian
+		//
+		//   header   magic "MBOD", version, settings, orbits sampled
+		//   density  width x height doubles per channel
+		//
+		// Saved to a temporary file first and renamed over filename, so a crash
+		// while saving leaves the previous checkpoint.
+		void save(const std::string& filename) const;
+		static accumulator load(const std::string& filename);
+
+		// densities scaled by their brightest pixel and raised to gamma, channel 0 is red
+		void render(mandelbrot::host_output& output, float gamma = 0.5f) const;
+	};
+}
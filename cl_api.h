@@ -0,0 +1,40 @@
+#pragma once
+
+#include <CL/cl.h>
+
+namespace compute {
+	// OpenCL entry points the gpu backend calls, through a table so tests can
+	// substitute a double that injects faults on a machine without a device
+	struct cl_api {
+		decltype(&::clGetPlatformIDs) clGetPlatformIDs;
+		decltype(&::clGetDeviceIDs) clGetDeviceIDs;
+		decltype(&::clGetDeviceInfo) clGetDeviceInfo;
+		decltype(&::clCreateContext) clCreateContext;
+		decltype(&::clReleaseContext) clReleaseContext;
+		decltype(&::clCreateCommandQueue) clCreateCommandQueue;
+		decltype(&::clReleaseCommandQueue) clReleaseCommandQueue;
+		decltype(&::clCreateBuffer) clCreateBuffer;
+		decltype(&::clCreateImage) clCreateImage;
+		decltype(&::clReleaseMemObject) clReleaseMemObject;
+		decltype(&::clCreateProgramWithSource) clCreateProgramWithSource;
+		decltype(&::clBuildProgram) clBuildProgram;
+		decltype(&::clGetProgramBuildInfo) clGetProgramBuildInfo;
+		decltype(&::clReleaseProgram) clReleaseProgram;
+		decltype(&::clCreateKernel) clCreateKernel;
+		decltype(&::clReleaseKernel) clReleaseKernel;
+		decltype(&::clSetKernelArg) clSetKernelArg;
+		decltype(&::clEnqueueWriteBuffer) clEnqueueWriteBuffer;
+		decltype(&::clEnqueueReadBuffer) clEnqueueReadBuffer;
+		decltype(&::clEnqueueFillBuffer) clEnqueueFillBuffer;
+		decltype(&::clEnqueueReadImage) clEnqueueReadImage;
+		decltype(&::clEnqueueNDRangeKernel) clEnqueueNDRangeKernel;
+		decltype(&::clFinish) clFinish;
+	};
+
+	// the OpenCL library's own entry points
+	const cl_api& native_cl_api();
+
+	// table in use, native_cl_api() unless replaced, only swap it while no
+	// gpu_context exists
+	cl_api& cl();
+}
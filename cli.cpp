@@ -0,0 +1,303 @@
+
+#include "cli.h"
+
+#include <algorithm>
+#include <stdexcept>
+#include <utility>
+
+namespace {
+	// seahorse valley, the scene rendered when nothing else is given
+	const std::complex<double> default_center{ -0.743643887037158704752191506114774, 0.131825904205311970493132056385139 };
+
+	std::pair<std::string, std::string> split(const std::string& text, char separator)
+	{
+		const size_t at = text.find(separator);
+		if (at == std::string::npos) {
+			return { text, std::string{} };
+		}
+		return { text.substr(0, at), text.substr(at + 1) };
+	}
+
+	double to_double(const std::string& text, const std::string& option)
+	{
+		size_t used = 0;
+		double value = 0.0;
+		try {
+			value = std::stod(text, &used);
+		}
+		catch (const std::exception&) {
+			used = 0;
+		}
+		if (used == 0 || used != text.size()) {
+			throw std::runtime_error("invalid number '" + text + "' for " + option);
+		}
+		return value;
+	}
+
+	size_t to_count(const std::string& text, const std::string& option)
+	{
+		const double value = to_double(text, option);
+		if (value < 0 || value != static_cast<double>(static_cast<size_t>(value))) {
+			throw std::runtime_error("invalid count '" + text + "' for " + option);
+		}
+		return static_cast<size_t>(value);
+	}
+
+	// value given on the command line, optionally swept FROM:TO
+	template<typename T>
+	struct sweep {
+		bool given{ false };
+		T from{}, to{};
+		bool has_to{ false };
+	};
+
+	template<typename T, typename Convert>
+	sweep<T> parse_sweep(const std::string& text, const std::string& option, Convert convert)
+	{
+		auto parts = split(text, ':');
+		sweep<T> result;
+		result.given = true;
+		result.from = convert(parts.first, option);
+		result.to = result.from;
+		if (!parts.second.empty()) {
+			result.to = convert(parts.second, option);
+			result.has_to = true;
+		}
+		return result;
+	}
+}
+
+cli::options cli::parse(int argc, const char* const argv[])
+{
+	options result;
+
+	std::string scene_file;
+	std::string size, frames, count, fps, center, interpolation, coloring, precision, formula, power, julia;
+	sweep<double> zoom;
+	sweep<size_t> iterations;
+
+	for (int i = 1; i < argc; i++) {
+		const std::string arg = argv[i];
+
+		auto value = [&]() -> std::string {
+			if (i + 1 >= argc) {
+				throw std::runtime_error("missing value for " + arg);
+			}
+			return argv[++i];
+		};
+
+		if (arg == "--help" || arg == "-h") result.help = true;
+		else if (arg == "--scene") scene_file = value();
+		else if (arg == "--size") size = value();
+		else if (arg == "--frames") frames = value();
+		else if (arg == "--count") count = value();
+		else if (arg == "--fps") fps = value();
+		else if (arg == "--center") center = value();
+		else if (arg == "--zoom") zoom = parse_sweep<double>(value(), arg, to_double);
+		else if (arg == "--iterations") iterations = parse_sweep<size_t>(value(), arg, to_count);
+		else if (arg == "--coloring") coloring = value();
+		else if (arg == "--precision") precision = value();
+		else if (arg == "--formula") formula = value();
+		else if (arg == "--power") power = value();
+		else if (arg == "--julia") julia = value();
+		else if (arg == "--interpolation") interpolation = value();
+		else if (arg == "--backend") {
+			const std::string name = value();
+			if (name == "gpu") result.backend = backend::gpu;
+			else if (name == "host") result.backend = backend::host;
+			else throw std::runtime_error("unknown backend " + name);
+		}
+		else if (arg == "--format") {
+			const std::string name = value();
+			if (name == "y4m") result.format = format::y4m;
+			else if (name == "rle") result.format = format::rle;
+			else if (name == "tiff") result.format = format::tiff;
+			else throw std::runtime_error("unknown format " + name);
+		}
+		else if (arg == "--schedule") {
+			const std::string name = value();
+			if (name == "fixed") result.schedule = mandelbrot::schedule::fixed;
+			else if (name == "compacted") result.schedule = mandelbrot::schedule::compacted;
+			else throw std::runtime_error("unknown schedule " + name);
+		}
+		else if (arg == "--mode") {
+			const std::string name = value();
+			if (name == "escape") result.mode = mode::escape;
+			else if (name == "buddhabrot") result.mode = mode::buddhabrot;
+			else if (name == "nebulabrot") result.mode = mode::nebulabrot;
+			else throw std::runtime_error("unknown mode " + name);
+		}
+		else if (arg == "--samples") result.samples = to_count(value(), arg);
+		else if (arg == "--seed") result.seed = to_count(value(), arg);
+		else if (arg == "--checkpoint") result.checkpoint = value();
+		else if (arg == "--serve") {
+			const std::string listen = value();
+			const size_t colon = listen.rfind(':');
+			if (colon != std::string::npos) {
+				result.serve_address = listen.substr(0, colon);
+			}
+			const size_t port = to_count(listen.substr(colon == std::string::npos ? 0 : colon + 1), arg);
+			if (port > 65535) {
+				throw std::runtime_error("invalid port in " + listen);
+			}
+			result.serve = true;
+			result.serve_port = static_cast<uint16_t>(port);
+		}
+		else if (arg == "--tile-cache") result.tile_cache_mb = to_count(value(), arg);
+		else if (arg == "--output") result.output = value();
+		else if (arg == "--pipe") result.pipe = value();
+		else if (arg == "--archive") result.archive = value();
+		else if (arg.size() > 1 && arg[0] == '-') throw std::runtime_error("unknown option " + arg);
+		else if (scene_file.empty()) scene_file = arg;
+		else throw std::runtime_error("unexpected argument " + arg);
+	}
+
+	if (result.help) {
+		return result;
+	}
+
+	scene::animation& animation = result.animation;
+
+	if (!scene_file.empty()) {
+		if (!center.empty() || zoom.given || iterations.given) {
+			throw std::runtime_error("--center, --zoom and --iterations cannot be combined with a scene file");
+		}
+		animation = scene::load(scene_file);
+	}
+	else {
+		// sweep from the command line, defaults to the seahorse valley zoom
+		animation.frames = count.empty() ? 100 : to_count(count, "--count");
+		if (animation.frames == 0) {
+			throw std::runtime_error("--count must be positive");
+		}
+
+		scene::keyframe first;
+		first.center = default_center;
+		if (!center.empty()) {
+			auto parts = split(center, ',');
+			first.center = { to_double(parts.first, "--center"), to_double(parts.second, "--center") };
+		}
+		first.zoom = zoom.given ? zoom.from : 1.0;
+		first.iterations = iterations.given ? iterations.from : first.iterations;
+
+		scene::keyframe last = first;
+		last.frame = animation.frames - 1;
+		last.zoom = zoom.given ? zoom.to : 6.0;
+		last.iterations = iterations.given ? iterations.to : first.iterations;
+
+		if (first.iterations == 0 || last.iterations == 0) {
+			throw std::runtime_error("--iterations must be positive");
+		}
+
+		animation.keyframes = { first };
+		if (last.frame > first.frame) {
+			animation.keyframes.push_back(last);
+		}
+	}
+
+	if (!size.empty()) {
+		auto parts = split(size, 'x');
+		animation.width = to_count(parts.first, "--size");
+		animation.height = to_count(parts.second, "--size");
+		if (animation.width == 0 || animation.height == 0) {
+			throw std::runtime_error("--size must be positive");
+		}
+	}
+	if (!count.empty() && !scene_file.empty()) {
+		animation.frames = to_count(count, "--count");
+	}
+	if (!fps.empty()) {
+		animation.fps = static_cast<unsigned>(to_count(fps, "--fps"));
+	}
+	if (!interpolation.empty()) {
+		animation.interpolation = scene::parse_interpolation(interpolation);
+	}
+	for (scene::keyframe& key : animation.keyframes) {
+		if (!coloring.empty()) key.coloring = scene::parse_coloring(coloring);
+		if (!precision.empty()) key.precision = scene::parse_precision(precision);
+		if (!formula.empty()) key.formula = scene::parse_formula(formula);
+		if (!power.empty()) key.power = static_cast<unsigned>(to_count(power, "--power"));
+		if (!julia.empty()) {
+			auto parts = split(julia, ',');
+			key.julia = { to_double(parts.first, "--julia"), to_double(parts.second, "--julia") };
+		}
+	}
+
+	result.last_frame = animation.frame_count();
+	if (!frames.empty()) {
+		auto parts = split(frames, ':');
+		result.first_frame = to_count(parts.first, "--frames");
+		if (!parts.second.empty()) {
+			result.last_frame = std::min(result.last_frame, to_count(parts.second, "--frames"));
+		}
+		if (result.first_frame >= result.last_frame) {
+			throw std::runtime_error("--frames selects no frames");
+		}
+	}
+
+	if (result.mode != mode::escape) {
+		if (result.samples == 0) {
+			throw std::runtime_error("--samples must be positive");
+		}
+		if (result.output.empty()) {
+			result.output = result.mode == mode::buddhabrot ? "buddhabrot" : "nebulabrot";
+		}
+	}
+
+	if (result.output.empty()) {
+		switch (result.format) {
+		case format::y4m: result.output = "out.y4m"; break;
+		case format::rle: result.output = "out.mbrle"; break;
+		case format::tiff: result.output = "out"; break;
+		}
+	}
+
+	if (!result.pipe.empty() && result.format == format::tiff) {
+		throw std::runtime_error("--pipe needs a stream format, y4m or rle");
+	}
+
+	return result;
+}
+
+std::string cli::usage(const std::string& program)
+{
+	return "Usage: " + program + " [options] [scene-file]\n"
+		"\n"
+		"Scene\n"
+		"  --scene FILE              keyframe file, see scene.h for the format\n"
+		"  --size WxH                output resolution (1000x1000)\n"
+		"  --count N                 frames in the animation (100)\n"
+		"  --fps N                   frame rate written to video streams (25)\n"
+		"  --center RE,IM            centre of the sweep when no scene file is given\n"
+		"  --zoom FROM[:TO]          zoom level, swept over the animation (1:6)\n"
+		"  --iterations FROM[:TO]    iteration limit, swept over the animation (1000)\n"
+		"  --coloring MODE           cyclic, histogram or distance\n"
+		"  --precision P             single or double, double needs the host backend\n"
+		"  --formula F               mandelbrot, julia or multibrot, the last two need the host backend\n"
+		"  --power N                 multibrot power, 2 to 5 (3)\n"
+		"  --julia RE,IM             julia constant (0.4,0.4)\n"
+		"  --interpolation MODE      linear, exponential or ease zoom between keyframes\n"
+		"\n"
+		"Render\n"
+		"  --frames A[:B]            render frames [A, B) only, to shard across machines\n"
+		"  --backend gpu|host        where frames are computed (gpu)\n"
+		"  --schedule S              fixed or compacted, compacted refills lanes whose pixel finished (compacted)\n"
+		"  --format y4m|rle|tiff     video stream, lossless stream or one tiff per frame (y4m)\n"
+		"  --output PATH             output file, - for stdout, file prefix for tiff\n"
+		"  --pipe COMMAND            stream into the stdin of COMMAND instead of a file\n"
+		"  --archive PREFIX          also keep each escape count field as PREFIX<frame>.mbf\n"
+		"\n"
+		"Orbit density\n"
+		"  --mode MODE               escape, buddhabrot or nebulabrot (escape), density modes\n"
+		"                            render the view of the first frame into PATH.tiff\n"
+		"  --samples N               orbits to sample (10000000)\n"
+		"  --seed N                  seed of the sampled starting points (1)\n"
+		"  --checkpoint FILE         save progress to FILE and resume from it\n"
+		"\n"
+		"Tile server\n"
+		"  --serve [ADDR:]PORT       serve /{z}/{x}/{y}.png tiles over HTTP instead of rendering frames,\n"
+		"                            formula, colouring and precision are taken from the first frame\n"
+		"                            and ADDR defaults to 127.0.0.1\n"
+		"  --tile-cache MB           memory kept for encoded tiles (256)\n"
+		"  --help                    show this message\n";
+}
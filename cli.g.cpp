@@ -0,0 +1,66 @@
+#include "cli.h"
+
+#include <gtest/gtest.h>
+
+TEST(Cli, Defaults)
+{
+	const char* argv[] = { "Mandelbrot" };
+
+	cli::options options = cli::parse(1, argv);
+
+	ASSERT_EQ(100u, options.last_frame);
+	ASSERT_EQ(cli::backend::gpu, options.backend);
+	ASSERT_EQ("out.y4m", options.output);
+	ASSERT_FLOAT_EQ(1.0f, options.animation.frame(0).zoom_level);
+	ASSERT_FLOAT_EQ(6.0f, options.animation.frame(99).zoom_level);
+}
+
+TEST(Cli, SweepAndShard)
+{
+	const char* argv[] = { "Mandelbrot", "--size", "64x48", "--count", "20", "--zoom", "2:4",
+		"--iterations", "100:300", "--frames", "10:15", "--backend", "host", "--format", "rle" };
+
+	cli::options options = cli::parse(sizeof(argv) / sizeof(argv[0]), argv);
+
+	ASSERT_EQ(64u, options.animation.width);
+	ASSERT_EQ(48u, options.animation.height);
+	ASSERT_EQ(10u, options.first_frame);
+	ASSERT_EQ(15u, options.last_frame);
+	ASSERT_EQ(cli::backend::host, options.backend);
+	ASSERT_EQ("out.mbrle", options.output);
+	ASSERT_FLOAT_EQ(4.0f, options.animation.frame(19).zoom_level);
+	ASSERT_EQ(300u, options.animation.frame(19).max_iterations);
+}
+
+TEST(Cli, RejectsBadArguments)
+{
+	const char* unknown[] = { "Mandelbrot", "--colour", "red" };
+	ASSERT_THROW(cli::parse(3, unknown), std::runtime_error);
+
+	const char* missing[] = { "Mandelbrot", "--size" };
+	ASSERT_THROW(cli::parse(2, missing), std::runtime_error);
+
+	const char* empty_range[] = { "Mandelbrot", "--frames", "50:50" };
+	ASSERT_THROW(cli::parse(3, empty_range), std::runtime_error);
+}
+
+TEST(Cli, Serve)
+{
+	const char* argv[] = { "Mandelbrot", "--serve", "0.0.0.0:9000", "--tile-cache", "64", "--coloring", "distance" };
+
+	cli::options options = cli::parse(sizeof(argv) / sizeof(argv[0]), argv);
+
+	ASSERT_TRUE(options.serve);
+	ASSERT_EQ("0.0.0.0", options.serve_address);
+	ASSERT_EQ(9000u, options.serve_port);
+	ASSERT_EQ(64u, options.tile_cache_mb);
+	ASSERT_EQ(mandelbrot::coloring_mode::distance, options.animation.frame(0).coloring);
+
+	const char* port_only[] = { "Mandelbrot", "--serve", "8081" };
+	options = cli::parse(3, port_only);
+	ASSERT_EQ("127.0.0.1", options.serve_address);
+	ASSERT_EQ(8081u, options.serve_port);
+
+	const char* bad_port[] = { "Mandelbrot", "--serve", "70000" };
+	ASSERT_THROW(cli::parse(3, bad_port), std::runtime_error);
+}
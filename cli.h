@@ -0,0 +1,54 @@
+#pragma once
+
+#include "scene.h"
+
+#include <cstdint>
+#include <string>
+
+namespace cli {
+	enum class backend { gpu, host };
+	enum class format { y4m, rle, tiff };
+
+	// escape time animation, or orbit density image of the first selected frame's view
+	enum class mode { escape, buddhabrot, nebulabrot };
+
+	struct options {
+		scene::animation animation;
+
+		// frames [first_frame, last_frame) are rendered, for sharding across machines
+		size_t first_frame{ 0 };
+		size_t last_frame{ 0 };
+
+		cli::backend backend{ cli::backend::gpu };
+		cli::format format{ cli::format::y4m };
+		mandelbrot::schedule schedule{ mandelbrot::schedule::compacted };
+
+		// file, - for stdout, or prefix for tiff frames
+		std::string output;
+		// when set the stream is piped into this command instead of output
+		std::string pipe;
+		// when set the escape count field of every frame is archived as <archive><frame>.mbf
+		std::string archive;
+
+		cli::mode mode{ cli::mode::escape };
+		// orbits sampled in the density modes
+		uint64_t samples{ 10000000 };
+		uint64_t seed{ 1 };
+		// density modes save progress here and resume from it when it exists
+		std::string checkpoint;
+
+		// when set tiles are served over HTTP on serve_address:serve_port instead of rendering frames
+		bool serve{ false };
+		std::string serve_address{ "127.0.0.1" };
+		uint16_t serve_port{ 8080 };
+		// memory kept for encoded tiles
+		size_t tile_cache_mb{ 256 };
+
+		bool help{ false };
+	};
+
+	// parses the command line, throws std::runtime_error for invalid arguments
+	options parse(int argc, const char* const argv[]);
+
+	std::string usage(const std::string& program);
+}
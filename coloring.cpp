@@ -0,0 +1,186 @@
+
+#include "coloring.h"
+#include "parallel.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+
+namespace {
+	// hue steps of the cyclic palette, matches valuetohsv in mandelbrot.cl
+	constexpr const int num_colors = 2000;
+
+	float mix(float a, float b, float t) { return a + (b - a) * t; }
+
+	float clamp01(float v) { return std::min(std::max(v, 0.0f), 1.0f); }
+
+	float cyclic_hue(float escape)
+	{
+		const float whole = std::floor(escape);
+		const float frac = escape - whole;
+
+		const int hue = static_cast<int>(whole) % num_colors;
+		const int next_hue = (hue + 1) % num_colors;
+
+		return mix(hue / float(num_colors), next_hue / float(num_colors), frac);
+	}
+}
+
+size_t coloring::bin(float escape, size_t max_iterations)
+{
+	const float scaled = escape * histogram_bins / max_iterations;
+	return std::min(static_cast<size_t>(std::max(scaled, 0.0f)), histogram_bins - 1);
+}
+
+coloring::histogram coloring::gather(const float* escape, size_t count, size_t max_iterations)
+{
+	// on the stack rather than per worker, so colouring a frame does not allocate
+	std::array<std::atomic<uint32_t>, histogram_bins> merged{};
+
+	util::parallel_for(count, 1u << 14, [&](size_t begin, size_t end, size_t) {
+		histogram counts{};
+		for (size_t i = begin; i < end; i++) {
+			if (escape[i] >= 0.0f) {
+				counts[bin(escape[i], max_iterations)]++;
+			}
+		}
+
+		for (size_t b = 0; b < histogram_bins; b++) {
+			if (counts[b] != 0) {
+				merged[b].fetch_add(counts[b], std::memory_order_relaxed);
+			}
+		}
+	});
+
+	histogram result;
+	for (size_t b = 0; b < histogram_bins; b++) {
+		result[b] = merged[b].load(std::memory_order_relaxed);
+	}
+
+	return result;
+}
+
+coloring::distribution coloring::cumulative(const histogram& counts)
+{
+	distribution cdf{};
+
+	uint64_t total = 0;
+	for (uint32_t count : counts) {
+		total += count;
+	}
+
+	if (total == 0) {
+		return cdf;
+	}
+
+	uint64_t running = 0;
+	for (size_t b = 0; b < histogram_bins; b++) {
+		running += counts[b];
+		cdf[b] = static_cast<float>(double(running) / double(total));
+	}
+
+	return cdf;
+}
+
+uint32_t coloring::pack(float r, float g, float b)
+{
+	// device image is CL_RGBA / CL_UNSIGNED_INT8 with zero alpha
+	const uint32_t ur = static_cast<uint32_t>(r * 255.0f);
+	const uint32_t ug = static_cast<uint32_t>(g * 255.0f);
+	const uint32_t ub = static_cast<uint32_t>(b * 255.0f);
+	return ur | (ug << 8) | (ub << 16);
+}
+
+uint32_t coloring::hsv_to_rgb(float h, float s, float v)
+{
+	const float k[] = { 1.0f, 2.0f / 3.0f, 1.0f / 3.0f };
+
+	float rgb[3];
+	for (size_t i = 0; i < 3; i++) {
+		const float shifted = h + k[i];
+		const float p = std::fabs((shifted - std::floor(shifted)) * 6.0f - 3.0f);
+		rgb[i] = v * mix(1.0f, clamp01(p - 1.0f), s);
+	}
+
+	return pack(rgb[0], rgb[1], rgb[2]);
+}
+
+namespace {
+	template<mandelbrot::coloring_mode Mode>
+	uint32_t color_of(float escape, float distance, float pixel_size, size_t max_iterations,
+		const coloring::distribution& cdf)
+	{
+		using mandelbrot::coloring_mode;
+
+		// is point in mandelbrot set?
+		if (escape < 0.0f) {
+			return coloring::pack(0.0f, 0.0f, 0.0f);
+		}
+
+		if constexpr (Mode == coloring_mode::histogram) {
+			const size_t b = coloring::bin(escape, max_iterations);
+			const float frac = clamp01(escape * coloring::histogram_bins / max_iterations - b);
+			const float low = b > 0 ? cdf[b - 1] : 0.0f;
+			return coloring::hsv_to_rgb(mix(low, cdf[b], frac) * coloring::histogram_hue_range, 1.0f, 1.0f);
+		}
+		else if constexpr (Mode == coloring_mode::distance) {
+			const float brightness = std::sqrt(clamp01(distance / (2.0f * pixel_size)));
+			return coloring::hsv_to_rgb(cyclic_hue(escape), 1.0f, brightness);
+		}
+		else {
+			return coloring::hsv_to_rgb(cyclic_hue(escape), 1.0f, 1.0f);
+		}
+	}
+}
+
+uint32_t coloring::color(mandelbrot::coloring_mode mode, float escape, float distance,
+	float pixel_size, size_t max_iterations, const distribution& cdf)
+{
+	switch (mode) {
+	case mandelbrot::coloring_mode::histogram:
+		return color_of<mandelbrot::coloring_mode::histogram>(escape, distance, pixel_size, max_iterations, cdf);
+	case mandelbrot::coloring_mode::distance:
+		return color_of<mandelbrot::coloring_mode::distance>(escape, distance, pixel_size, max_iterations, cdf);
+	case mandelbrot::coloring_mode::cyclic:
+	default:
+		return color_of<mandelbrot::coloring_mode::cyclic>(escape, distance, pixel_size, max_iterations, cdf);
+	}
+}
+
+template<mandelbrot::coloring_mode Mode>
+void coloring::colorize(const mandelbrot::input_spec& spec, mandelbrot::host_output& output)
+{
+	distribution cdf{};
+	if constexpr (Mode == mandelbrot::coloring_mode::histogram) {
+		cdf = cumulative(gather(output.escape.data(), output.escape.size(), spec.max_iterations));
+	}
+
+	const float pixel_size = static_cast<float>(util::step_size(spec.zoom_level));
+
+	util::parallel_for(output.out.size(), 1u << 14, [&](size_t begin, size_t end, size_t) {
+		for (size_t i = begin; i < end; i++) {
+			output.out[i] = color_of<Mode>(output.escape[i], output.distance[i],
+				pixel_size, spec.max_iterations, cdf);
+		}
+	});
+}
+
+template void coloring::colorize<mandelbrot::coloring_mode::cyclic>(const mandelbrot::input_spec&, mandelbrot::host_output&);
+template void coloring::colorize<mandelbrot::coloring_mode::histogram>(const mandelbrot::input_spec&, mandelbrot::host_output&);
+template void coloring::colorize<mandelbrot::coloring_mode::distance>(const mandelbrot::input_spec&, mandelbrot::host_output&);
+
+void coloring::colorize(const mandelbrot::input_spec& spec, mandelbrot::host_output& output)
+{
+	switch (spec.coloring) {
+	case mandelbrot::coloring_mode::histogram:
+		colorize<mandelbrot::coloring_mode::histogram>(spec, output);
+		break;
+	case mandelbrot::coloring_mode::distance:
+		colorize<mandelbrot::coloring_mode::distance>(spec, output);
+		break;
+	case mandelbrot::coloring_mode::cyclic:
+	default:
+		colorize<mandelbrot::coloring_mode::cyclic>(spec, output);
+		break;
+	}
+}
@@ -0,0 +1,85 @@
+#include "coloring.h"
+
+#include <gtest/gtest.h>
+
+TEST(Coloring, HistogramSkipsInterior)
+{
+	std::vector<float> escape(100000, -1.0f);
+	for (size_t i = 0; i < escape.size(); i += 2) {
+		escape[i] = static_cast<float>(i % 1000);
+	}
+
+	coloring::histogram counts = coloring::gather(escape.data(), escape.size(), 1000);
+
+	uint64_t total = 0;
+	for (uint32_t count : counts) {
+		total += count;
+	}
+
+	ASSERT_EQ(escape.size() / 2, total);
+	ASSERT_EQ(100u, counts[coloring::bin(0.0f, 1000)]);
+}
+
+TEST(Coloring, CumulativeIsNormalised)
+{
+	coloring::histogram counts{};
+	counts[3] = 10;
+	counts[700] = 30;
+
+	coloring::distribution cdf = coloring::cumulative(counts);
+
+	ASSERT_FLOAT_EQ(0.0f, cdf[2]);
+	ASSERT_FLOAT_EQ(0.25f, cdf[3]);
+	ASSERT_FLOAT_EQ(0.25f, cdf[699]);
+	ASSERT_FLOAT_EQ(1.0f, cdf.back());
+}
+
+TEST(Coloring, InteriorIsBlack)
+{
+	mandelbrot::input_spec spec;
+	spec.coloring = mandelbrot::coloring_mode::histogram;
+
+	mandelbrot::host_output output{ 10u, 10u };
+	output.escape[5] = 12.5f;
+
+	coloring::colorize(spec, output);
+
+	ASSERT_EQ(0u, output.at(0, 0));
+	ASSERT_NE(0u, output.at(5, 0));
+}
+
+TEST(Coloring, HistogramSpreadsClusteredValues)
+{
+	// values bunched in a narrow band get the same hue cyclically but are spread by equalisation
+	mandelbrot::input_spec spec;
+	spec.max_iterations = 1000;
+
+	mandelbrot::host_output output{ 2u, 1u };
+	output.escape = { 100.0f, 102.0f };
+
+	spec.coloring = mandelbrot::coloring_mode::cyclic;
+	coloring::colorize(spec, output);
+	const uint32_t cyclic_low = output.at(0, 0);
+
+	spec.coloring = mandelbrot::coloring_mode::histogram;
+	coloring::colorize(spec, output);
+
+	ASSERT_NE(cyclic_low, output.at(0, 0));
+	ASSERT_NE(output.at(0, 0), output.at(1, 0));
+}
+
+TEST(Coloring, DistanceDarkensBoundary)
+{
+	mandelbrot::input_spec spec;
+	spec.coloring = mandelbrot::coloring_mode::distance;
+
+	const float pixel_size = util::step_size(spec.zoom_level);
+
+	mandelbrot::host_output output{ 2u, 1u };
+	output.escape = { 10.0f, 10.0f };
+	output.distance = { pixel_size * 0.01f, pixel_size * 10.0f };
+
+	coloring::colorize(spec, output);
+
+	ASSERT_LT(output.at(0, 0) & 0xffu, output.at(1, 0) & 0xffu);
+}
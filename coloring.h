@@ -0,0 +1,41 @@
+#pragma once
+
+#include "mandelbrot.h"
+
+#include <array>
+
+namespace coloring {
+	// buckets the escape counts of a frame are gathered into, matches HISTOGRAM_BINS in mandelbrot.cl
+	constexpr const size_t histogram_bins = 1024;
+
+	// hue range histogram equalised frames are spread over, stops both ends wrapping to red
+	constexpr const float histogram_hue_range = 0.8f;
+
+	using histogram = std::array<uint32_t, histogram_bins>;
+	using distribution = std::array<float, histogram_bins>;
+
+	// bucket of an exterior escape value
+	size_t bin(float escape, size_t max_iterations);
+
+	// counts exterior escape values per bucket, gathered per chunk and merged
+	histogram gather(const float* escape, size_t count, size_t max_iterations);
+
+	// cumulative distribution of a histogram, normalised to [0, 1]
+	distribution cumulative(const histogram& counts);
+
+	// RGBA packed the way the device image is read back
+	uint32_t pack(float r, float g, float b);
+	uint32_t hsv_to_rgb(float h, float s, float v);
+
+	// colour of a single pixel, cdf is only used in histogram mode
+	uint32_t color(mandelbrot::coloring_mode mode, float escape, float distance,
+		float pixel_size, size_t max_iterations, const distribution& cdf);
+
+	// recolours output.out from output.escape and output.distance on the host,
+	// gives the same result as the device for the same fields
+	void colorize(const mandelbrot::input_spec& spec, mandelbrot::host_output& output);
+
+	// as above with the mode fixed at compile time, instantiated for every mode
+	template<mandelbrot::coloring_mode Mode>
+	void colorize(const mandelbrot::input_spec& spec, mandelbrot::host_output& output);
+}
@@ -1,434 +1,981 @@
-
-#include "gpu_compute.h"
-
-#include <vector>
-#include <complex>
-#include <array>
-#include <fstream>
-#include <chrono>
-
-// TODO: remove
-#include <iostream>
-
-#include <CL/cl.h>
-
-namespace impl {
-
-	namespace mem {
-		constexpr const size_t r = CL_MEM_READ_ONLY;
-		constexpr const size_t w = CL_MEM_WRITE_ONLY;
-	}
-
-	template<typename T>
-	void CLDeleter(T) {}
-
-	template<>
-	void CLDeleter<cl_mem>(cl_mem obj) { if (obj) clReleaseMemObject(obj); }
-
-	template<>
-	void CLDeleter<cl_command_queue>(cl_command_queue obj) { if (obj) clReleaseCommandQueue(obj); }
-
-	template<>
-	void CLDeleter<cl_program>(cl_program obj) { if (obj) clReleaseProgram(obj); }
-
-	template<>
-	void CLDeleter<cl_context>(cl_context obj) { if (obj) clReleaseContext(obj); }
-
-	template<>
-	void CLDeleter<cl_kernel>(cl_kernel obj) { if (obj) clReleaseKernel(obj); }
-
-	template<typename T>
-	class CLOwner {
-		using type = T;
-
-		type val;
-
-	public:
-		CLOwner() :val{ 0 } {};
-
-		template<typename Ot>
-		CLOwner(CLOwner<Ot>&&) = delete;
-
-		template<typename Ot>
-		CLOwner& operator=(CLOwner<Ot>&&) = delete;
-
-		~CLOwner()
-		{
-			CLDeleter<T>(val);
-		}
-
-		T& obj() { return val; }
-		const T& obj() const { return val; }
-	};
-
-	// gpu buffer helper
-	template<typename T, size_t Spec>
-	class gpu_buffer : private CLOwner<cl_mem> {
-		size_t _size;
-	public:
-		gpu_buffer(cl_context context, size_t n);
-
-		void load(cl_command_queue, T* data, size_t size);
-
-		size_t size() const { return _size; }
-
-		cl_mem buff() const { return obj(); }
-	};
-
-	class gpu_queue : private CLOwner<cl_command_queue> {
-	public:
-		gpu_queue(cl_context context, cl_device_id deviceId);
-
-		cl_command_queue queue() { return obj(); }
-	};
-
-	template<size_t Spec>
-	class gpu_image : private CLOwner<cl_mem> {
-	public:
-		cl_image_desc desc{};
-
-		gpu_image(cl_context, size_t width, size_t height);
-
-		void read(cl_command_queue queue, std::vector<uint32_t>& result);
-
-		cl_mem buff() { return obj(); }
-	};
-
-	class gpu_mandelbrot_program : private CLOwner<cl_program> {
-	public:
-		gpu_mandelbrot_program(cl_context context, cl_device_id deviceId, std::string filename);
-
-		cl_program program() { return obj(); }
-	};
-
-	class gpu_mandelbrot_kernel : private CLOwner<cl_kernel> {
-	public:
-		gpu_mandelbrot_kernel(cl_program program);
-
-		void run(cl_command_queue queue, 
-			const gpu_buffer<float, impl::mem::r>& reals, 
-			const gpu_buffer<float, impl::mem::r>& imags, 
-			gpu_image<impl::mem::w>& result);
-	};
-}
-
-namespace compute {
-
-	class gpu_mandelbrot_context {
-	public:
-		// input
-		impl::gpu_buffer<float, impl::mem::r> device_reals;
-		impl::gpu_buffer<float, impl::mem::r> device_imags;
-
-		// output
-		impl::gpu_image<impl::mem::w> device_result;
-
-		// compute
-		impl::gpu_queue queue;
-		impl::gpu_mandelbrot_program program;
-		impl::gpu_mandelbrot_kernel kernel;
-
-		gpu_mandelbrot_context(cl_context context, cl_device_id deviceId, size_t num_reals, size_t num_imags);
-
-		void compute(compute::compute_io_data& data);
-	};
-
-	class gpu_context_impl : private impl::CLOwner<cl_context> {
-	public:
-		cl_device_id deviceId{ 0 };
-		std::unique_ptr<compute::gpu_mandelbrot_context> mand_ctx;
-
-		gpu_context_impl(size_t num_reals, size_t num_imags);
-
-		cl_context context() { return obj(); }
-	};
-}
-
-// gpu buffer helper
-template<typename T, size_t Spec>
-impl::gpu_buffer<T, Spec>::gpu_buffer(cl_context context, size_t n)
-	:_size(n)
-{
-	cl_int error = CL_SUCCESS;
-
-	obj() = clCreateBuffer(context,
-		Spec,
-		sizeof(T) * (n),
-		nullptr, &error);
-
-	if (CL_SUCCESS != error) {
-		throw std::exception("device buffer alloc failed");
-	}
-}
-
-template<typename T, size_t Spec>
-void impl::gpu_buffer<T, Spec>::load(cl_command_queue queue, T *data, size_t size)
-{
-	cl_int error = clEnqueueWriteBuffer(queue, obj(), CL_TRUE /* blocking write */, 0u, sizeof(T) * size, data, 0u, NULL, NULL);
-
-	if (CL_SUCCESS != error) {
-		throw std::exception("buffer write failed");
-	}
-}
-
-// gpu queue helper
-impl::gpu_queue::gpu_queue(cl_context context, cl_device_id deviceId)
-{
-	cl_int error = CL_SUCCESS;
-
-	obj() = clCreateCommandQueue(context, deviceId, 0, &error);
-
-	if (CL_SUCCESS != error) {
-		throw std::exception("device command queue alloc failed");
-	}
-}
-
-// gpu image helper
-template<size_t Spec>
-impl::gpu_image<Spec>::gpu_image(cl_context context, size_t width, size_t height)
-{
-	cl_int error = CL_SUCCESS;
-
-	cl_image_format format = {};
-	format.image_channel_data_type = CL_UNSIGNED_INT8;
-	format.image_channel_order = CL_RGBA;
-
-	desc.image_type = CL_MEM_OBJECT_IMAGE2D;
-	desc.image_width = width;
-	desc.image_height = height;
-
-	obj() = clCreateImage(context, Spec, &format, &desc, NULL, &error);
-
-	if (CL_SUCCESS != error) {
-		throw std::exception("error allocating image");
-	}
-}
-
-template<size_t Spec>
-void impl::gpu_image<Spec>::read(cl_command_queue queue, std::vector<uint32_t>& result)
-{
-	result.resize(desc.image_width * desc.image_height);
-
-	const size_t origin[] = { 0u, 0u, 0u };
-	const size_t region[] = { desc.image_width, desc.image_height, 1u /* depth */ };
-	cl_int error = clEnqueueReadImage(queue, obj(), true /* blocking read */, origin, region, 0u, 0u, (void*)result.data(), 0, NULL, NULL);
-	if (CL_SUCCESS != error) {
-		throw std::exception("Error reading image buff");
-	}
-}
-
-// gpu mandelbrot program
-impl::gpu_mandelbrot_program::gpu_mandelbrot_program(cl_context context, cl_device_id deviceId, std::string filename)
-{
-	std::ifstream codeStream{ filename };
-	if (!codeStream) {
-		throw std::runtime_error("could not load kernel from " + filename);
-	}
-	std::istreambuf_iterator<char> code_begin{ codeStream };
-	std::istreambuf_iterator<char> code_end;
-	std::string code{ code_begin, code_end };
-
-	cl_int error = CL_SUCCESS;
-
-	const char* codes[] = { code.c_str() };
-	const size_t lengths[] = { code.size() };
-
-	cl_program program = clCreateProgramWithSource(context, 1, codes, lengths, &error);
-
-	obj() = program;
-
-	if (CL_SUCCESS != error) {
-		throw std::runtime_error("unable to create program from " + filename);
-	}
-
-	const cl_device_id devices[] = { deviceId };
-	const char* options = "";
-
-	cl_int buildError = clBuildProgram(program, 1, devices, options, NULL, NULL);
-
-	if (CL_SUCCESS != buildError) {
-		//TODO extract build error and print
-		size_t errorLogLength;
-		cl_int error = clGetProgramBuildInfo(program,
-			deviceId, CL_PROGRAM_BUILD_LOG, 0, NULL, &errorLogLength);
-
-		if (CL_SUCCESS != error) {
-			throw std::runtime_error("build failed for " + filename + " and error occured getting length of build logs");
-		}
-
-		std::string errorLog(errorLogLength, ' ');
-
-		error = clGetProgramBuildInfo(program,
-			deviceId, CL_PROGRAM_BUILD_LOG, errorLogLength, (void*)errorLog.data(), NULL);
-
-		if (CL_SUCCESS != error) {
-			throw std::runtime_error("build failed for " + filename + " and error occured getting build logs");
-		}
-
-		throw std::runtime_error("build failed for " + filename + "\n" + errorLog);
-	}
-}
-
-impl::gpu_mandelbrot_kernel::gpu_mandelbrot_kernel(cl_program program)
-{
-	cl_int error = CL_SUCCESS;
-	obj() = clCreateKernel(program, "mandelbrot", &error);
-	if (CL_SUCCESS != error) {
-		throw std::exception("failed to create kernel mandelbrot");
-	}
-}
-
-void impl::gpu_mandelbrot_kernel::run(cl_command_queue queue, 
-	const impl::gpu_buffer<float, impl::mem::r>& reals,
-	const impl::gpu_buffer<float, impl::mem::r>& imags, 
-	impl::gpu_image<impl::mem::w>& result)
-{
-	auto setArg = [this, argIdx = 0u](const auto& arg) mutable {
-		constexpr const size_t argSize = sizeof(std::remove_reference_t<decltype(arg)>);
-		cl_int error = clSetKernelArg(obj(), argIdx++, argSize, (void*)&arg);
-		if (CL_SUCCESS != error) {
-			throw std::exception("Error setting argument");
-		}
-	};
-
-	setArg(reals.buff());
-	setArg(imags.buff());
-	setArg(result.buff());
-
-	constexpr const size_t work_dim = 2;
-
-	const size_t global_work_offset[work_dim] = { 0u, 0u };
-	const size_t global_work_size[work_dim] = { reals.size(), imags.size() };
-	const size_t local_work_size[work_dim] = { 1u, 1u };
-
-	cl_int error = clEnqueueNDRangeKernel(queue, obj(), work_dim, global_work_offset,
-		global_work_size, local_work_size, 0, NULL, NULL);
-
-	if (CL_SUCCESS != error) {
-		throw std::runtime_error("Kernel run error: " + std::to_string(error));
-	}
-
-	clFinish(queue);
-}
-
-// gpu context implementation, details
-compute::gpu_context_impl::gpu_context_impl(size_t num_reals, size_t num_imags)
-{
-	cl_uint platformIdCount = 0;
-	clGetPlatformIDs(0, nullptr, &platformIdCount);
-
-	if (platformIdCount == 0) {
-		throw std::exception("no platorms found");
-	}
-
-	// load details of platforms
-	std::vector<cl_platform_id> platformIds(platformIdCount, 0);
-	clGetPlatformIDs(platformIdCount, platformIds.data(), nullptr);
-
-	// assume first platform
-	cl_platform_id platformId = platformIds[0];
-
-	cl_uint deviceIdCount = 0;
-	clGetDeviceIDs(platformId, CL_DEVICE_TYPE_ALL, 0, nullptr,
-		&deviceIdCount);
-
-	if (deviceIdCount == 0) {
-		throw std::exception("no devices found");
-	}
-
-	std::vector<cl_device_id> deviceIds(deviceIdCount);
-	clGetDeviceIDs(platformId, CL_DEVICE_TYPE_ALL, deviceIdCount,
-		deviceIds.data(), nullptr);
-
-	this->deviceId = deviceIds[0];
-	const cl_context_properties contextProperties[] =
-	{
-		CL_CONTEXT_PLATFORM,
-		reinterpret_cast<cl_context_properties> (platformIds[0]),
-		0, 0
-	};
-
-	cl_int error = CL_SUCCESS;
-
-	cl_context context = clCreateContext(
-		contextProperties, deviceIdCount,
-		deviceIds.data(), nullptr,
-		nullptr, &error);
-
-	if (CL_SUCCESS != error) {
-		throw std::exception("no devices found");
-	}
-
-	obj() = context;
-
-	mand_ctx = std::make_unique<compute::gpu_mandelbrot_context>(context, deviceId, num_reals, num_imags);
-}
-
-compute::gpu_mandelbrot_context::gpu_mandelbrot_context(cl_context context, cl_device_id deviceId, size_t num_reals, size_t num_imags)
-    // Create input buffers
-	: device_reals{ context, num_reals }
-	, device_imags{ context, num_imags }
-	// Create output buffers
-	, device_result{ context, num_reals, num_imags }
-	// Create context for computation
-	, queue{ context, deviceId }
-	, program{ context, deviceId, "mandelbrot.cl" }
-	, kernel{ program.program() }
-{
-}
-
-template<typename TimePoint>
-auto microsBetween(const TimePoint& a, const TimePoint& b)
-{
-	TimePoint i = a;
-	TimePoint j = b;
-
-	if (i > j) {
-		std::swap(i, j);
-	}
-
-	return std::chrono::duration_cast<std::chrono::microseconds>(j - i).count();
-}
-
-// gpu context, client interface
-compute::gpu_context::gpu_context(size_t num_reals, size_t num_imags)
-{
-	auto start = std::chrono::high_resolution_clock::now();
-	_impl = std::make_unique<gpu_context_impl>(num_reals, num_imags);
-	auto finish = std::chrono::high_resolution_clock::now();
-	std::cout << "Allocation and compile time (us): " << microsBetween(start, finish) << '\n';
-}
-
-compute::gpu_context::~gpu_context() = default;
-
-// mandelbrot computation
-
-void compute::compute(compute::compute_io_data& data, compute::gpu_context& context)
-{
-	context.impl().mand_ctx->compute(data);
-}
-
-void compute::gpu_mandelbrot_context::compute(compute::compute_io_data& data)
-{
-	auto start = std::chrono::high_resolution_clock::now();
-
-	// Copy input
-	device_reals.load(queue.queue(), data.input.reals.data(), device_reals.size());
-	device_imags.load(queue.queue(), data.input.imags.data(), device_imags.size());
-
-	auto calculationStart = std::chrono::high_resolution_clock::now();
-
-	// Calculate
-	kernel.run(queue.queue(), device_reals, device_imags, device_result);
-
-	auto copyBackStart = std::chrono::high_resolution_clock::now();
-
-	// Copy result
-	device_result.read(queue.queue(), data.output.out);
-
-	auto finish = std::chrono::high_resolution_clock::now();
-
-	std::cout << "Copy to time (us): " << microsBetween(start, calculationStart) << '\n';
-	std::cout << "Kernel run time (us): " << microsBetween(calculationStart, copyBackStart) << '\n';
-	std::cout << "Copy back time (us): " << microsBetween(copyBackStart, finish) << '\n';
-}
+
+#include "gpu_compute.h"
+#include "cl_api.h"
+#include "coloring.h"
+#include "host_compute.h"
+#include "parallel.h"
+
+#include <algorithm>
+#include <vector>
+#include <complex>
+#include <array>
+#include <fstream>
+#include <chrono>
+
+// TODO: remove
+#include <iostream>
+
+#include <CL/cl.h>
+
+const compute::cl_api& compute::native_cl_api()
+{
+	static const cl_api native = {
+		&::clGetPlatformIDs,
+		&::clGetDeviceIDs,
+		&::clGetDeviceInfo,
+		&::clCreateContext,
+		&::clReleaseContext,
+		&::clCreateCommandQueue,
+		&::clReleaseCommandQueue,
+		&::clCreateBuffer,
+		&::clCreateImage,
+		&::clReleaseMemObject,
+		&::clCreateProgramWithSource,
+		&::clBuildProgram,
+		&::clGetProgramBuildInfo,
+		&::clReleaseProgram,
+		&::clCreateKernel,
+		&::clReleaseKernel,
+		&::clSetKernelArg,
+		&::clEnqueueWriteBuffer,
+		&::clEnqueueReadBuffer,
+		&::clEnqueueFillBuffer,
+		&::clEnqueueReadImage,
+		&::clEnqueueNDRangeKernel,
+		&::clFinish,
+	};
+	return native;
+}
+
+compute::cl_api& compute::cl()
+{
+	static cl_api active = native_cl_api();
+	return active;
+}
+
+// errors
+namespace {
+	// from cl_ext.h, returned by the ICD loader when no platform is installed
+	constexpr const cl_int platform_not_found = -1001;
+}
+
+compute::gpu_error::gpu_error(const std::string& what, const std::string& call, int32_t code)
+	: std::runtime_error{ what + " (" + call + ": " + cl_error_name(code) + ")" }
+	, _code{ code }
+	, _call{ call }
+{
+}
+
+bool compute::gpu_error::transient() const
+{
+	switch (_code) {
+	case CL_DEVICE_NOT_AVAILABLE:
+	case CL_MEM_OBJECT_ALLOCATION_FAILURE:
+	case CL_OUT_OF_RESOURCES:
+	case CL_OUT_OF_HOST_MEMORY:
+	case CL_EXEC_STATUS_ERROR_FOR_EVENTS_IN_WAIT_LIST:
+		return true;
+	// invalid handles, such as CL_INVALID_COMMAND_QUEUE or CL_INVALID_CONTEXT,
+	// are bugs a rebuild would hide
+	default:
+		return false;
+	}
+}
+
+std::string compute::cl_error_name(int32_t code)
+{
+	switch (code) {
+	case CL_SUCCESS: return "CL_SUCCESS";
+	case CL_DEVICE_NOT_FOUND: return "CL_DEVICE_NOT_FOUND";
+	case CL_DEVICE_NOT_AVAILABLE: return "CL_DEVICE_NOT_AVAILABLE";
+	case CL_COMPILER_NOT_AVAILABLE: return "CL_COMPILER_NOT_AVAILABLE";
+	case CL_MEM_OBJECT_ALLOCATION_FAILURE: return "CL_MEM_OBJECT_ALLOCATION_FAILURE";
+	case CL_OUT_OF_RESOURCES: return "CL_OUT_OF_RESOURCES";
+	case CL_OUT_OF_HOST_MEMORY: return "CL_OUT_OF_HOST_MEMORY";
+	case CL_BUILD_PROGRAM_FAILURE: return "CL_BUILD_PROGRAM_FAILURE";
+	case CL_EXEC_STATUS_ERROR_FOR_EVENTS_IN_WAIT_LIST: return "CL_EXEC_STATUS_ERROR_FOR_EVENTS_IN_WAIT_LIST";
+	case CL_INVALID_VALUE: return "CL_INVALID_VALUE";
+	case CL_INVALID_PLATFORM: return "CL_INVALID_PLATFORM";
+	case CL_INVALID_DEVICE: return "CL_INVALID_DEVICE";
+	case CL_INVALID_CONTEXT: return "CL_INVALID_CONTEXT";
+	case CL_INVALID_COMMAND_QUEUE: return "CL_INVALID_COMMAND_QUEUE";
+	case CL_INVALID_MEM_OBJECT: return "CL_INVALID_MEM_OBJECT";
+	case CL_INVALID_IMAGE_SIZE: return "CL_INVALID_IMAGE_SIZE";
+	case CL_INVALID_PROGRAM: return "CL_INVALID_PROGRAM";
+	case CL_INVALID_PROGRAM_EXECUTABLE: return "CL_INVALID_PROGRAM_EXECUTABLE";
+	case CL_INVALID_KERNEL_NAME: return "CL_INVALID_KERNEL_NAME";
+	case CL_INVALID_KERNEL: return "CL_INVALID_KERNEL";
+	case CL_INVALID_ARG_INDEX: return "CL_INVALID_ARG_INDEX";
+	case CL_INVALID_ARG_VALUE: return "CL_INVALID_ARG_VALUE";
+	case CL_INVALID_ARG_SIZE: return "CL_INVALID_ARG_SIZE";
+	case CL_INVALID_KERNEL_ARGS: return "CL_INVALID_KERNEL_ARGS";
+	case CL_INVALID_WORK_DIMENSION: return "CL_INVALID_WORK_DIMENSION";
+	case CL_INVALID_WORK_GROUP_SIZE: return "CL_INVALID_WORK_GROUP_SIZE";
+	case CL_INVALID_WORK_ITEM_SIZE: return "CL_INVALID_WORK_ITEM_SIZE";
+	case CL_INVALID_OPERATION: return "CL_INVALID_OPERATION";
+	case CL_INVALID_BUFFER_SIZE: return "CL_INVALID_BUFFER_SIZE";
+	case CL_INVALID_GLOBAL_WORK_SIZE: return "CL_INVALID_GLOBAL_WORK_SIZE";
+	case platform_not_found: return "CL_PLATFORM_NOT_FOUND_KHR";
+	default: return "CL error " + std::to_string(code);
+	}
+}
+
+namespace impl {
+	// throws a gpu_error unless error is CL_SUCCESS
+	void check(cl_int error, const char* what, const char* call)
+	{
+		if (CL_SUCCESS != error) {
+			throw compute::gpu_error(what, call, error);
+		}
+	}
+
+	namespace mem {
+		constexpr const size_t r = CL_MEM_READ_ONLY;
+		constexpr const size_t w = CL_MEM_WRITE_ONLY;
+		constexpr const size_t rw = CL_MEM_READ_WRITE;
+	}
+
+	template<typename T>
+	void CLDeleter(T) {}
+
+	template<>
+	void CLDeleter<cl_mem>(cl_mem obj) { if (obj) compute::cl().clReleaseMemObject(obj); }
+
+	template<>
+	void CLDeleter<cl_command_queue>(cl_command_queue obj) { if (obj) compute::cl().clReleaseCommandQueue(obj); }
+
+	template<>
+	void CLDeleter<cl_program>(cl_program obj) { if (obj) compute::cl().clReleaseProgram(obj); }
+
+	template<>
+	void CLDeleter<cl_context>(cl_context obj) { if (obj) compute::cl().clReleaseContext(obj); }
+
+	template<>
+	void CLDeleter<cl_kernel>(cl_kernel obj) { if (obj) compute::cl().clReleaseKernel(obj); }
+
+	template<typename T>
+	class CLOwner {
+		using type = T;
+
+		type val;
+
+	public:
+		CLOwner() :val{ 0 } {};
+
+		template<typename Ot>
+		CLOwner(CLOwner<Ot>&&) = delete;
+
+		template<typename Ot>
+		CLOwner& operator=(CLOwner<Ot>&&) = delete;
+
+		~CLOwner()
+		{
+			CLDeleter<T>(val);
+		}
+
+		T& obj() { return val; }
+		const T& obj() const { return val; }
+	};
+
+	// gpu buffer helper
+	template<typename T, size_t Spec>
+	class gpu_buffer : private CLOwner<cl_mem> {
+		size_t _size;
+	public:
+		gpu_buffer(cl_context context, size_t n);
+
+		void load(cl_command_queue, T* data, size_t size);
+		void read(cl_command_queue, T* data, size_t size);
+		void fill(cl_command_queue, T value);
+
+		size_t size() const { return _size; }
+
+		cl_mem buff() const { return obj(); }
+	};
+
+	class gpu_queue : private CLOwner<cl_command_queue> {
+	public:
+		gpu_queue(cl_context context, cl_device_id deviceId);
+
+		cl_command_queue queue() { return obj(); }
+	};
+
+	template<size_t Spec>
+	class gpu_image : private CLOwner<cl_mem> {
+	public:
+		cl_image_desc desc{};
+
+		gpu_image(cl_context, size_t width, size_t height);
+
+		void read(cl_command_queue queue, uint32_t* result, size_t size);
+
+		cl_mem buff() { return obj(); }
+	};
+
+	class gpu_mandelbrot_program : private CLOwner<cl_program> {
+	public:
+		gpu_mandelbrot_program(cl_context context, cl_device_id deviceId, std::string filename);
+
+		cl_program program() { return obj(); }
+	};
+
+	class gpu_kernel : private CLOwner<cl_kernel> {
+	public:
+		gpu_kernel(cl_program program, const char* name);
+
+		template<typename... Args>
+		void set_args(const Args&... args);
+
+		void run(cl_command_queue queue, std::array<size_t, 2> global_work_size, std::array<size_t, 2> local_work_size);
+	};
+
+	// work group edge used for the 2d kernels, global sizes are padded up to a multiple
+	constexpr const size_t group_size = 8u;
+
+	// work items per group of the persistent kernel, GROUP_ITEMS in mandelbrot.cl
+	constexpr const size_t persistent_group_items = group_size * group_size;
+
+	// persistent work groups per compute unit, enough to hide memory latency
+	constexpr const size_t persistent_groups_per_unit = 8u;
+
+	// work items per group of the atlas kernels, along the pixels of one frame
+	constexpr const size_t atlas_group_items = group_size * group_size;
+
+	size_t persistent_groups(cl_device_id deviceId);
+
+	size_t round_up(size_t n, size_t multiple) { return (n + multiple - 1) / multiple * multiple; }
+}
+
+namespace compute {
+
+	class gpu_mandelbrot_context {
+	public:
+		const size_t escape_groups;
+		const size_t persistent_groups;
+
+		// input
+		impl::gpu_buffer<float, impl::mem::r> device_reals;
+		impl::gpu_buffer<float, impl::mem::r> device_imags;
+
+		// intermediate, escape fields and their statistics
+		impl::gpu_buffer<float, impl::mem::rw> device_escape;
+		impl::gpu_buffer<float, impl::mem::rw> device_distance;
+		impl::gpu_buffer<cl_uint, impl::mem::rw> device_histogram;
+		impl::gpu_buffer<float, impl::mem::rw> device_cdf;
+
+		// lane utilisation per work group and the persistent kernel's pixel queue
+		impl::gpu_buffer<cl_ulong, impl::mem::rw> device_lane_counts;
+		impl::gpu_buffer<cl_uint, impl::mem::rw> device_queue;
+
+		// host copy of the lane counts, kept so frames do not allocate
+		util::buffer<cl_ulong> lane_counts;
+
+		// output
+		impl::gpu_image<impl::mem::w> device_result;
+
+		// compute
+		impl::gpu_queue queue;
+		impl::gpu_mandelbrot_program program;
+		impl::gpu_kernel escape_kernel;
+		impl::gpu_kernel persistent_kernel;
+		impl::gpu_kernel cdf_kernel;
+		impl::gpu_kernel colorize_kernel;
+
+		gpu_mandelbrot_context(cl_context context, cl_device_id deviceId, size_t num_reals, size_t num_imags);
+
+		void compute(compute::compute_io_data& data);
+	};
+
+	// frame of an atlas, must match tile_descriptor in mandelbrot.cl
+	struct tile_descriptor {
+		cl_uint reals;
+		cl_uint imags;
+		cl_uint pixels;
+		cl_uint width;
+		cl_uint height;
+		cl_uint max_iterations;
+		cl_uint coloring;
+		cl_float pixel_size;
+	};
+
+	// atlas buffers, recreated larger when a batch does not fit
+	class gpu_atlas_buffers {
+	public:
+		impl::gpu_buffer<tile_descriptor, impl::mem::r> device_tiles;
+		impl::gpu_buffer<float, impl::mem::r> device_axes;
+		impl::gpu_buffer<float, impl::mem::rw> device_escape;
+		impl::gpu_buffer<float, impl::mem::rw> device_distance;
+		impl::gpu_buffer<cl_uint, impl::mem::rw> device_histograms;
+		impl::gpu_buffer<float, impl::mem::rw> device_cdfs;
+		impl::gpu_buffer<cl_uint, impl::mem::w> device_pixels;
+
+		gpu_atlas_buffers(cl_context context, size_t frames, size_t axes, size_t pixels);
+
+		bool fits(size_t frames, size_t axes, size_t pixels) const;
+	};
+
+	class gpu_atlas_context {
+	public:
+		impl::gpu_kernel escape_kernel;
+		impl::gpu_kernel cdf_kernel;
+		impl::gpu_kernel colorize_kernel;
+
+		std::unique_ptr<gpu_atlas_buffers> buffers;
+
+		// host side of the descriptors, axes and results, kept between batches
+		util::buffer<tile_descriptor> tiles;
+		util::buffer<float> axes, escape, distance;
+		util::buffer<uint32_t> pixels;
+
+		gpu_atlas_context(cl_program program);
+
+		compute::timing compute(cl_context context, cl_command_queue queue, compute::compute_io_data* frames, size_t count);
+	};
+
+	class gpu_context_impl : private impl::CLOwner<cl_context> {
+	public:
+		cl_device_id deviceId{ 0 };
+		std::unique_ptr<compute::gpu_mandelbrot_context> mand_ctx;
+		std::unique_ptr<compute::gpu_atlas_context> atlas_ctx;
+
+		gpu_context_impl(size_t num_reals, size_t num_imags);
+
+		cl_context context() { return obj(); }
+	};
+}
+
+// gpu buffer helper
+template<typename T, size_t Spec>
+impl::gpu_buffer<T, Spec>::gpu_buffer(cl_context context, size_t n)
+	:_size(n)
+{
+	cl_int error = CL_SUCCESS;
+
+	obj() = compute::cl().clCreateBuffer(context,
+		Spec,
+		sizeof(T) * (n),
+		nullptr, &error);
+
+	check(error, "device buffer alloc failed", "clCreateBuffer");
+}
+
+template<typename T, size_t Spec>
+void impl::gpu_buffer<T, Spec>::load(cl_command_queue queue, T *data, size_t size)
+{
+	cl_int error = compute::cl().clEnqueueWriteBuffer(queue, obj(), CL_TRUE /* blocking write */, 0u, sizeof(T) * size, data, 0u, NULL, NULL);
+
+	check(error, "buffer write failed", "clEnqueueWriteBuffer");
+}
+
+template<typename T, size_t Spec>
+void impl::gpu_buffer<T, Spec>::read(cl_command_queue queue, T *data, size_t size)
+{
+	cl_int error = compute::cl().clEnqueueReadBuffer(queue, obj(), CL_TRUE /* blocking read */, 0u, sizeof(T) * size, data, 0u, NULL, NULL);
+
+	check(error, "buffer read failed", "clEnqueueReadBuffer");
+}
+
+template<typename T, size_t Spec>
+void impl::gpu_buffer<T, Spec>::fill(cl_command_queue queue, T value)
+{
+	cl_int error = compute::cl().clEnqueueFillBuffer(queue, obj(), &value, sizeof(T), 0u, sizeof(T) * _size, 0u, NULL, NULL);
+
+	check(error, "buffer fill failed", "clEnqueueFillBuffer");
+}
+
+// gpu queue helper
+impl::gpu_queue::gpu_queue(cl_context context, cl_device_id deviceId)
+{
+	cl_int error = CL_SUCCESS;
+
+	obj() = compute::cl().clCreateCommandQueue(context, deviceId, 0, &error);
+
+	check(error, "device command queue alloc failed", "clCreateCommandQueue");
+}
+
+// gpu image helper
+template<size_t Spec>
+impl::gpu_image<Spec>::gpu_image(cl_context context, size_t width, size_t height)
+{
+	cl_int error = CL_SUCCESS;
+
+	cl_image_format format = {};
+	format.image_channel_data_type = CL_UNSIGNED_INT8;
+	format.image_channel_order = CL_RGBA;
+
+	desc.image_type = CL_MEM_OBJECT_IMAGE2D;
+	desc.image_width = width;
+	desc.image_height = height;
+
+	obj() = compute::cl().clCreateImage(context, Spec, &format, &desc, NULL, &error);
+
+	check(error, "error allocating image", "clCreateImage");
+}
+
+template<size_t Spec>
+void impl::gpu_image<Spec>::read(cl_command_queue queue, uint32_t* result, size_t size)
+{
+	if (size != desc.image_width * desc.image_height) {
+		throw std::runtime_error("image read size does not match the image");
+	}
+
+	const size_t origin[] = { 0u, 0u, 0u };
+	const size_t region[] = { desc.image_width, desc.image_height, 1u /* depth */ };
+	cl_int error = compute::cl().clEnqueueReadImage(queue, obj(), true /* blocking read */, origin, region, 0u, 0u, (void*)result, 0, NULL, NULL);
+	check(error, "error reading image buffer", "clEnqueueReadImage");
+}
+
+// gpu mandelbrot program
+impl::gpu_mandelbrot_program::gpu_mandelbrot_program(cl_context context, cl_device_id deviceId, std::string filename)
+{
+	std::ifstream codeStream{ filename };
+	if (!codeStream) {
+		throw std::runtime_error("could not load kernel from " + filename);
+	}
+	std::istreambuf_iterator<char> code_begin{ codeStream };
+	std::istreambuf_iterator<char> code_end;
+	std::string code{ code_begin, code_end };
+
+	cl_int error = CL_SUCCESS;
+
+	const char* codes[] = { code.c_str() };
+	const size_t lengths[] = { code.size() };
+
+	cl_program program = compute::cl().clCreateProgramWithSource(context, 1, codes, lengths, &error);
+
+	obj() = program;
+
+	check(error, ("unable to create program from " + filename).c_str(), "clCreateProgramWithSource");
+
+	const cl_device_id devices[] = { deviceId };
+	const char* options = "";
+
+	cl_int buildError = compute::cl().clBuildProgram(program, 1, devices, options, NULL, NULL);
+
+	if (CL_SUCCESS != buildError) {
+		//TODO extract build error and print
+		size_t errorLogLength;
+		cl_int error = compute::cl().clGetProgramBuildInfo(program,
+			deviceId, CL_PROGRAM_BUILD_LOG, 0, NULL, &errorLogLength);
+
+		if (CL_SUCCESS != error) {
+			throw compute::gpu_error("build failed for " + filename + " and error occured getting length of build logs", "clBuildProgram", buildError);
+		}
+
+		std::string errorLog(errorLogLength, ' ');
+
+		error = compute::cl().clGetProgramBuildInfo(program,
+			deviceId, CL_PROGRAM_BUILD_LOG, errorLogLength, (void*)errorLog.data(), NULL);
+
+		if (CL_SUCCESS != error) {
+			throw compute::gpu_error("build failed for " + filename + " and error occured getting build logs", "clBuildProgram", buildError);
+		}
+
+		throw compute::gpu_error("build failed for " + filename + "\n" + errorLog, "clBuildProgram", buildError);
+	}
+}
+
+impl::gpu_kernel::gpu_kernel(cl_program program, const char* name)
+{
+	cl_int error = CL_SUCCESS;
+	obj() = compute::cl().clCreateKernel(program, name, &error);
+	check(error, (std::string("failed to create kernel ") + name).c_str(), "clCreateKernel");
+}
+
+template<typename... Args>
+void impl::gpu_kernel::set_args(const Args&... args)
+{
+	auto setArg = [this, argIdx = 0u](const auto& arg) mutable {
+		constexpr const size_t argSize = sizeof(std::remove_reference_t<decltype(arg)>);
+		cl_int error = compute::cl().clSetKernelArg(obj(), argIdx++, argSize, (void*)&arg);
+		check(error, "error setting argument", "clSetKernelArg");
+	};
+
+	(setArg(args), ...);
+}
+
+void impl::gpu_kernel::run(cl_command_queue queue, std::array<size_t, 2> global_work_size, std::array<size_t, 2> local_work_size)
+{
+	constexpr const size_t work_dim = 2;
+
+	const size_t global_work_offset[work_dim] = { 0u, 0u };
+
+	cl_int error = compute::cl().clEnqueueNDRangeKernel(queue, obj(), work_dim, global_work_offset,
+		global_work_size.data(), local_work_size.data(), 0, NULL, NULL);
+
+	check(error, "kernel run error", "clEnqueueNDRangeKernel");
+}
+
+size_t impl::persistent_groups(cl_device_id deviceId)
+{
+	cl_uint units = 0;
+	cl_int error = compute::cl().clGetDeviceInfo(deviceId, CL_DEVICE_MAX_COMPUTE_UNITS, sizeof(units), &units, nullptr);
+	if (CL_SUCCESS != error || units == 0) {
+		units = 1;
+	}
+	return units * persistent_groups_per_unit;
+}
+
+// gpu context implementation, details
+compute::gpu_context_impl::gpu_context_impl(size_t num_reals, size_t num_imags)
+{
+	const compute::cl_api& api = compute::cl();
+
+	cl_uint platformIdCount = 0;
+	cl_int error = api.clGetPlatformIDs(0, nullptr, &platformIdCount);
+
+	if (error == platform_not_found || (CL_SUCCESS == error && platformIdCount == 0)) {
+		throw compute::gpu_error("no platforms found", "clGetPlatformIDs", platform_not_found);
+	}
+	impl::check(error, "could not count platforms", "clGetPlatformIDs");
+
+	// load details of platforms
+	std::vector<cl_platform_id> platformIds(platformIdCount, 0);
+	error = api.clGetPlatformIDs(platformIdCount, platformIds.data(), nullptr);
+	impl::check(error, "could not list platforms", "clGetPlatformIDs");
+
+	// assume first platform
+	cl_platform_id platformId = platformIds[0];
+
+	cl_uint deviceIdCount = 0;
+	error = api.clGetDeviceIDs(platformId, CL_DEVICE_TYPE_ALL, 0, nullptr,
+		&deviceIdCount);
+
+	if (error == CL_DEVICE_NOT_FOUND || (CL_SUCCESS == error && deviceIdCount == 0)) {
+		throw compute::gpu_error("no devices found", "clGetDeviceIDs", CL_DEVICE_NOT_FOUND);
+	}
+	impl::check(error, "could not count devices", "clGetDeviceIDs");
+
+	std::vector<cl_device_id> deviceIds(deviceIdCount);
+	error = api.clGetDeviceIDs(platformId, CL_DEVICE_TYPE_ALL, deviceIdCount,
+		deviceIds.data(), nullptr);
+	impl::check(error, "could not list devices", "clGetDeviceIDs");
+
+	this->deviceId = deviceIds[0];
+	const cl_context_properties contextProperties[] =
+	{
+		CL_CONTEXT_PLATFORM,
+		reinterpret_cast<cl_context_properties> (platformIds[0]),
+		0, 0
+	};
+
+	cl_context context = api.clCreateContext(
+		contextProperties, deviceIdCount,
+		deviceIds.data(), nullptr,
+		nullptr, &error);
+
+	impl::check(error, "could not create a context", "clCreateContext");
+
+	obj() = context;
+
+	mand_ctx = std::make_unique<compute::gpu_mandelbrot_context>(context, deviceId, num_reals, num_imags);
+	atlas_ctx = std::make_unique<compute::gpu_atlas_context>(mand_ctx->program.program());
+}
+
+compute::gpu_mandelbrot_context::gpu_mandelbrot_context(cl_context context, cl_device_id deviceId, size_t num_reals, size_t num_imags)
+	: escape_groups{ impl::round_up(num_reals, impl::group_size) / impl::group_size * (impl::round_up(num_imags, impl::group_size) / impl::group_size) }
+	, persistent_groups{ impl::persistent_groups(deviceId) }
+	// Create input buffers
+	, device_reals{ context, num_reals }
+	, device_imags{ context, num_imags }
+	// Create intermediate buffers
+	, device_escape{ context, num_reals * num_imags }
+	, device_distance{ context, num_reals * num_imags }
+	, device_histogram{ context, coloring::histogram_bins }
+	, device_cdf{ context, coloring::histogram_bins }
+	, device_lane_counts{ context, 2 * std::max(escape_groups, persistent_groups) }
+	, device_queue{ context, 1 }
+	, lane_counts(device_lane_counts.size())
+	// Create output buffers
+	, device_result{ context, num_reals, num_imags }
+	// Create context for computation
+	, queue{ context, deviceId }
+	, program{ context, deviceId, "mandelbrot.cl" }
+	, escape_kernel{ program.program(), "mandelbrot" }
+	, persistent_kernel{ program.program(), "mandelbrot_persistent" }
+	, cdf_kernel{ program.program(), "histogram_cdf" }
+	, colorize_kernel{ program.program(), "colorize" }
+{
+}
+
+template<typename TimePoint>
+auto microsBetween(const TimePoint& a, const TimePoint& b)
+{
+	TimePoint i = a;
+	TimePoint j = b;
+
+	if (i > j) {
+		std::swap(i, j);
+	}
+
+	return std::chrono::duration_cast<std::chrono::microseconds>(j - i).count();
+}
+
+// gpu context, client interface
+compute::gpu_context::gpu_context(size_t num_reals, size_t num_imags, const compute::recovery_policy& policy)
+	: _num_reals{ num_reals }, _num_imags{ num_imags }, _policy{ policy }
+{
+	auto start = std::chrono::high_resolution_clock::now();
+	_impl = std::make_unique<gpu_context_impl>(num_reals, num_imags);
+	auto finish = std::chrono::high_resolution_clock::now();
+	std::clog << "Allocation and compile time (us): " << microsBetween(start, finish) << '\n';
+}
+
+compute::gpu_context::~gpu_context() = default;
+
+void compute::gpu_context::rebuild()
+{
+	// the old objects go first, a reset device may not have room for both
+	_impl.reset();
+	_stats.rebuilds++;
+	_impl = std::make_unique<gpu_context_impl>(_num_reals, _num_imags);
+}
+
+namespace {
+	// Runs device on the context. After a transient error the context is
+	// rebuilt and device runs again while retries last. Returns false when
+	// the device failed for good and the caller should use the host, or
+	// rethrows when the policy does not allow that.
+	template<typename Device>
+	bool on_device(compute::gpu_context& context, unsigned& retries, Device&& device)
+	{
+		const bool fallback = context.policy().host_fallback;
+
+		while (context.available()) {
+			try {
+				device(context.impl());
+				return true;
+			}
+			catch (const compute::gpu_error& error) {
+				if (!error.transient()) {
+					context.stats().permanent_errors++;
+					if (!fallback) {
+						throw;
+					}
+					return false;
+				}
+
+				context.stats().transient_errors++;
+				if (retries == 0) {
+					if (!fallback) {
+						throw;
+					}
+					return false;
+				}
+				retries--;
+			}
+
+			try {
+				context.rebuild();
+			}
+			catch (const compute::gpu_error&) {
+				// the device is gone, available() is false from here on
+				if (!fallback) {
+					throw;
+				}
+			}
+		}
+
+		if (!fallback) {
+			throw std::runtime_error("gpu context was lost and could not be rebuilt");
+		}
+		return false;
+	}
+
+	void on_host(compute::compute_io_data& data, compute::gpu_context& context)
+	{
+		compute::host_compute(data);
+		context.stats().host_frames++;
+	}
+
+	// the atlas of frames, split in halves when the device fails on it until
+	// single frames are left, those are rendered on the host
+	void compute_range(compute::compute_io_data* frames, size_t count, compute::gpu_context& context,
+		unsigned& retries, compute::timing& total)
+	{
+		compute::timing timing;
+		const bool done = on_device(context, retries, [&](compute::gpu_context_impl& impl) {
+			timing = impl.atlas_ctx->compute(impl.context(), impl.mand_ctx->queue.queue(), frames, count);
+		});
+
+		if (done) {
+			total.upload_us += timing.upload_us;
+			total.kernel_us += timing.kernel_us;
+			total.download_us += timing.download_us;
+			return;
+		}
+
+		if (count == 1 || !context.available()) {
+			for (size_t frame = 0; frame < count; frame++) {
+				on_host(frames[frame], context);
+				total.kernel_us += frames[frame].timing.kernel_us;
+			}
+			return;
+		}
+
+		compute_range(frames, count / 2, context, retries, total);
+		compute_range(frames + count / 2, count - count / 2, context, retries, total);
+	}
+
+	void check_device_spec(const mandelbrot::input_spec& spec);
+}
+
+// mandelbrot computation
+
+void compute::compute(compute::compute_io_data& data, compute::gpu_context& context)
+{
+	// not a device failure, no fallback
+	check_device_spec(data.spec);
+
+	unsigned retries = context.policy().retries;
+	const bool done = on_device(context, retries, [&](gpu_context_impl& impl) {
+		impl.mand_ctx->compute(data);
+	});
+
+	if (!done) {
+		on_host(data, context);
+	}
+}
+
+compute::timing compute::compute_batch(std::vector<compute::compute_io_data>& frames, compute::gpu_context& context)
+{
+	for (const compute::compute_io_data& data : frames) {
+		check_device_spec(data.spec);
+	}
+
+	compute::timing timing;
+	unsigned retries = context.policy().retries;
+	compute_range(frames.data(), frames.size(), context, retries, timing);
+	return timing;
+}
+
+namespace {
+	void check_device_spec(const mandelbrot::input_spec& spec)
+	{
+		if (spec.precision != mandelbrot::precision::single) {
+			throw std::runtime_error("gpu backend only supports single precision");
+		}
+
+		const bool square = spec.formula == mandelbrot::formula::mandelbrot
+			|| (spec.formula == mandelbrot::formula::multibrot && spec.power == 2);
+		if (!square) {
+			throw std::runtime_error("gpu backend only supports the mandelbrot formula");
+		}
+	}
+}
+
+void compute::gpu_mandelbrot_context::compute(compute::compute_io_data& data)
+{
+	const mandelbrot::input_spec& spec = data.spec;
+
+	check_device_spec(spec);
+
+	if (data.input.reals.size() != device_reals.size() || data.input.imags.size() != device_imags.size()) {
+		throw std::runtime_error("frame size does not match the gpu context");
+	}
+
+	const cl_uint width = static_cast<cl_uint>(data.output.width);
+	const cl_uint height = static_cast<cl_uint>(data.output.height);
+	const cl_uint max_iterations = static_cast<cl_uint>(spec.max_iterations);
+	const cl_uint coloring = static_cast<cl_uint>(spec.coloring);
+	const cl_float pixel_size = util::step_size(spec.zoom_level);
+
+	const std::array<size_t, 2> global_work_size = {
+		impl::round_up(width, impl::group_size), impl::round_up(height, impl::group_size) };
+	const std::array<size_t, 2> local_work_size = { impl::group_size, impl::group_size };
+
+	auto start = std::chrono::high_resolution_clock::now();
+
+	// Copy input
+	device_reals.load(queue.queue(), data.input.reals.data(), device_reals.size());
+	device_imags.load(queue.queue(), data.input.imags.data(), device_imags.size());
+	device_histogram.fill(queue.queue(), 0u);
+
+	auto calculationStart = std::chrono::high_resolution_clock::now();
+
+	// Calculate escape fields and histogram in one pass
+	size_t groups = escape_groups;
+	if (spec.schedule == mandelbrot::schedule::compacted) {
+		groups = persistent_groups;
+		device_queue.fill(queue.queue(), 0u);
+		persistent_kernel.set_args(device_reals.buff(), device_imags.buff(), width, height, max_iterations,
+			device_escape.buff(), device_distance.buff(), device_histogram.buff(),
+			device_lane_counts.buff(), device_queue.buff());
+		persistent_kernel.run(queue.queue(), { groups * impl::persistent_group_items, 1u }, { impl::persistent_group_items, 1u });
+	}
+	else {
+		escape_kernel.set_args(device_reals.buff(), device_imags.buff(), width, height, max_iterations,
+			device_escape.buff(), device_distance.buff(), device_histogram.buff(), device_lane_counts.buff());
+		escape_kernel.run(queue.queue(), global_work_size, local_work_size);
+	}
+
+	if (spec.coloring == mandelbrot::coloring_mode::histogram) {
+		cdf_kernel.set_args(device_histogram.buff(), device_cdf.buff());
+		cdf_kernel.run(queue.queue(), { 1u, 1u }, { 1u, 1u });
+	}
+
+	// Colour
+	colorize_kernel.set_args(device_escape.buff(), device_distance.buff(), device_cdf.buff(),
+		width, height, max_iterations, coloring, pixel_size, device_result.buff());
+	colorize_kernel.run(queue.queue(), global_work_size, local_work_size);
+
+	impl::check(compute::cl().clFinish(queue.queue()), "frame did not complete", "clFinish");
+
+	auto copyBackStart = std::chrono::high_resolution_clock::now();
+
+	// Copy result
+	device_result.read(queue.queue(), data.output.out.data(), data.output.out.size());
+	device_escape.read(queue.queue(), data.output.escape.data(), data.output.escape.size());
+	device_distance.read(queue.queue(), data.output.distance.data(), data.output.distance.size());
+
+	device_lane_counts.read(queue.queue(), lane_counts.data(), 2 * groups);
+	data.lanes = {};
+	for (size_t group = 0; group < groups; group++) {
+		data.lanes.active += lane_counts[2 * group];
+		data.lanes.issued += lane_counts[2 * group + 1];
+	}
+
+	auto finish = std::chrono::high_resolution_clock::now();
+
+	data.timing.upload_us = microsBetween(start, calculationStart);
+	data.timing.kernel_us = microsBetween(calculationStart, copyBackStart);
+	data.timing.download_us = microsBetween(copyBackStart, finish);
+}
+
+// atlas of small frames
+compute::gpu_atlas_buffers::gpu_atlas_buffers(cl_context context, size_t frames, size_t axes, size_t pixels)
+	: device_tiles{ context, frames }
+	, device_axes{ context, axes }
+	, device_escape{ context, pixels }
+	, device_distance{ context, pixels }
+	, device_histograms{ context, frames * coloring::histogram_bins }
+	, device_cdfs{ context, frames * coloring::histogram_bins }
+	, device_pixels{ context, pixels }
+{
+}
+
+bool compute::gpu_atlas_buffers::fits(size_t frames, size_t axes, size_t pixels) const
+{
+	return frames <= device_tiles.size() && axes <= device_axes.size() && pixels <= device_escape.size();
+}
+
+compute::gpu_atlas_context::gpu_atlas_context(cl_program program)
+	: escape_kernel{ program, "mandelbrot_atlas" }
+	, cdf_kernel{ program, "histogram_cdf_atlas" }
+	, colorize_kernel{ program, "colorize_atlas" }
+{
+}
+
+compute::timing compute::gpu_atlas_context::compute(cl_context context, cl_command_queue queue, compute::compute_io_data* frames, size_t count)
+{
+	compute::timing timing;
+	if (count == 0) {
+		return timing;
+	}
+
+	auto start = std::chrono::high_resolution_clock::now();
+
+	// lay the frames out one after another, coordinates and pixels alike
+	tiles.resize(count);
+	size_t total_axes = 0, total_pixels = 0, largest = 0;
+	bool histogram = false;
+	for (size_t frame = 0; frame < count; frame++) {
+		const compute::compute_io_data& data = frames[frame];
+		check_device_spec(data.spec);
+
+		const size_t width = data.input.reals.size();
+		const size_t height = data.input.imags.size();
+
+		tile_descriptor& tile = tiles[frame];
+		tile.reals = static_cast<cl_uint>(total_axes);
+		tile.imags = static_cast<cl_uint>(total_axes + width);
+		tile.pixels = static_cast<cl_uint>(total_pixels);
+		tile.width = static_cast<cl_uint>(width);
+		tile.height = static_cast<cl_uint>(height);
+		tile.max_iterations = static_cast<cl_uint>(data.spec.max_iterations);
+		tile.coloring = static_cast<cl_uint>(data.spec.coloring);
+		tile.pixel_size = static_cast<cl_float>(util::step_size(data.spec.zoom_level));
+
+		total_axes += width + height;
+		total_pixels += width * height;
+		largest = std::max(largest, width * height);
+		histogram = histogram || data.spec.coloring == mandelbrot::coloring_mode::histogram;
+	}
+
+	if (total_pixels == 0) {
+		return timing;
+	}
+
+	// the real then imaginary axis of every frame in one buffer
+	axes.resize(total_axes);
+	for (size_t frame = 0; frame < count; frame++) {
+		const mandelbrot::host_input& input = frames[frame].input;
+		std::copy(input.reals.begin(), input.reals.end(), axes.begin() + tiles[frame].reals);
+		std::copy(input.imags.begin(), input.imags.end(), axes.begin() + tiles[frame].imags);
+	}
+
+	if (!buffers || !buffers->fits(count, total_axes, total_pixels)) {
+		buffers.reset();
+		buffers = std::make_unique<gpu_atlas_buffers>(context, count, total_axes, total_pixels);
+	}
+	gpu_atlas_buffers& device = *buffers;
+
+	device.device_tiles.load(queue, tiles.data(), tiles.size());
+	device.device_axes.load(queue, axes.data(), total_axes);
+	if (histogram) {
+		device.device_histograms.fill(queue, 0u);
+	}
+
+	auto calculationStart = std::chrono::high_resolution_clock::now();
+
+	const std::array<size_t, 2> global_work_size = { impl::round_up(largest, impl::atlas_group_items), count };
+	const std::array<size_t, 2> local_work_size = { impl::atlas_group_items, 1u };
+
+	escape_kernel.set_args(device.device_tiles.buff(), device.device_axes.buff(),
+		device.device_escape.buff(), device.device_distance.buff(), device.device_histograms.buff());
+	escape_kernel.run(queue, global_work_size, local_work_size);
+
+	if (histogram) {
+		const cl_uint frame_count = static_cast<cl_uint>(count);
+		cdf_kernel.set_args(device.device_histograms.buff(), device.device_cdfs.buff(), frame_count);
+		cdf_kernel.run(queue, { count, 1u }, { 1u, 1u });
+	}
+
+	colorize_kernel.set_args(device.device_tiles.buff(), device.device_escape.buff(), device.device_distance.buff(),
+		device.device_cdfs.buff(), device.device_pixels.buff());
+	colorize_kernel.run(queue, global_work_size, local_work_size);
+
+	impl::check(compute::cl().clFinish(queue), "atlas did not complete", "clFinish");
+
+	auto copyBackStart = std::chrono::high_resolution_clock::now();
+
+	// one read per field for the whole atlas
+	escape.resize(total_pixels);
+	distance.resize(total_pixels);
+	pixels.resize(total_pixels);
+	device.device_escape.read(queue, escape.data(), total_pixels);
+	device.device_distance.read(queue, distance.data(), total_pixels);
+	device.device_pixels.read(queue, pixels.data(), total_pixels);
+
+	util::parallel_for(count, 16u, [&](size_t begin, size_t end, size_t) {
+		for (size_t frame = begin; frame < end; frame++) {
+			mandelbrot::host_output& output = frames[frame].output;
+			const size_t first = tiles[frame].pixels;
+			const size_t size = output.width * output.height;
+
+			std::copy(pixels.begin() + first, pixels.begin() + first + size, output.out.begin());
+			std::copy(escape.begin() + first, escape.begin() + first + size, output.escape.begin());
+			std::copy(distance.begin() + first, distance.begin() + first + size, output.distance.begin());
+
+			frames[frame].timing = {};
+			frames[frame].lanes = {};
+		}
+	});
+
+	auto finish = std::chrono::high_resolution_clock::now();
+
+	timing.upload_us = microsBetween(start, calculationStart);
+	timing.kernel_us = microsBetween(calculationStart, copyBackStart);
+	timing.download_us = microsBetween(copyBackStart, finish);
+	return timing;
+}
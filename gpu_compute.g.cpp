@@ -1,34 +1,43 @@
-
-#include "gpu_compute.h"
-
-#include <gtest/gtest.h>
-
-TEST(GPUCompute, Prepare)
-{
-	mandelbrot::input_spec spec;
-
-	compute::compute_io_data data{ spec };
-}
-
-TEST(GPUCompute, PopulatesArgs)
-{
-	float width = 1.0f;
-	float height = 1.0f;
-
-	mandelbrot::input_spec spec;
-	spec.center = { 0.0f,0.0f };
-	spec.imag_height = height;
-	spec.real_width = width;
-	spec.imag_step = height / 10.0f;
-	spec.real_step = width / 10.0f;
-
-	compute::compute_io_data data{ spec };
-
-	ASSERT_EQ(11u, data.input.imags.size());
-	ASSERT_EQ(11u, data.input.reals.size());
-}
-
-TEST(GPUCompute, ContextCreate)
-{
-	compute::gpu_context context;
-}
\ No newline at end of file
+
+#include "gpu_compute.h"
+
+#include <gtest/gtest.h>
+
+TEST(GPUCompute, Prepare)
+{
+	mandelbrot::input_spec spec;
+
+	compute::compute_io_data data{ spec };
+}
+
+TEST(GPUCompute, PopulatesArgs)
+{
+	mandelbrot::input_spec spec;
+	spec.center = { 0.0, 0.0 };
+	spec.output_width = 11;
+	spec.output_height = 11;
+	spec.zoom_level = 1.0f;
+
+	compute::compute_io_data data{ spec };
+
+	ASSERT_EQ(11u, data.input.imags.size());
+	ASSERT_EQ(11u, data.input.reals.size());
+	ASSERT_EQ(11u * 11u, data.output.out.size());
+
+	// centred on the middle pixel, a step apart
+	const float step = static_cast<float>(util::step_size(spec.zoom_level));
+	ASSERT_FLOAT_EQ(0.0f, data.input.reals[5]);
+	ASSERT_FLOAT_EQ(step, data.input.reals[6] - data.input.reals[5]);
+	ASSERT_FLOAT_EQ(-5.0f * step, data.input.imags[0]);
+}
+
+TEST(GPUCompute, ContextCreate)
+{
+	try {
+		compute::gpu_context context{ 64, 64 };
+		ASSERT_TRUE(context.available());
+	}
+	catch (const compute::gpu_error& error) {
+		GTEST_SKIP() << "no OpenCL device: " << error.what();
+	}
+}
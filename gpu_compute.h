@@ -1,33 +1,134 @@
-#pragma once
-
-#include <mandelbrot.h>
-
-namespace compute {
-	class compute_io_data {
-	public:
-		mandelbrot::host_input input;
-		mandelbrot::host_output output;
-
-		compute_io_data(const mandelbrot::input_spec& spec);
-	};
-	
-	// implementation detail
-	class gpu_context_impl;
-
-	class gpu_context {
-	private:
-		std::unique_ptr<gpu_context_impl> _impl;
-	public:
-		gpu_context(size_t num_reals, size_t num_imags);
-		~gpu_context();
-
-		gpu_context_impl& impl() { return *_impl;  }
-	};
-
-	void compute(compute_io_data&, gpu_context&);
-}
-
-inline compute::compute_io_data::compute_io_data(const mandelbrot::input_spec& spec)
-	: input{ spec }, output{ input }
-{
-}
+#pragma once
+
+#include <mandelbrot.h>
+
+#include <memory>
+#include <stdexcept>
+#include <string>
+
+namespace compute {
+	// where the time of the last compute went, in microseconds
+	struct timing {
+		long long upload_us{ 0 };
+		long long kernel_us{ 0 };
+		long long download_us{ 0 };
+
+		long long total_us() const { return upload_us + kernel_us + download_us; }
+	};
+
+	// lane iterations of the last compute, SIMD lanes on the host and work items
+	// on the device, issued also counts lanes that were stepped while idle
+	struct lane_usage {
+		uint64_t active{ 0 };
+		uint64_t issued{ 0 };
+
+		double utilization() const { return issued == 0 ? 0.0 : double(active) / double(issued); }
+	};
+
+	class compute_io_data {
+	public:
+		mandelbrot::input_spec spec;
+		mandelbrot::host_input input;
+		mandelbrot::host_output output;
+		compute::timing timing;
+		compute::lane_usage lanes;
+
+		compute_io_data(const mandelbrot::input_spec& spec);
+
+		// set up for another frame in place, no allocation unless the frame grows
+		void reset(const mandelbrot::input_spec& spec);
+	};
+
+	// an OpenCL call that failed, code is the CL error code it returned
+	class gpu_error : public std::runtime_error {
+	private:
+		int32_t _code;
+		std::string _call;
+	public:
+		gpu_error(const std::string& what, const std::string& call, int32_t code);
+
+		int32_t code() const { return _code; }
+		const std::string& call() const { return _call; }
+
+		// device unavailable or out of resources, a rebuilt context may succeed
+		bool transient() const;
+	};
+
+	// name of a CL error code, such as CL_OUT_OF_RESOURCES
+	std::string cl_error_name(int32_t code);
+
+	// how compute and compute_batch recover from device errors
+	struct recovery_policy {
+		// context rebuilds per call after transient errors
+		unsigned retries{ 2 };
+		// render frames the device failed on on the host rather than throw
+		bool host_fallback{ true };
+	};
+
+	struct recovery_stats {
+		uint64_t transient_errors{ 0 };
+		uint64_t permanent_errors{ 0 };
+		uint64_t rebuilds{ 0 };
+		// frames rendered on the host after a device error
+		uint64_t host_frames{ 0 };
+	};
+
+	// implementation detail
+	class gpu_context_impl;
+
+	class gpu_context {
+	private:
+		size_t _num_reals, _num_imags;
+		compute::recovery_policy _policy;
+		compute::recovery_stats _stats;
+		std::unique_ptr<gpu_context_impl> _impl;
+	public:
+		// throws gpu_error when there is no usable device
+		gpu_context(size_t num_reals, size_t num_imags, const compute::recovery_policy& policy = {});
+		~gpu_context();
+
+		gpu_context_impl& impl() { return *_impl;  }
+
+		// false once a rebuild failed, every frame goes to the host from then on
+		bool available() const { return _impl != nullptr; }
+
+		// releases every device object and creates them again on a new context
+		void rebuild();
+
+		const compute::recovery_policy& policy() const { return _policy; }
+		const compute::recovery_stats& stats() const { return _stats; }
+		compute::recovery_stats& stats() { return _stats; }
+	};
+
+	// evaluates the fractal and gathers the escape count histogram in a single
+	// pass on the device, then colours the frame as selected by spec.coloring.
+	// A compacted schedule runs the persistent threads kernel, data.lanes counts
+	// work items as idle while another of their work group still runs.
+	// Transient device errors rebuild the context and retry, a frame the
+	// device still fails on is rendered on the host as the policy allows
+	void compute(compute_io_data&, gpu_context&);
+
+	// Evaluates and colours many small frames, such as thumbnails, in one
+	// launch. Frames are packed into an atlas with a descriptor each, their
+	// coordinates and descriptors are uploaded once and the results read back
+	// once and sliced into every frame's output. Frames may differ in size,
+	// view, iterations and colouring. Uses the fixed schedule and leaves the
+	// frames' timing and lanes empty, returns the timing of the whole batch.
+	// A batch that still fails after recovery is split in halves down to
+	// single frames, which fall back to the host one at a time.
+	compute::timing compute_batch(std::vector<compute_io_data>& frames, gpu_context&);
+}
+
+inline compute::compute_io_data::compute_io_data(const mandelbrot::input_spec& _spec)
+	: spec{ _spec }, input{ spec }, output{ input }
+{
+}
+
+inline void compute::compute_io_data::reset(const mandelbrot::input_spec& _spec)
+{
+	spec = _spec;
+	input.assign(spec);
+	output.resize(input.reals.size(), input.imags.size());
+	timing = {};
+	lanes = {};
+}
@@ -0,0 +1,481 @@
+#include "cl_api.h"
+#include "gpu_compute.h"
+#include "host_compute.h"
+
+#include <gtest/gtest.h>
+
+#include <cstring>
+#include <map>
+#include <string>
+#include <vector>
+
+namespace {
+	// Test double of the OpenCL API, a device without kernels: memory objects
+	// keep their contents on the host and start out filled with a pattern, so
+	// frames read back from the device are all pattern while frames rendered
+	// on the host are not. Calls can be made to fail with a chosen code.
+	struct fake_object {
+		std::vector<uint8_t> memory;
+	};
+
+	constexpr const uint8_t pattern = 0xa5;
+	constexpr const uint32_t pattern_pixel = 0xa5a5a5a5u;
+
+	struct fault {
+		std::string call;
+		cl_int code;
+		// calls let through before failing, then calls that fail
+		unsigned skip;
+		unsigned count;
+	};
+
+	struct fake_state {
+		std::vector<fault> faults;
+		std::map<std::string, unsigned> calls;
+		int live_objects{ 0 };
+	};
+
+	fake_state* state = nullptr;
+
+	int platform_tag, device_tag;
+
+	cl_int injected(const char* call)
+	{
+		state->calls[call]++;
+		for (fault& f : state->faults) {
+			if (f.call != call || f.count == 0) {
+				continue;
+			}
+			if (f.skip > 0) {
+				f.skip--;
+				continue;
+			}
+			f.count--;
+			return f.code;
+		}
+		return CL_SUCCESS;
+	}
+
+	template<typename Handle>
+	Handle create(const char* call, size_t bytes, cl_int* error)
+	{
+		const cl_int code = injected(call);
+		if (error) {
+			*error = code;
+		}
+		if (code != CL_SUCCESS) {
+			return nullptr;
+		}
+		state->live_objects++;
+		return reinterpret_cast<Handle>(new fake_object{ std::vector<uint8_t>(bytes, pattern) });
+	}
+
+	template<typename Handle>
+	cl_int CL_API_CALL release(Handle handle)
+	{
+		state->live_objects--;
+		delete reinterpret_cast<fake_object*>(handle);
+		return CL_SUCCESS;
+	}
+
+	std::vector<uint8_t>& memory_of(cl_mem mem) { return reinterpret_cast<fake_object*>(mem)->memory; }
+
+	cl_int CL_API_CALL get_platform_ids(cl_uint entries, cl_platform_id* platforms, cl_uint* count)
+	{
+		if (cl_int error = injected("clGetPlatformIDs")) {
+			return error;
+		}
+		if (count) {
+			*count = 1;
+		}
+		if (platforms && entries > 0) {
+			platforms[0] = reinterpret_cast<cl_platform_id>(&platform_tag);
+		}
+		return CL_SUCCESS;
+	}
+
+	cl_int CL_API_CALL get_device_ids(cl_platform_id, cl_device_type, cl_uint entries, cl_device_id* devices, cl_uint* count)
+	{
+		if (cl_int error = injected("clGetDeviceIDs")) {
+			return error;
+		}
+		if (count) {
+			*count = 1;
+		}
+		if (devices && entries > 0) {
+			devices[0] = reinterpret_cast<cl_device_id>(&device_tag);
+		}
+		return CL_SUCCESS;
+	}
+
+	cl_int CL_API_CALL get_device_info(cl_device_id, cl_device_info, size_t size, void* value, size_t*)
+	{
+		const cl_uint units = 2;
+		if (value && size >= sizeof(units)) {
+			std::memcpy(value, &units, sizeof(units));
+		}
+		return injected("clGetDeviceInfo");
+	}
+
+	cl_context CL_API_CALL create_context(const cl_context_properties*, cl_uint, const cl_device_id*,
+		void (CL_API_CALL*)(const char*, const void*, size_t, void*), void*, cl_int* error)
+	{
+		return create<cl_context>("clCreateContext", 0, error);
+	}
+
+	cl_command_queue CL_API_CALL create_queue(cl_context, cl_device_id, cl_command_queue_properties, cl_int* error)
+	{
+		return create<cl_command_queue>("clCreateCommandQueue", 0, error);
+	}
+
+	cl_mem CL_API_CALL create_buffer(cl_context, cl_mem_flags, size_t size, void*, cl_int* error)
+	{
+		return create<cl_mem>("clCreateBuffer", size, error);
+	}
+
+	cl_mem CL_API_CALL create_image(cl_context, cl_mem_flags, const cl_image_format*, const cl_image_desc* desc, void*, cl_int* error)
+	{
+		return create<cl_mem>("clCreateImage", desc->image_width * desc->image_height * 4, error);
+	}
+
+	cl_program CL_API_CALL create_program(cl_context, cl_uint, const char**, const size_t*, cl_int* error)
+	{
+		return create<cl_program>("clCreateProgramWithSource", 0, error);
+	}
+
+	cl_int CL_API_CALL build_program(cl_program, cl_uint, const cl_device_id*, const char*,
+		void (CL_API_CALL*)(cl_program, void*), void*)
+	{
+		return injected("clBuildProgram");
+	}
+
+	cl_int CL_API_CALL get_build_info(cl_program, cl_device_id, cl_program_build_info, size_t size, void* value, size_t* size_ret)
+	{
+		if (size_ret) {
+			*size_ret = 1;
+		}
+		if (value && size > 0) {
+			static_cast<char*>(value)[0] = '\0';
+		}
+		return CL_SUCCESS;
+	}
+
+	cl_kernel CL_API_CALL create_kernel(cl_program, const char*, cl_int* error)
+	{
+		return create<cl_kernel>("clCreateKernel", 0, error);
+	}
+
+	cl_int CL_API_CALL set_kernel_arg(cl_kernel, cl_uint, size_t, const void*)
+	{
+		return injected("clSetKernelArg");
+	}
+
+	cl_int CL_API_CALL write_buffer(cl_command_queue, cl_mem mem, cl_bool, size_t offset, size_t size, const void* data,
+		cl_uint, const cl_event*, cl_event*)
+	{
+		if (cl_int error = injected("clEnqueueWriteBuffer")) {
+			return error;
+		}
+		std::memcpy(memory_of(mem).data() + offset, data, size);
+		return CL_SUCCESS;
+	}
+
+	cl_int CL_API_CALL read_buffer(cl_command_queue, cl_mem mem, cl_bool, size_t offset, size_t size, void* data,
+		cl_uint, const cl_event*, cl_event*)
+	{
+		if (cl_int error = injected("clEnqueueReadBuffer")) {
+			return error;
+		}
+		std::memcpy(data, memory_of(mem).data() + offset, size);
+		return CL_SUCCESS;
+	}
+
+	cl_int CL_API_CALL fill_buffer(cl_command_queue, cl_mem, const void*, size_t, size_t, size_t, cl_uint, const cl_event*, cl_event*)
+	{
+		// leaves the pattern, nothing reads the filled buffers back
+		return injected("clEnqueueFillBuffer");
+	}
+
+	cl_int CL_API_CALL read_image(cl_command_queue, cl_mem mem, cl_bool, const size_t*, const size_t* region, size_t, size_t,
+		void* data, cl_uint, const cl_event*, cl_event*)
+	{
+		if (cl_int error = injected("clEnqueueReadImage")) {
+			return error;
+		}
+		std::memcpy(data, memory_of(mem).data(), region[0] * region[1] * 4);
+		return CL_SUCCESS;
+	}
+
+	cl_int CL_API_CALL run_kernel(cl_command_queue, cl_kernel, cl_uint, const size_t*, const size_t*, const size_t*,
+		cl_uint, const cl_event*, cl_event*)
+	{
+		return injected("clEnqueueNDRangeKernel");
+	}
+
+	cl_int CL_API_CALL finish(cl_command_queue)
+	{
+		return injected("clFinish");
+	}
+
+	compute::cl_api fake_api()
+	{
+		compute::cl_api api = compute::native_cl_api();
+		api.clGetPlatformIDs = &get_platform_ids;
+		api.clGetDeviceIDs = &get_device_ids;
+		api.clGetDeviceInfo = &get_device_info;
+		api.clCreateContext = &create_context;
+		api.clReleaseContext = &release<cl_context>;
+		api.clCreateCommandQueue = &create_queue;
+		api.clReleaseCommandQueue = &release<cl_command_queue>;
+		api.clCreateBuffer = &create_buffer;
+		api.clCreateImage = &create_image;
+		api.clReleaseMemObject = &release<cl_mem>;
+		api.clCreateProgramWithSource = &create_program;
+		api.clBuildProgram = &build_program;
+		api.clGetProgramBuildInfo = &get_build_info;
+		api.clReleaseProgram = &release<cl_program>;
+		api.clCreateKernel = &create_kernel;
+		api.clReleaseKernel = &release<cl_kernel>;
+		api.clSetKernelArg = &set_kernel_arg;
+		api.clEnqueueWriteBuffer = &write_buffer;
+		api.clEnqueueReadBuffer = &read_buffer;
+		api.clEnqueueFillBuffer = &fill_buffer;
+		api.clEnqueueReadImage = &read_image;
+		api.clEnqueueNDRangeKernel = &run_kernel;
+		api.clFinish = &finish;
+		return api;
+	}
+
+	mandelbrot::input_spec test_spec()
+	{
+		mandelbrot::input_spec spec;
+		spec.center = { -0.5, 0.0 };
+		spec.output_width = 32;
+		spec.output_height = 16;
+		spec.zoom_level = -1.0f;
+		spec.max_iterations = 50;
+		return spec;
+	}
+
+	bool from_device(const compute::compute_io_data& data)
+	{
+		for (uint32_t pixel : data.output.out) {
+			if (pixel != pattern_pixel) {
+				return false;
+			}
+		}
+		return true;
+	}
+
+	bool from_host(const compute::compute_io_data& data)
+	{
+		compute::compute_io_data expected{ data.spec };
+		compute::host_compute(expected);
+		return expected.output.out == data.output.out && expected.output.escape == data.output.escape;
+	}
+
+	class GPUFaults : public testing::Test {
+	protected:
+		fake_state fake;
+		compute::cl_api saved;
+
+		void SetUp() override
+		{
+			state = &fake;
+			saved = compute::cl();
+			compute::cl() = fake_api();
+		}
+
+		void TearDown() override
+		{
+			compute::cl() = saved;
+			state = nullptr;
+		}
+
+		void inject(const char* call, cl_int code, unsigned count = 1, unsigned skip = 0)
+		{
+			fake.faults.push_back({ call, code, skip, count });
+		}
+	};
+}
+
+TEST_F(GPUFaults, NoPlatform)
+{
+	inject("clGetPlatformIDs", -1001);
+
+	try {
+		compute::gpu_context context{ 32, 16 };
+		FAIL() << "context created without a platform";
+	}
+	catch (const compute::gpu_error& error) {
+		ASSERT_EQ(-1001, error.code());
+		ASSERT_EQ("clGetPlatformIDs", error.call());
+		ASSERT_FALSE(error.transient());
+	}
+}
+
+TEST_F(GPUFaults, ErrorNamesCode)
+{
+	inject("clCreateBuffer", CL_INVALID_BUFFER_SIZE);
+
+	try {
+		compute::gpu_context context{ 32, 16 };
+		FAIL() << "context created without its buffers";
+	}
+	catch (const compute::gpu_error& error) {
+		ASSERT_EQ(CL_INVALID_BUFFER_SIZE, error.code());
+		ASSERT_NE(std::string::npos, std::string(error.what()).find("CL_INVALID_BUFFER_SIZE"));
+	}
+
+	// everything created before the failure was released
+	ASSERT_EQ(0, fake.live_objects);
+}
+
+TEST_F(GPUFaults, RendersOnDevice)
+{
+	compute::gpu_context context{ 32, 16 };
+	compute::compute_io_data data{ test_spec() };
+
+	compute::compute(data, context);
+
+	ASSERT_TRUE(from_device(data));
+	ASSERT_EQ(0u, context.stats().host_frames);
+}
+
+TEST_F(GPUFaults, TransientErrorRebuildsAndRetries)
+{
+	compute::gpu_context context{ 32, 16 };
+	const int objects = fake.live_objects;
+
+	inject("clFinish", CL_OUT_OF_RESOURCES);
+	compute::compute_io_data data{ test_spec() };
+	compute::compute(data, context);
+
+	ASSERT_TRUE(from_device(data));
+	ASSERT_EQ(1u, context.stats().transient_errors);
+	ASSERT_EQ(1u, context.stats().rebuilds);
+	ASSERT_EQ(0u, context.stats().host_frames);
+	ASSERT_EQ(2u, fake.calls["clCreateContext"]);
+
+	// the old context was released, not leaked
+	ASSERT_EQ(objects, fake.live_objects);
+}
+
+TEST_F(GPUFaults, RetriesRunOut)
+{
+	compute::recovery_policy policy;
+	policy.retries = 2;
+	compute::gpu_context context{ 32, 16, policy };
+
+	inject("clEnqueueReadImage", CL_OUT_OF_RESOURCES, 3);
+	compute::compute_io_data data{ test_spec() };
+	compute::compute(data, context);
+
+	ASSERT_TRUE(from_host(data));
+	ASSERT_EQ(3u, context.stats().transient_errors);
+	ASSERT_EQ(2u, context.stats().rebuilds);
+	ASSERT_EQ(1u, context.stats().host_frames);
+
+	// the device still works for the next frame
+	compute::compute(data, context);
+	ASSERT_TRUE(from_device(data));
+}
+
+TEST_F(GPUFaults, PermanentErrorFallsBackToHost)
+{
+	compute::gpu_context context{ 32, 16 };
+
+	inject("clEnqueueNDRangeKernel", CL_INVALID_KERNEL_ARGS);
+	compute::compute_io_data data{ test_spec() };
+	compute::compute(data, context);
+
+	ASSERT_TRUE(from_host(data));
+	ASSERT_EQ(1u, context.stats().permanent_errors);
+	ASSERT_EQ(0u, context.stats().rebuilds);
+	ASSERT_EQ(1u, context.stats().host_frames);
+}
+
+TEST_F(GPUFaults, InvalidHandlesAreNotRetried)
+{
+	compute::recovery_policy policy;
+	policy.host_fallback = false;
+	compute::gpu_context context{ 32, 16, policy };
+
+	// a released queue or a mismatched context is a bug, not a lost device
+	for (cl_int code : { CL_INVALID_COMMAND_QUEUE, CL_INVALID_CONTEXT }) {
+		inject("clEnqueueNDRangeKernel", code);
+		compute::compute_io_data data{ test_spec() };
+		try {
+			compute::compute(data, context);
+			FAIL() << compute::cl_error_name(code) << " was not thrown";
+		}
+		catch (const compute::gpu_error& error) {
+			ASSERT_EQ(code, error.code());
+			ASSERT_FALSE(error.transient());
+		}
+	}
+
+	ASSERT_EQ(2u, context.stats().permanent_errors);
+	ASSERT_EQ(0u, context.stats().transient_errors);
+	ASSERT_EQ(0u, context.stats().rebuilds);
+}
+
+TEST_F(GPUFaults, LostDeviceStaysOnHost)
+{
+	compute::gpu_context context{ 32, 16 };
+
+	// the device resets and no new context can be made
+	inject("clFinish", CL_OUT_OF_RESOURCES);
+	inject("clCreateContext", CL_DEVICE_NOT_AVAILABLE, 100);
+
+	compute::compute_io_data data{ test_spec() };
+	compute::compute(data, context);
+	ASSERT_TRUE(from_host(data));
+	ASSERT_FALSE(context.available());
+
+	const unsigned finishes = fake.calls["clFinish"];
+	compute::compute(data, context);
+	ASSERT_TRUE(from_host(data));
+	ASSERT_EQ(finishes, fake.calls["clFinish"]);
+	ASSERT_EQ(2u, context.stats().host_frames);
+	ASSERT_EQ(0, fake.live_objects);
+}
+
+TEST_F(GPUFaults, WithoutFallbackErrorsAreThrown)
+{
+	compute::recovery_policy policy;
+	policy.host_fallback = false;
+	compute::gpu_context context{ 32, 16, policy };
+
+	inject("clEnqueueNDRangeKernel", CL_INVALID_KERNEL_ARGS);
+	compute::compute_io_data data{ test_spec() };
+	ASSERT_THROW(compute::compute(data, context), compute::gpu_error);
+
+	// transient errors are still retried first
+	inject("clFinish", CL_OUT_OF_RESOURCES);
+	compute::compute(data, context);
+	ASSERT_TRUE(from_device(data));
+}
+
+TEST_F(GPUFaults, BatchFallsBackPerFrame)
+{
+	compute::gpu_context context{ 32, 16 };
+
+	std::vector<compute::compute_io_data> frames;
+	for (size_t i = 0; i < 8; i++) {
+		mandelbrot::input_spec spec = test_spec();
+		spec.center = { -0.5 + 0.1 * i, 0.0 };
+		frames.emplace_back(spec);
+	}
+
+	// the atlas of 8, then of 4, 2 and the first frame alone fail
+	inject("clEnqueueNDRangeKernel", CL_INVALID_WORK_GROUP_SIZE, 4);
+	compute::compute_batch(frames, context);
+
+	ASSERT_TRUE(from_host(frames[0]));
+	for (size_t i = 1; i < frames.size(); i++) {
+		ASSERT_TRUE(from_device(frames[i])) << "frame " << i;
+	}
+	ASSERT_EQ(1u, context.stats().host_frames);
+	ASSERT_EQ(4u, context.stats().permanent_errors);
+}
@@ -0,0 +1,162 @@
+#include "host_compute.h"
+
+#include <chrono>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+// Throughput of the specialised host kernels against the runtime
+// branching reference, for each formula, precision and colouring, then
+// lane utilisation and throughput of fixed against compacted lanes, then
+// 128x128 thumbnails rendered one at a time against a batch.
+//
+//   MandelbrotBench [size] [iterations] [repeats]
+
+namespace {
+	struct result {
+		double mpixels_per_second{ 0.0 };
+		double utilization{ 0.0 };
+	};
+
+	result measure(void (*compute)(compute::compute_io_data&), const mandelbrot::input_spec& spec, size_t repeats)
+	{
+		compute::compute_io_data data{ spec };
+		compute(data); // warm up the pool and caches
+
+		uint64_t total_us = 0;
+		for (size_t i = 0; i < repeats; i++) {
+			compute(data);
+			total_us += data.timing.kernel_us;
+		}
+
+		const double pixels = double(spec.output_width) * double(spec.output_height) * double(repeats);
+		return { total_us == 0 ? 0.0 : pixels / double(total_us), data.lanes.utilization() };
+	}
+
+	const char* name(mandelbrot::formula formula, unsigned power)
+	{
+		switch (formula) {
+		case mandelbrot::formula::julia: return "julia";
+		case mandelbrot::formula::multibrot: return power == 3 ? "multibrot3" : power == 4 ? "multibrot4" : "multibrot5";
+		default: return "mandelbrot";
+		}
+	}
+}
+
+int main(int argc, char* argv[])
+{
+	const size_t size = argc > 1 ? std::stoul(argv[1]) : 512;
+	const size_t iterations = argc > 2 ? std::stoul(argv[2]) : 500;
+	const size_t repeats = argc > 3 ? std::stoul(argv[3]) : 3;
+
+	struct configuration {
+		mandelbrot::formula formula;
+		unsigned power;
+	};
+	const configuration formulas[] = {
+		{ mandelbrot::formula::mandelbrot, 2 },
+		{ mandelbrot::formula::julia, 2 },
+		{ mandelbrot::formula::multibrot, 3 },
+		{ mandelbrot::formula::multibrot, 5 },
+	};
+	const mandelbrot::precision precisions[] = { mandelbrot::precision::single, mandelbrot::precision::double_ };
+	const mandelbrot::coloring_mode colorings[] = { mandelbrot::coloring_mode::cyclic, mandelbrot::coloring_mode::distance };
+
+	std::printf("%-12s %-7s %-9s %12s %12s %8s\n", "formula", "prec", "coloring", "generic", "specialised", "speedup");
+
+	for (const configuration& formula : formulas) {
+		for (auto precision : precisions) {
+			for (auto coloring : colorings) {
+				mandelbrot::input_spec spec;
+				spec.center = formula.formula == mandelbrot::formula::mandelbrot ? std::complex<double>{ -0.5, 0.0 } : std::complex<double>{ 0.0, 0.0 };
+				spec.output_width = size;
+				spec.output_height = size;
+				spec.zoom_level = 0.0f;
+				spec.max_iterations = iterations;
+				spec.formula = formula.formula;
+				spec.power = formula.power;
+				spec.precision = precision;
+				spec.coloring = coloring;
+
+				const double generic = measure(compute::host_compute_generic, spec, repeats).mpixels_per_second;
+				const double specialised = measure(compute::host_compute, spec, repeats).mpixels_per_second;
+
+				std::printf("%-12s %-7s %-9s %9.2f Mp/s %9.2f Mp/s %7.2fx\n",
+					name(formula.formula, formula.power),
+					precision == mandelbrot::precision::single ? "single" : "double",
+					coloring == mandelbrot::coloring_mode::cyclic ? "cyclic" : "distance",
+					generic, specialised, generic > 0.0 ? specialised / generic : 0.0);
+			}
+		}
+	}
+
+	// views from the interior to mostly boundary, where lanes finish at very different times
+	struct view {
+		const char* name;
+		std::complex<double> center;
+		float zoom;
+	};
+	const view views[] = {
+		{ "overview", { -0.5, 0.0 }, 0.0f },
+		{ "seahorse", { -0.743643887037158, 0.131825904205311 }, 2.0f },
+		{ "spiral", { -0.743643887037158, 0.131825904205311 }, 4.0f },
+	};
+
+	std::printf("\n%-12s %12s %8s %12s %8s %8s\n", "view", "fixed", "lanes", "compacted", "lanes", "speedup");
+
+	for (const view& v : views) {
+		mandelbrot::input_spec spec;
+		spec.center = v.center;
+		spec.output_width = size;
+		spec.output_height = size;
+		spec.zoom_level = v.zoom;
+		spec.max_iterations = iterations;
+
+		spec.schedule = mandelbrot::schedule::fixed;
+		const result fixed = measure(compute::host_compute, spec, repeats);
+		spec.schedule = mandelbrot::schedule::compacted;
+		const result compacted = measure(compute::host_compute, spec, repeats);
+
+		std::printf("%-12s %7.2f Mp/s %7.1f%% %7.2f Mp/s %7.1f%% %7.2fx\n", v.name,
+			fixed.mpixels_per_second, fixed.utilization * 100.0,
+			compacted.mpixels_per_second, compacted.utilization * 100.0,
+			fixed.mpixels_per_second > 0.0 ? compacted.mpixels_per_second / fixed.mpixels_per_second : 0.0);
+	}
+
+	// thumbnails along the seahorse valley
+	std::vector<compute::compute_io_data> thumbnails;
+	for (size_t i = 0; i < 256; i++) {
+		mandelbrot::input_spec spec;
+		spec.center = { -0.75 + 0.0005 * i, 0.1 };
+		spec.output_width = 128;
+		spec.output_height = 128;
+		spec.zoom_level = 0.01f * i;
+		spec.max_iterations = iterations;
+		thumbnails.emplace_back(spec);
+	}
+
+	uint64_t one_at_a_time_us = 0, batched_us = 0;
+	for (size_t i = 0; i <= repeats; i++) {
+		const auto start = std::chrono::high_resolution_clock::now();
+		for (compute::compute_io_data& thumbnail : thumbnails) {
+			compute::host_compute(thumbnail);
+		}
+		const auto finish = std::chrono::high_resolution_clock::now();
+		const compute::timing batch = compute::host_compute_batch(thumbnails);
+
+		// first round warms up
+		if (i > 0) {
+			one_at_a_time_us += std::chrono::duration_cast<std::chrono::microseconds>(finish - start).count();
+			batched_us += batch.kernel_us;
+		}
+	}
+
+	const double thumbnail_pixels = 128.0 * 128.0 * thumbnails.size() * repeats;
+	std::printf("\n%-12s %12s %12s %8s\n", "thumbnails", "single", "batch", "speedup");
+	std::printf("%-12zu %7.2f Mp/s %7.2f Mp/s %7.2fx\n", thumbnails.size(),
+		one_at_a_time_us == 0 ? 0.0 : thumbnail_pixels / one_at_a_time_us,
+		batched_us == 0 ? 0.0 : thumbnail_pixels / batched_us,
+		batched_us == 0 ? 0.0 : double(one_at_a_time_us) / double(batched_us));
+
+	return 0;
+}
@@ -0,0 +1,511 @@
+
+#include "host_compute.h"
+#include "coloring.h"
+#include "parallel.h"
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <stdexcept>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+namespace {
+	using mandelbrot::coloring_mode;
+
+	// pixels of a row iterated in lock step, a loop this long is vectorised
+	// rather than unrolled
+	constexpr const size_t lanes = 32;
+
+	// iterations between checks whether any lane of a fixed group is still running
+	constexpr const size_t unroll = 4;
+
+	// iterations between compactions of the running lanes
+	constexpr const size_t chunk = 16;
+
+	// rows a compacting worker takes at a time, lanes are only drained at the end
+	constexpr const size_t compacted_rows = 8;
+
+	// escape radius 4, compared squared
+	constexpr const double bailout = 16.0;
+
+	// pixel coordinates, single precision uses the same values as the device
+	template<typename T>
+	T real_at(const compute::compute_io_data& data, double step, size_t x)
+	{
+		if constexpr (std::is_same<T, float>::value) {
+			return data.input.reals[x];
+		}
+		else {
+			return util::coordinate(data.spec.center.real(), data.output.width, step, x);
+		}
+	}
+
+	template<typename T>
+	T imag_at(const compute::compute_io_data& data, double step, size_t y)
+	{
+		if constexpr (std::is_same<T, float>::value) {
+			return data.input.imags[y];
+		}
+		else {
+			return util::coordinate(data.spec.center.imag(), data.output.height, step, y);
+		}
+	}
+
+	template<typename T>
+	float smooth_escape(T iteration, T length, size_t max_iterations, T log_power)
+	{
+		return static_cast<float>(iteration + (std::log(std::log(T(max_iterations))) - std::log(std::log(length))) / log_power);
+	}
+
+	template<typename T>
+	float distance_estimate(T length, T dzr, T dzi)
+	{
+		return static_cast<float>(T(0.5) * length * std::log(length) / std::sqrt(dzr * dzr + dzi * dzi));
+	}
+
+	// z^Power with the power known at compile time, unrolled
+	template<int Power, typename T>
+	void power(T zr, T zi, T& pr, T& pi)
+	{
+		if constexpr (Power == 1) {
+			pr = zr;
+			pi = zi;
+		}
+		else {
+			T qr, qi;
+			power<Power - 1>(zr, zi, qr, qi);
+			pr = qr * zr - qi * zi;
+			pi = qr * zi + qi * zr;
+		}
+	}
+
+	// state of up to lanes pixels iterated together, lanes that finish are
+	// frozen by arithmetic masks rather than branches so the lane loop vectorises
+	template<int Power, bool Julia, bool Derivative, typename T>
+	struct orbit {
+		T zr[lanes], zi[lanes];
+		T cr[lanes], ci[lanes];
+		T dzr[lanes], dzi[lanes];
+		// iterations done, the escaping one is not counted so it is the escape count
+		T iteration[lanes];
+		// 1 while the lane iterates, 0 once it escaped or ran out of iterations
+		T running[lanes];
+		T escaped[lanes];
+
+		void start(size_t l, T re, T im, T julia_r, T julia_i)
+		{
+			zr[l] = Julia ? re : T(0);
+			zi[l] = Julia ? im : T(0);
+			cr[l] = Julia ? julia_r : re;
+			ci[l] = Julia ? julia_i : im;
+			dzr[l] = Julia ? T(1) : T(0);
+			dzi[l] = T(0);
+			iteration[l] = T(0);
+			running[l] = T(1);
+			escaped[l] = T(0);
+		}
+
+		void move(size_t from, size_t to)
+		{
+			zr[to] = zr[from];
+			zi[to] = zi[from];
+			cr[to] = cr[from];
+			ci[to] = ci[from];
+			dzr[to] = dzr[from];
+			dzi[to] = dzi[from];
+			iteration[to] = iteration[from];
+			running[to] = running[from];
+			escaped[to] = escaped[from];
+		}
+
+		// one iteration of lanes [0, count)
+		void step(size_t count, T max_iterations)
+		{
+			for (size_t l = 0; l < count; l++) {
+				// z^(Power - 1), shared by the orbit and its derivative
+				T pr, pi;
+				power<Power - 1>(zr[l], zi[l], pr, pi);
+
+				const T next_zr = pr * zr[l] - pi * zi[l] + cr[l];
+				const T next_zi = pr * zi[l] + pi * zr[l] + ci[l];
+
+				const T live = running[l];
+				const T frozen = T(1) - live;
+
+				if constexpr (Derivative) {
+					const T next_dzr = Power * (pr * dzr[l] - pi * dzi[l]) + (Julia ? T(0) : T(1));
+					const T next_dzi = Power * (pr * dzi[l] + pi * dzr[l]);
+					dzr[l] = next_dzr * live + dzr[l] * frozen;
+					dzi[l] = next_dzi * live + dzi[l] * frozen;
+				}
+
+				zr[l] = next_zr * live + zr[l] * frozen;
+				zi[l] = next_zi * live + zi[l] * frozen;
+
+				const T escapes = T(next_zr * next_zr + next_zi * next_zi > T(bailout)) * live;
+				const T next_iteration = iteration[l] + live - escapes;
+				escaped[l] += escapes;
+				iteration[l] = next_iteration;
+				running[l] = (live - escapes) * T(next_iteration < max_iterations);
+			}
+		}
+
+		bool any_running(size_t count) const
+		{
+			T sum = 0;
+			for (size_t l = 0; l < count; l++) {
+				sum += running[l];
+			}
+			return sum != T(0);
+		}
+
+		// iterations the lane did useful work for
+		uint64_t active(size_t l) const
+		{
+			return static_cast<uint64_t>(iteration[l] + escaped[l]);
+		}
+
+		void store(size_t l, mandelbrot::host_output& output, size_t index, size_t max_iterations, T log_power) const
+		{
+			if (escaped[l] == T(0)) {
+				output.escape[index] = -1.0f;
+				output.distance[index] = 0.0f;
+				return;
+			}
+
+			const T length = std::sqrt(zr[l] * zr[l] + zi[l] * zi[l]);
+			output.escape[index] = smooth_escape(iteration[l], length, max_iterations, log_power);
+			output.distance[index] = Derivative ? distance_estimate(length, dzr[l], dzi[l]) : 0.0f;
+		}
+	};
+
+	// lane usage summed over workers, each chunk of rows adds its own once
+	struct lane_totals {
+		std::atomic<uint64_t> active{ 0 };
+		std::atomic<uint64_t> issued{ 0 };
+
+		void add(const compute::lane_usage& usage)
+		{
+			active.fetch_add(usage.active, std::memory_order_relaxed);
+			issued.fetch_add(usage.issued, std::memory_order_relaxed);
+		}
+	};
+
+	// what every scheduler needs to start and finish pixels
+	template<typename T>
+	struct frame {
+		compute::compute_io_data& data;
+		double step;
+		T julia_r, julia_i;
+		T log_power;
+		T max_iterations;
+
+		frame(compute::compute_io_data& _data, int power)
+			: data{ _data }
+			, step{ util::step_size(_data.spec.zoom_level) }
+			, julia_r{ static_cast<T>(_data.spec.julia_constant.real()) }
+			, julia_i{ static_cast<T>(_data.spec.julia_constant.imag()) }
+			, log_power{ std::log(T(power)) }
+			, max_iterations{ static_cast<T>(_data.spec.max_iterations) }
+		{}
+
+		T real(size_t x) const { return real_at<T>(data, step, x); }
+		T imag(size_t y) const { return imag_at<T>(data, step, y); }
+	};
+
+	// each row is cut into fixed groups of lanes that iterate until their
+	// slowest pixel is done, lanes that finish early idle
+	template<int Power, bool Julia, bool Derivative, typename T>
+	void iterate_fixed(const frame<T>& f, lane_totals& totals)
+	{
+		auto& output = f.data.output;
+
+		util::parallel_for(output.height, 1u, [&](size_t begin, size_t end, size_t) {
+			orbit<Power, Julia, Derivative, T> group;
+			compute::lane_usage usage;
+
+			for (size_t y = begin; y < end; y++) {
+				const T im = f.imag(y);
+
+				for (size_t x0 = 0; x0 < output.width; x0 += lanes) {
+					// lanes past the edge repeat the last pixel and are dropped
+					for (size_t l = 0; l < lanes; l++) {
+						group.start(l, f.real(std::min(x0 + l, output.width - 1)), im, f.julia_r, f.julia_i);
+					}
+
+					size_t steps = 0;
+					while (group.any_running(lanes)) {
+						for (size_t u = 0; u < unroll; u++) {
+							group.step(lanes, f.max_iterations);
+						}
+						steps += unroll;
+					}
+					usage.issued += lanes * steps;
+
+					for (size_t l = 0; l < lanes && x0 + l < output.width; l++) {
+						group.store(l, output, y * output.width + x0 + l, f.data.spec.max_iterations, f.log_power);
+						usage.active += group.active(l);
+					}
+				}
+			}
+
+			totals.add(usage);
+		});
+	}
+
+	// lanes iterate chunk iterations at a time, in between finished pixels are
+	// retired, the running ones compacted to the front and the freed lanes
+	// refilled from the pixels still to do so the vectors stay dense
+	template<int Power, bool Julia, bool Derivative, typename T>
+	void iterate_compacted(const frame<T>& f, lane_totals& totals)
+	{
+		auto& output = f.data.output;
+
+		util::parallel_for(output.height, compacted_rows, [&](size_t begin, size_t end, size_t) {
+			orbit<Power, Julia, Derivative, T> group;
+			compute::lane_usage usage;
+			size_t pixel[lanes];
+			size_t count = 0;
+
+			size_t next = begin * output.width;
+			const size_t last = end * output.width;
+
+			for (;;) {
+				for (; count < lanes && next < last; count++, next++) {
+					pixel[count] = next;
+					group.start(count, f.real(next % output.width), f.imag(next / output.width), f.julia_r, f.julia_i);
+				}
+
+				if (count == 0) {
+					break;
+				}
+
+				for (size_t u = 0; u < chunk; u++) {
+					group.step(count, f.max_iterations);
+				}
+				usage.issued += count * chunk;
+
+				size_t kept = 0;
+				for (size_t l = 0; l < count; l++) {
+					if (group.running[l] != T(0)) {
+						if (kept != l) {
+							group.move(l, kept);
+							pixel[kept] = pixel[l];
+						}
+						kept++;
+						continue;
+					}
+
+					group.store(l, output, pixel[l], f.data.spec.max_iterations, f.log_power);
+					usage.active += group.active(l);
+				}
+				count = kept;
+			}
+
+			totals.add(usage);
+		});
+	}
+
+	template<int Power, bool Julia, typename T, coloring_mode Mode>
+	void render(compute::compute_io_data& data)
+	{
+		// only distance colouring needs the derivative orbit
+		constexpr bool derivative = Mode == coloring_mode::distance;
+
+		const frame<T> f{ data, Power };
+
+		lane_totals totals;
+		if (data.spec.schedule == mandelbrot::schedule::fixed) {
+			iterate_fixed<Power, Julia, derivative>(f, totals);
+		}
+		else {
+			iterate_compacted<Power, Julia, derivative>(f, totals);
+		}
+
+		data.lanes.active = totals.active.load(std::memory_order_relaxed);
+		data.lanes.issued = totals.issued.load(std::memory_order_relaxed);
+
+		coloring::colorize<Mode>(data.spec, data.output);
+	}
+
+	// [precision][coloring]
+	using kernel_row = std::array<std::array<compute::host_kernel, 3>, 2>;
+
+	template<int Power, bool Julia>
+	constexpr kernel_row kernels()
+	{
+		return { {
+			{ { &render<Power, Julia, float, coloring_mode::cyclic>,
+				&render<Power, Julia, float, coloring_mode::histogram>,
+				&render<Power, Julia, float, coloring_mode::distance> } },
+			{ { &render<Power, Julia, double, coloring_mode::cyclic>,
+				&render<Power, Julia, double, coloring_mode::histogram>,
+				&render<Power, Julia, double, coloring_mode::distance> } },
+		} };
+	}
+
+	// [formula][precision][coloring], formulas are mandelbrot, julia then multibrot 3 to 5
+	const std::array<kernel_row, 5> kernel_table = { {
+		kernels<2, false>(),
+		kernels<2, true>(),
+		kernels<3, false>(),
+		kernels<4, false>(),
+		kernels<5, false>(),
+	} };
+
+	unsigned formula_power(const mandelbrot::input_spec& spec)
+	{
+		if (spec.formula != mandelbrot::formula::multibrot) {
+			return 2;
+		}
+		if (spec.power < compute::min_multibrot_power || spec.power > compute::max_multibrot_power) {
+			throw std::runtime_error("multibrot power " + std::to_string(spec.power) + " is not supported");
+		}
+		return spec.power;
+	}
+
+	// runtime branching reference, one pixel at a time
+	template<typename T>
+	void evaluate_generic(compute::compute_io_data& data)
+	{
+		const mandelbrot::input_spec& spec = data.spec;
+		auto& output = data.output;
+
+		const double step = util::step_size(spec.zoom_level);
+		const unsigned power = formula_power(spec);
+		const T log_power = std::log(T(power));
+
+		util::parallel_for(output.height, 1u, [&](size_t begin, size_t end, size_t) {
+			for (size_t y = begin; y < end; y++) {
+				for (size_t x = 0; x < output.width; x++) {
+					const size_t index = y * output.width + x;
+					const T re = real_at<T>(data, step, x);
+					const T im = imag_at<T>(data, step, y);
+
+					T zr = 0, zi = 0, cr = re, ci = im, dzr = 0, dzi = 0;
+					if (spec.formula == mandelbrot::formula::julia) {
+						zr = re;
+						zi = im;
+						cr = static_cast<T>(spec.julia_constant.real());
+						ci = static_cast<T>(spec.julia_constant.imag());
+						dzr = 1;
+					}
+
+					output.escape[index] = -1.0f;
+					output.distance[index] = 0.0f;
+
+					for (size_t i = 0; i < spec.max_iterations; i++) {
+						T pr = zr, pi = zi;
+						if (spec.formula == mandelbrot::formula::multibrot) {
+							for (unsigned k = 2; k < power; k++) {
+								const T r = pr * zr - pi * zi;
+								pi = pr * zi + pi * zr;
+								pr = r;
+							}
+						}
+
+						if (spec.coloring == coloring_mode::distance) {
+							const T next_dzr = power * (pr * dzr - pi * dzi) + (spec.formula == mandelbrot::formula::julia ? T(0) : T(1));
+							dzi = power * (pr * dzi + pi * dzr);
+							dzr = next_dzr;
+						}
+
+						const T next_zr = pr * zr - pi * zi + cr;
+						zi = pr * zi + pi * zr + ci;
+						zr = next_zr;
+
+						if (zr * zr + zi * zi > T(bailout)) {
+							const T length = std::sqrt(zr * zr + zi * zi);
+							output.escape[index] = smooth_escape(T(i), length, spec.max_iterations, log_power);
+							if (spec.coloring == coloring_mode::distance) {
+								output.distance[index] = distance_estimate(length, dzr, dzi);
+							}
+							break;
+						}
+					}
+				}
+			}
+		});
+	}
+}
+
+compute::host_kernel compute::select_host_kernel(const mandelbrot::input_spec& spec)
+{
+	size_t formula = 0;
+	switch (spec.formula) {
+	case mandelbrot::formula::mandelbrot: formula = 0; break;
+	case mandelbrot::formula::julia: formula = 1; break;
+	case mandelbrot::formula::multibrot: formula = formula_power(spec) == 2 ? 0 : formula_power(spec) - 1; break;
+	default: throw std::runtime_error("unknown formula");
+	}
+
+	const size_t precision = static_cast<size_t>(spec.precision);
+	const size_t coloring = static_cast<size_t>(spec.coloring);
+	if (precision >= 2 || coloring >= 3) {
+		throw std::runtime_error("unknown precision or coloring");
+	}
+
+	return kernel_table[formula][precision][coloring];
+}
+
+void compute::host_compute(compute::compute_io_data& data)
+{
+	auto start = std::chrono::high_resolution_clock::now();
+
+	select_host_kernel(data.spec)(data);
+
+	auto finish = std::chrono::high_resolution_clock::now();
+
+	data.timing = {};
+	data.timing.kernel_us = std::chrono::duration_cast<std::chrono::microseconds>(finish - start).count();
+}
+
+void compute::host_compute_generic(compute::compute_io_data& data)
+{
+	auto start = std::chrono::high_resolution_clock::now();
+
+	switch (data.spec.precision) {
+	case mandelbrot::precision::double_:
+		evaluate_generic<double>(data);
+		break;
+	case mandelbrot::precision::single:
+	default:
+		evaluate_generic<float>(data);
+		break;
+	}
+
+	// scalar, no lanes to report
+	data.lanes = {};
+
+	// the parallel colouring of the specialised kernels, so comparing the two
+	// only measures the evaluation
+	coloring::colorize(data.spec, data.output);
+
+	auto finish = std::chrono::high_resolution_clock::now();
+
+	data.timing = {};
+	data.timing.kernel_us = std::chrono::duration_cast<std::chrono::microseconds>(finish - start).count();
+}
+
+compute::timing compute::host_compute_batch(std::vector<compute::compute_io_data>& frames)
+{
+	auto start = std::chrono::high_resolution_clock::now();
+
+	// frames are rendered inline on the worker that takes them, nested
+	// parallel_for calls do not fan out again
+	util::parallel_for(frames.size(), 1u, [&](size_t begin, size_t end, size_t) {
+		for (size_t frame = begin; frame < end; frame++) {
+			host_compute(frames[frame]);
+		}
+	});
+
+	auto finish = std::chrono::high_resolution_clock::now();
+
+	compute::timing timing;
+	timing.kernel_us = std::chrono::duration_cast<std::chrono::microseconds>(finish - start).count();
+	return timing;
+}
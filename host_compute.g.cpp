@@ -0,0 +1,175 @@
+#include "host_compute.h"
+
+#include <gtest/gtest.h>
+
+namespace {
+	mandelbrot::input_spec test_spec()
+	{
+		mandelbrot::input_spec spec;
+		spec.center = { -0.5, 0.0 };
+		spec.output_width = 64;
+		spec.output_height = 64;
+		spec.zoom_level = -1.5f;
+		spec.max_iterations = 200;
+		return spec;
+	}
+}
+
+TEST(HostCompute, InteriorAndExterior)
+{
+	mandelbrot::input_spec spec = test_spec();
+	spec.coloring = mandelbrot::coloring_mode::distance;
+	compute::compute_io_data data{ spec };
+
+	compute::host_compute(data);
+
+	// centre of the main cardioid and a corner far outside
+	ASSERT_LT(data.output.escape[32 * 64 + 32], 0.0f);
+	ASSERT_EQ(0u, data.output.at(32, 32));
+	ASSERT_GE(data.output.escape[0], 0.0f);
+	ASSERT_GT(data.output.distance[0], 0.0f);
+	ASSERT_NE(0u, data.output.at(0, 0));
+}
+
+TEST(HostCompute, DoublePrecisionAgrees)
+{
+	compute::compute_io_data single{ test_spec() };
+	mandelbrot::input_spec spec = test_spec();
+	spec.precision = mandelbrot::precision::double_;
+	compute::compute_io_data twice{ spec };
+
+	compute::host_compute(single);
+	compute::host_compute(twice);
+
+	size_t differing = 0;
+	for (size_t i = 0; i < single.output.escape.size(); i++) {
+		if ((single.output.escape[i] < 0.0f) != (twice.output.escape[i] < 0.0f)) {
+			differing++;
+		}
+	}
+
+	// only pixels right on the boundary may classify differently
+	ASSERT_LT(differing, single.output.escape.size() / 100);
+}
+
+TEST(HostCompute, SpecialisedMatchesGeneric)
+{
+	const mandelbrot::formula formulas[] = { mandelbrot::formula::mandelbrot, mandelbrot::formula::julia, mandelbrot::formula::multibrot };
+	const mandelbrot::precision precisions[] = { mandelbrot::precision::single, mandelbrot::precision::double_ };
+	const mandelbrot::coloring_mode colorings[] = { mandelbrot::coloring_mode::cyclic, mandelbrot::coloring_mode::distance };
+
+	for (auto formula : formulas) {
+		for (auto precision : precisions) {
+			for (auto coloring : colorings) {
+				mandelbrot::input_spec spec = test_spec();
+				spec.output_width = 61; // not a multiple of the lane count
+				spec.formula = formula;
+				spec.power = 4;
+				spec.precision = precision;
+				spec.coloring = coloring;
+
+				compute::compute_io_data specialised{ spec };
+				compute::compute_io_data generic{ spec };
+				compute::host_compute(specialised);
+				compute::host_compute_generic(generic);
+
+				size_t differing = 0;
+				for (size_t i = 0; i < generic.output.escape.size(); i++) {
+					if (std::abs(specialised.output.escape[i] - generic.output.escape[i]) > 1e-3f) {
+						differing++;
+					}
+				}
+				ASSERT_LE(differing, generic.output.escape.size() / 1000);
+			}
+		}
+	}
+}
+
+TEST(HostCompute, Formulas)
+{
+	mandelbrot::input_spec spec = test_spec();
+	spec.center = { 0.0, 0.0 };
+	spec.formula = mandelbrot::formula::julia;
+	spec.julia_constant = { 0.0, 0.0 };
+
+	// with a zero constant the julia set is the unit disc
+	compute::compute_io_data julia{ spec };
+	compute::host_compute(julia);
+	ASSERT_LT(julia.output.escape[32 * 64 + 32], 0.0f);
+	ASSERT_GE(julia.output.escape[0], 0.0f);
+
+	spec.formula = mandelbrot::formula::multibrot;
+	spec.power = 3;
+	compute::compute_io_data multibrot{ spec };
+	compute::host_compute(multibrot);
+	ASSERT_LT(multibrot.output.escape[32 * 64 + 32], 0.0f);
+
+	// the cubic set is symmetric about the imaginary axis, the square set is not
+	ASSERT_FLOAT_EQ(multibrot.output.escape[10 * 64 + 1], multibrot.output.escape[10 * 64 + 63]);
+}
+
+TEST(HostCompute, UnsupportedPower)
+{
+	mandelbrot::input_spec spec = test_spec();
+	spec.formula = mandelbrot::formula::multibrot;
+	spec.power = 7;
+
+	ASSERT_THROW(compute::select_host_kernel(spec), std::runtime_error);
+
+	spec.power = 2;
+	spec.formula = mandelbrot::formula::multibrot;
+	mandelbrot::input_spec square = test_spec();
+	ASSERT_EQ(compute::select_host_kernel(square), compute::select_host_kernel(spec));
+}
+
+TEST(HostCompute, CompactedMatchesFixed)
+{
+	mandelbrot::input_spec spec = test_spec();
+	spec.center = { -0.743643887037158, 0.131825904205311 };
+	spec.zoom_level = 2.0f;
+	spec.output_width = 67;
+	spec.coloring = mandelbrot::coloring_mode::distance;
+
+	spec.schedule = mandelbrot::schedule::fixed;
+	compute::compute_io_data fixed{ spec };
+	compute::host_compute(fixed);
+
+	spec.schedule = mandelbrot::schedule::compacted;
+	compute::compute_io_data compacted{ spec };
+	compute::host_compute(compacted);
+
+	// every pixel goes through the same arithmetic whichever lane it lands in
+	ASSERT_EQ(fixed.output.escape, compacted.output.escape);
+	ASSERT_EQ(fixed.output.distance, compacted.output.distance);
+
+	// both count the same useful iterations, near the boundary compaction idles less
+	ASSERT_EQ(fixed.lanes.active, compacted.lanes.active);
+	ASSERT_GT(compacted.lanes.utilization(), fixed.lanes.utilization());
+	ASSERT_LE(compacted.lanes.utilization(), 1.0);
+}
+
+TEST(HostCompute, BatchMatchesSingleFrames)
+{
+	std::vector<compute::compute_io_data> batch;
+	std::vector<compute::compute_io_data> single;
+
+	for (size_t i = 0; i < 12; i++) {
+		mandelbrot::input_spec spec = test_spec();
+		spec.output_width = 16 + 8 * (i % 4);
+		spec.output_height = 24 + 4 * (i % 3);
+		spec.center = { -0.75 + 0.05 * i, 0.1 };
+		spec.zoom_level = 0.2f * i - 1.0f;
+		spec.coloring = static_cast<mandelbrot::coloring_mode>(i % 3);
+
+		batch.emplace_back(spec);
+		single.emplace_back(spec);
+		compute::host_compute(single.back());
+	}
+
+	compute::host_compute_batch(batch);
+
+	for (size_t i = 0; i < batch.size(); i++) {
+		ASSERT_EQ(single[i].output.escape, batch[i].output.escape);
+		ASSERT_EQ(single[i].output.out, batch[i].output.out);
+	}
+}
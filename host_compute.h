@@ -0,0 +1,34 @@
+#pragma once
+
+#include "gpu_compute.h"
+
+namespace compute {
+	// evaluates and colours a frame on the host worker pool, same fields and
+	// colours as the device, also supports double precision and the julia
+	// and multibrot formulas, the distance field is only filled for distance
+	// colouring. spec.schedule picks fixed lane groups or compacted lanes and
+	// data.lanes reports how busy they were
+	void host_compute(compute_io_data&);
+
+	// kernel with formula, precision and colouring fixed at compile time so
+	// the iteration loop is branch free and vectorises, host_compute picks
+	// one per frame from the spec
+	using host_kernel = void(*)(compute_io_data&);
+
+	// throws for multibrot powers without a specialisation
+	host_kernel select_host_kernel(const mandelbrot::input_spec& spec);
+
+	// multibrot powers with a specialisation
+	constexpr const unsigned min_multibrot_power = 2;
+	constexpr const unsigned max_multibrot_power = 5;
+
+	// same results choosing the formula per iteration at runtime and colouring
+	// as host_compute does, the reference the specialised kernels are tested
+	// and benchmarked against
+	void host_compute_generic(compute_io_data&);
+
+	// host_compute of many small frames, spread over the worker pool a frame
+	// at a time rather than each frame over all workers, returns the timing
+	// of the whole batch
+	compute::timing host_compute_batch(std::vector<compute_io_data>& frames);
+}
@@ -1,53 +1,291 @@
-﻿#include <iostream>
-#include <fstream>
-
-#include "mandelbrot.h"
-#include "gpu_compute.h"
-#include "raster.h"
-
-void pause();
-
-int main(int argc, char* argv[])
-{
-	try {
-
-		const size_t output_width = 1000;
-		const size_t output_height = 1000;
-
-		compute::gpu_context context{ output_width, output_height };
-
-		for (size_t i = 0; i < 100; i++) {
-			mandelbrot::input_spec spec;
-
-			spec.center = { -0.743643887037158704752191506114774f, 0.131825904205311970493132056385139f };
-			spec.output_width = output_width;
-			spec.output_height = output_height;
-			spec.zoom_level = (i/100.0) * 5.0 + 1.0;
-
-			compute::compute_io_data data{ spec };
-
-			compute::compute(data, context);
-
-			raster::write_output("out" + std::to_string(i), data.output);
-		}
-
-		pause();
-	}
-	catch (const std::exception& exception) {
-		std::cerr << "Error occured when running " << argv[0] << '\n';
-
-		std::cerr << exception.what() << '\n';
-
-		pause();
-
-		return 1;
-	}
-
-	return 0;
-}
-
-void pause()
-{
-	std::string done;
-	std::getline(std::cin, done);
-}
\ No newline at end of file
+﻿#include <iostream>
+#include <fstream>
+#include <iomanip>
+#include <chrono>
+#include <memory>
+
+#ifdef _WIN32
+#include <fcntl.h>
+#include <io.h>
+#else
+#include <csignal>
+#endif
+
+#include "mandelbrot.h"
+#include "gpu_compute.h"
+#include "host_compute.h"
+#include "sequence.h"
+#include "cli.h"
+#include "archive.h"
+#include "buddhabrot.h"
+#include "raster.h"
+#include "pool.h"
+#include "tile_server.h"
+
+#include <filesystem>
+
+namespace {
+	// stream the frames go to, a file, stdout or an encoder process
+	std::unique_ptr<std::ostream> open_stream(const cli::options& options)
+	{
+		if (!options.pipe.empty()) {
+#ifndef _WIN32
+			// an encoder that exits early fails the writes and is reported
+			// by its exit status instead of killing the render
+			std::signal(SIGPIPE, SIG_IGN);
+#endif
+			return std::make_unique<raster::process_stream>(options.pipe);
+		}
+
+		if (options.output == "-") {
+#ifdef _WIN32
+			_setmode(_fileno(stdout), _O_BINARY);
+#endif
+			return std::make_unique<std::ostream>(std::cout.rdbuf());
+		}
+
+		auto file = std::make_unique<std::ofstream>(options.output, std::ios_base::out | std::ios_base::binary);
+		if (!*file) {
+			throw std::runtime_error("unable to open " + options.output);
+		}
+		return file;
+	}
+
+	std::unique_ptr<raster::sequence_sink> open_sink(const cli::options& options, std::ostream* stream)
+	{
+		const scene::animation& animation = options.animation;
+
+		switch (options.format) {
+		case cli::format::rle:
+			return std::make_unique<raster::rle_sequence>(*stream, animation.width, animation.height, animation.fps);
+		case cli::format::tiff:
+			return std::make_unique<raster::tiff_sequence>(options.output, options.first_frame);
+		case cli::format::y4m:
+		default:
+			return std::make_unique<raster::y4m_sequence>(*stream, animation.width, animation.height, animation.fps);
+		}
+	}
+
+	// tiles of 256 and levels down to a single tile
+	archive::layout archive_layout(const scene::animation& animation)
+	{
+		archive::layout layout;
+		layout.width = animation.width;
+		layout.height = animation.height;
+		while (layout.levels < 32 && (layout.tiles_x(layout.levels - 1) > 1 || layout.tiles_y(layout.levels - 1) > 1)) {
+			layout.levels++;
+		}
+		return layout;
+	}
+
+	double millis(std::chrono::high_resolution_clock::duration duration)
+	{
+		return std::chrono::duration<double, std::milli>(duration).count();
+	}
+
+	// orbits sampled between progress reports
+	constexpr const uint64_t density_batch = 1000000;
+
+	// seconds between checkpoints
+	constexpr const double checkpoint_interval = 60.0;
+
+	// samples orbits for the view of the first selected frame and writes the density image
+	void render_density(const cli::options& options)
+	{
+		buddhabrot::settings settings;
+		settings.view = options.animation.frame(options.first_frame);
+		settings.channels = options.mode == cli::mode::nebulabrot
+			? buddhabrot::nebulabrot_channels(settings.view.max_iterations)
+			: buddhabrot::buddhabrot_channels(settings.view.max_iterations);
+		settings.seed = options.seed;
+
+		std::unique_ptr<buddhabrot::accumulator> density;
+		if (!options.checkpoint.empty() && std::filesystem::exists(options.checkpoint)) {
+			density = std::make_unique<buddhabrot::accumulator>(buddhabrot::accumulator::load(options.checkpoint));
+			if (!buddhabrot::compatible(density->settings(), settings)) {
+				throw std::runtime_error("checkpoint " + options.checkpoint + " was started with other settings");
+			}
+			std::clog << "resuming " << options.checkpoint << " at " << density->orbits() << " orbits\n";
+		}
+		else {
+			density = std::make_unique<buddhabrot::accumulator>(settings);
+		}
+
+		std::clog << std::fixed;
+
+		const auto start = std::chrono::high_resolution_clock::now();
+		auto saved = start;
+		const uint64_t resumed = density->orbits();
+
+		while (density->orbits() < options.samples) {
+			density->run(std::min(density_batch, options.samples - density->orbits()));
+
+			const auto now = std::chrono::high_resolution_clock::now();
+			const double seconds = millis(now - start) / 1000.0;
+			std::clog << "orbits " << density->orbits() << '/' << options.samples
+				<< std::setprecision(2) << ", " << (density->orbits() - resumed) / seconds / 1e6 << " Morbits/s\n";
+
+			if (!options.checkpoint.empty() && millis(now - saved) / 1000.0 >= checkpoint_interval) {
+				density->flush();
+				density->save(options.checkpoint);
+				saved = now;
+			}
+		}
+
+		density->flush();
+		if (!options.checkpoint.empty()) {
+			density->save(options.checkpoint);
+		}
+
+		mandelbrot::host_output output{ settings.view.output_width, settings.view.output_height };
+		density->render(output);
+		raster::write_output(options.output, output);
+		util::trim_pool();
+	}
+
+	// serves tiles with the formula, colouring and precision of the first selected frame until killed
+	void serve_tiles(const cli::options& options)
+	{
+		tiles::tile_settings settings;
+		settings.view = options.animation.frame(options.first_frame);
+		if (settings.view.precision == mandelbrot::precision::double_) {
+			settings.max_level = 40;
+		}
+		settings.cache_bytes = options.tile_cache_mb << 20;
+
+		tiles::tile_service service{ settings, tiles::compute_renderer(settings, options.backend == cli::backend::gpu) };
+		tiles::tile_server server{ service, options.serve_address, options.serve_port };
+
+		std::clog << "serving tiles on http://" << options.serve_address << ':' << server.port() << "/{z}/{x}/{y}.png\n";
+		server.run();
+		util::trim_pool();
+	}
+}
+
+int main(int argc, char* argv[])
+{
+	try {
+		const cli::options options = cli::parse(argc, argv);
+
+		if (options.help) {
+			std::cout << cli::usage(argv[0]);
+			return 0;
+		}
+
+		if (options.serve) {
+			serve_tiles(options);
+			return 0;
+		}
+
+		if (options.mode != cli::mode::escape) {
+			render_density(options);
+			return 0;
+		}
+
+		const scene::animation& animation = options.animation;
+
+		std::unique_ptr<compute::gpu_context> context;
+		if (options.backend == cli::backend::gpu) {
+			try {
+				context = std::make_unique<compute::gpu_context>(animation.width, animation.height);
+			}
+			catch (const compute::gpu_error& error) {
+				std::clog << "gpu unavailable, rendering on the host: " << error.what() << '\n';
+			}
+		}
+
+		std::unique_ptr<std::ostream> stream;
+		if (options.format != cli::format::tiff) {
+			stream = open_stream(options);
+		}
+		std::unique_ptr<raster::sequence_sink> sequence = open_sink(options, stream.get());
+
+		const size_t pixels = animation.width * animation.height;
+		const size_t total_frames = animation.frame_count();
+		const auto render_start = std::chrono::high_resolution_clock::now();
+
+		std::clog << std::fixed;
+
+		compute::lane_usage lanes;
+
+		// reset for every frame, after the first no frame allocates its buffers
+		compute::compute_io_data data{ animation.frame(options.first_frame) };
+
+		for (size_t i = options.first_frame; i < options.last_frame; i++) {
+			mandelbrot::input_spec spec = animation.frame(i);
+			spec.schedule = options.schedule;
+
+			const auto start = std::chrono::high_resolution_clock::now();
+
+			data.reset(spec);
+
+			if (context) {
+				compute::compute(data, *context);
+			}
+			else {
+				compute::host_compute(data);
+			}
+
+			const auto computed = std::chrono::high_resolution_clock::now();
+
+			sequence->write_frame(data.output);
+
+			if (!options.archive.empty()) {
+				archive::writer writer{ options.archive + std::to_string(i) + ".mbf", archive_layout(animation), archive::from_spec(spec) };
+				writer.write_field(data.output.escape.data(), data.output.escape.size());
+				writer.close();
+			}
+
+			const auto finish = std::chrono::high_resolution_clock::now();
+
+			lanes.active += data.lanes.active;
+			lanes.issued += data.lanes.issued;
+
+			const double compute_ms = millis(computed - start);
+			std::clog << "frame " << i << '/' << total_frames
+				<< std::setprecision(3) << " zoom " << spec.zoom_level
+				<< " iterations " << spec.max_iterations
+				<< std::setprecision(2) << " compute " << compute_ms << " ms"
+				<< " (upload " << data.timing.upload_us / 1000.0
+				<< " kernel " << data.timing.kernel_us / 1000.0
+				<< " download " << data.timing.download_us / 1000.0 << ")"
+				<< std::setprecision(1) << " lanes " << data.lanes.utilization() * 100.0 << '%'
+				<< std::setprecision(2)
+				<< " output " << millis(finish - computed) << " ms "
+				<< pixels / (compute_ms * 1000.0) << " Mpixel/s\n";
+		}
+
+		sequence->close();
+
+		// a failed encoder leaves no usable output
+		if (auto* encoder = dynamic_cast<raster::process_stream*>(stream.get())) {
+			const int status = encoder->close();
+			if (status != 0) {
+				throw std::runtime_error("encoder '" + options.pipe + "' exited with status " + std::to_string(status));
+			}
+		}
+		util::trim_pool();
+
+		const double total_ms = millis(std::chrono::high_resolution_clock::now() - render_start);
+		const size_t rendered = options.last_frame - options.first_frame;
+		std::clog << "rendered " << rendered << " frames in " << std::setprecision(2) << total_ms / 1000.0 << " s, "
+			<< rendered * 1000.0 / total_ms << " frames/s, "
+			<< rendered * pixels / (total_ms * 1000.0) << " Mpixel/s, "
+			<< std::setprecision(1) << lanes.utilization() * 100.0 << "% lane utilisation\n";
+
+		if (context && context->stats().transient_errors + context->stats().permanent_errors > 0) {
+			const compute::recovery_stats& stats = context->stats();
+			std::clog << "gpu errors: " << stats.transient_errors << " transient, " << stats.permanent_errors << " permanent, "
+				<< stats.rebuilds << " context rebuilds, " << stats.host_frames << " frames rendered on the host\n";
+		}
+	}
+	catch (const std::exception& exception) {
+		std::cerr << "Error occured when running " << argv[0] << '\n';
+
+		std::cerr << exception.what() << '\n';
+
+		return 1;
+	}
+
+	return 0;
+}
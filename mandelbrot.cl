@@ -1,90 +1,450 @@
-
-float2 multiply(float2 a, float2 b) {
-    float2 mul = { a.s0*b.s0-a.s1*b.s1, a.s1*b.s0+a.s0*b.s1 };
-	return mul;
-}
-
-float norm(int i, float2 z, int max_iterations) {
-    return i + (log(log(convert_float(max_iterations))) - log(log(length(z))))/log(2.0);
-}
-
-float3 hsvtorgb(float3 hsv)
-{  
-	float3 i;
-	float4 K = { 1.0, 2.0 / 3.0, 1.0 / 3.0, 3.0 };
-	float3 six = { 6.0, 6.0, 6.0 };
-    float3 p = fabs(fract(hsv.xxx + K.xyz, &i) * six - K.www);
-    return hsv.z * mix(K.xxx, clamp(p - K.xxx, 0.0, 1.0), hsv.y);
-}
-
-float norm_mandelbrot(float2 c)
-{
-	const size_t max_iterations = 1000;
-
-#define MANDELBROT
-
-#ifdef JULIA
-	float2 z = c;	
-	float2 zero = { 0.4, 0.4 };
-	c = zero;
-#endif
-
-#ifdef MANDELBROT
-	float2 z = { 0.0, 0.0 };
-#endif
-
-	size_t i;
-
-	for(i = 0; i < max_iterations; i++)
-	{
-		z = multiply(z, z) + c;
-		if(fast_length(z) > 4.0) 
-			return norm(i, z, max_iterations);
-	}
-
-	return -1.0;
-}
-
-float3 valuetohsv(float value)
-{
-	// is point in mandelbrot set?
-	if (value < 0.0) {
-		const float3 black = { 0.0, 0.0, 0.0 };
-		return black;
-	}
-
-	const int inum_colors = 2000;
-	const float fnum_colors = convert_int(inum_colors);
-
-	float fwhole;
-	float frac = fract(value, &fwhole);
-
-	const int whole = convert_int(fwhole) % inum_colors;
-	const int next_whole = (whole + 1) % inum_colors;
-
-	float3 col1 = { whole / fnum_colors, 1.0, 1.0 };
-	float3 col2 = { next_whole / fnum_colors, 1.0, 1.0 };
-	
-	return mix(col1, col2, frac);
-}
-
-// Mandelbrot kernel
-__kernel void mandelbrot(__global float* reals,
-	                     __global float* imags,
-	                     __write_only image2d_t image)
-{
-	const float2 c = { reals[get_global_id(0)], imags[get_global_id(1)] };
-
-	const float norm_mb = norm_mandelbrot(c);
-
-	const float3 colorHSV = valuetohsv(norm_mb);
-	
-	const float3 colorRGB = hsvtorgb(colorHSV);
-
-	const uint3 colorUI = convert_uint3(colorRGB * 255.0f);
-	const uint4 colorWithAlpha = { colorUI, 0u };
-
-	const int2 coord = { get_global_id(0), get_global_id(1) };
-	
-	write_imageui(image, coord, colorWithAlpha);
-}
\ No newline at end of file
+
+// must match coloring::histogram_bins and mandelbrot::coloring_mode
+#define HISTOGRAM_BINS 1024
+#define HISTOGRAM_HUE_RANGE 0.8f
+
+#define COLORING_CYCLIC 0
+#define COLORING_HISTOGRAM 1
+#define COLORING_DISTANCE 2
+
+// must match the work group size in gpu_compute.cpp, both kernels use 64 work items
+#define GROUP_ITEMS 64
+
+// iterations between the points where a persistent work item may take a new pixel
+#define ITERATION_CHUNK 32
+
+// frame of an atlas, must match compute::tile_descriptor in gpu_compute.cpp
+typedef struct {
+	uint reals;          // first real and imaginary coordinate of the frame in axes
+	uint imags;
+	uint pixels;         // first pixel of the frame in the atlas fields
+	uint width;
+	uint height;
+	uint max_iterations;
+	uint coloring;
+	float pixel_size;
+} tile_descriptor;
+
+float2 multiply(float2 a, float2 b) {
+    float2 mul = { a.s0*b.s0-a.s1*b.s1, a.s1*b.s0+a.s0*b.s1 };
+	return mul;
+}
+
+float norm(int i, float2 z, int max_iterations) {
+    return i + (log(log(convert_float(max_iterations))) - log(log(length(z))))/log(2.0);
+}
+
+float3 hsvtorgb(float3 hsv)
+{
+	float3 i;
+	float4 K = { 1.0, 2.0 / 3.0, 1.0 / 3.0, 3.0 };
+	float3 six = { 6.0, 6.0, 6.0 };
+    float3 p = fabs(fract(hsv.xxx + K.xyz, &i) * six - K.www);
+    return hsv.z * mix(K.xxx, clamp(p - K.xxx, 0.0, 1.0), hsv.y);
+}
+
+// { smooth escape count, exterior distance estimate } of an escaped orbit
+float2 escaped_result(uint i, float2 z, float2 dz, uint max_iterations)
+{
+	const float length_z = length(z);
+	const float2 result = { norm(i, z, max_iterations), 0.5f * length_z * log(length_z) / length(dz) };
+	return result;
+}
+
+// returns { smooth escape count, exterior distance estimate }, escape count is negative inside the set,
+// iterations is set to the number of iterations done
+float2 norm_mandelbrot(float2 c, uint max_iterations, uint* iterations)
+{
+#define MANDELBROT
+
+#ifdef JULIA
+	float2 z = c;
+	float2 zero = { 0.4, 0.4 };
+	c = zero;
+	// derivative of the orbit with respect to the starting point
+	float2 dz = { 1.0, 0.0 };
+	const float2 dc = { 0.0, 0.0 };
+#endif
+
+#ifdef MANDELBROT
+	float2 z = { 0.0, 0.0 };
+	// derivative of the orbit with respect to c
+	float2 dz = { 0.0, 0.0 };
+	const float2 dc = { 1.0, 0.0 };
+#endif
+
+	uint i;
+
+	for(i = 0; i < max_iterations; i++)
+	{
+		dz = 2.0f * multiply(z, dz) + dc;
+		z = multiply(z, z) + c;
+		if(fast_length(z) > 4.0) {
+			*iterations = i + 1;
+			return escaped_result(i, z, dz, max_iterations);
+		}
+	}
+
+	*iterations = max_iterations;
+	const float2 inside = { -1.0, 0.0 };
+	return inside;
+}
+
+uint histogram_bin(float value, uint max_iterations)
+{
+	const float scaled = value * HISTOGRAM_BINS / convert_float(max_iterations);
+	return min(convert_uint(max(scaled, 0.0f)), (uint)(HISTOGRAM_BINS - 1));
+}
+
+float cyclic_hue(float value)
+{
+	const int inum_colors = 2000;
+	const float fnum_colors = convert_int(inum_colors);
+
+	float fwhole;
+	float frac = fract(value, &fwhole);
+
+	const int whole = convert_int(fwhole) % inum_colors;
+	const int next_whole = (whole + 1) % inum_colors;
+
+	return mix(whole / fnum_colors, next_whole / fnum_colors, frac);
+}
+
+float3 valuetohsv(float value, float distance, float pixel_size, uint max_iterations,
+	uint coloring, __global const float* cdf)
+{
+	// is point in mandelbrot set?
+	if (value < 0.0) {
+		const float3 black = { 0.0, 0.0, 0.0 };
+		return black;
+	}
+
+	if (coloring == COLORING_HISTOGRAM) {
+		const uint bin = histogram_bin(value, max_iterations);
+		const float frac = clamp(value * HISTOGRAM_BINS / convert_float(max_iterations) - bin, 0.0f, 1.0f);
+		const float low = bin > 0 ? cdf[bin - 1] : 0.0f;
+		const float3 col = { mix(low, cdf[bin], frac) * HISTOGRAM_HUE_RANGE, 1.0, 1.0 };
+		return col;
+	}
+
+	if (coloring == COLORING_DISTANCE) {
+		const float3 col = { cyclic_hue(value), 1.0, sqrt(clamp(distance / (2.0f * pixel_size), 0.0f, 1.0f)) };
+		return col;
+	}
+
+	const float3 col = { cyclic_hue(value), 1.0, 1.0 };
+	return col;
+}
+
+void clear_histogram(__local uint* local_histogram, size_t local_id, size_t local_size)
+{
+	for (size_t bin = local_id; bin < HISTOGRAM_BINS; bin += local_size) {
+		local_histogram[bin] = 0u;
+	}
+}
+
+void merge_histogram(__local const uint* local_histogram, __global uint* histogram, size_t local_id, size_t local_size)
+{
+	for (size_t bin = local_id; bin < HISTOGRAM_BINS; bin += local_size) {
+		if (local_histogram[bin] != 0u) {
+			atomic_add(&histogram[bin], local_histogram[bin]);
+		}
+	}
+}
+
+// Writes { active, issued } lane iterations of the work group, issued counts
+// every work item for as long as the busiest one ran. Needs a barrier after
+// local_active and local_steps were written.
+void store_lane_counts(__local const ulong* local_active, __local const uint* local_steps,
+	__global ulong* lane_counts, size_t group, size_t local_id, size_t local_size)
+{
+	if (local_id != 0) {
+		return;
+	}
+
+	ulong active = 0;
+	uint steps = 0;
+	for (size_t item = 0; item < local_size; item++) {
+		active += local_active[item];
+		steps = max(steps, local_steps[item]);
+	}
+
+	lane_counts[2 * group] = active;
+	lane_counts[2 * group + 1] = convert_ulong(steps) * local_size;
+}
+
+// Mandelbrot kernel, evaluates the fractal once per pixel and gathers the
+// escape count histogram per work group, merged into histogram with atomics
+__kernel void mandelbrot(__global const float* reals,
+	                     __global const float* imags,
+	                     uint width,
+	                     uint height,
+	                     uint max_iterations,
+	                     __global float* escape,
+	                     __global float* distance,
+	                     __global uint* histogram,
+	                     __global ulong* lane_counts)
+{
+	__local uint local_histogram[HISTOGRAM_BINS];
+	__local ulong local_active[GROUP_ITEMS];
+	__local uint local_steps[GROUP_ITEMS];
+
+	const size_t local_id = get_local_id(1) * get_local_size(0) + get_local_id(0);
+	const size_t local_size = get_local_size(0) * get_local_size(1);
+
+	clear_histogram(local_histogram, local_id, local_size);
+	barrier(CLK_LOCAL_MEM_FENCE);
+
+	const size_t x = get_global_id(0);
+	const size_t y = get_global_id(1);
+
+	uint iterations = 0;
+
+	// global size is padded up to a whole number of work groups
+	if (x < width && y < height) {
+		const float2 c = { reals[x], imags[y] };
+
+		const float2 norm_mb = norm_mandelbrot(c, max_iterations, &iterations);
+
+		escape[y * width + x] = norm_mb.s0;
+		distance[y * width + x] = norm_mb.s1;
+
+		if (norm_mb.s0 >= 0.0f) {
+			atomic_inc(&local_histogram[histogram_bin(norm_mb.s0, max_iterations)]);
+		}
+	}
+
+	local_active[local_id] = iterations;
+	local_steps[local_id] = iterations;
+	barrier(CLK_LOCAL_MEM_FENCE);
+
+	merge_histogram(local_histogram, histogram, local_id, local_size);
+	store_lane_counts(local_active, local_steps, lane_counts,
+		get_group_id(1) * get_num_groups(0) + get_group_id(0), local_id, local_size);
+}
+
+// Persistent threads version of the mandelbrot kernel, one dimensional and
+// sized to fill the device rather than the frame. Each work item takes a
+// pixel from the queue counter and iterates it ITERATION_CHUNK iterations at a
+// time, in between a work item whose pixel finished takes the next one, so
+// work items of a wavefront stay busy while their neighbours run long orbits.
+__kernel void mandelbrot_persistent(__global const float* reals,
+	                                __global const float* imags,
+	                                uint width,
+	                                uint height,
+	                                uint max_iterations,
+	                                __global float* escape,
+	                                __global float* distance,
+	                                __global uint* histogram,
+	                                __global ulong* lane_counts,
+	                                __global uint* queue)
+{
+	__local uint local_histogram[HISTOGRAM_BINS];
+	__local ulong local_active[GROUP_ITEMS];
+	__local uint local_steps[GROUP_ITEMS];
+
+	const size_t local_id = get_local_id(0);
+	const size_t local_size = get_local_size(0);
+
+	clear_histogram(local_histogram, local_id, local_size);
+	barrier(CLK_LOCAL_MEM_FENCE);
+
+	const uint pixels = width * height;
+	const float2 dc = { 1.0, 0.0 };
+
+	ulong active = 0;
+	uint steps = 0;
+
+	float2 c, z, dz;
+	uint i = 0;
+
+	uint pixel = atomic_inc(queue);
+	if (pixel < pixels) {
+		c = (float2)(reals[pixel % width], imags[pixel / width]);
+		z = (float2)(0.0f, 0.0f);
+		dz = (float2)(0.0f, 0.0f);
+	}
+
+	while (pixel < pixels) {
+		bool done = false;
+		float2 result = { -1.0f, 0.0f };
+
+		for (uint k = 0; k < ITERATION_CHUNK; k++) {
+			dz = 2.0f * multiply(z, dz) + dc;
+			z = multiply(z, z) + c;
+			active++;
+
+			if (fast_length(z) > 4.0f) {
+				result = escaped_result(i, z, dz, max_iterations);
+				done = true;
+				break;
+			}
+			if (++i >= max_iterations) {
+				done = true;
+				break;
+			}
+		}
+		steps += ITERATION_CHUNK;
+
+		if (done) {
+			escape[pixel] = result.s0;
+			distance[pixel] = result.s1;
+
+			if (result.s0 >= 0.0f) {
+				atomic_inc(&local_histogram[histogram_bin(result.s0, max_iterations)]);
+			}
+
+			pixel = atomic_inc(queue);
+			if (pixel < pixels) {
+				c = (float2)(reals[pixel % width], imags[pixel / width]);
+				z = (float2)(0.0f, 0.0f);
+				dz = (float2)(0.0f, 0.0f);
+				i = 0;
+			}
+		}
+	}
+
+	local_active[local_id] = active;
+	local_steps[local_id] = steps;
+	barrier(CLK_LOCAL_MEM_FENCE);
+
+	merge_histogram(local_histogram, histogram, local_id, local_size);
+	store_lane_counts(local_active, local_steps, lane_counts, get_group_id(0), local_id, local_size);
+}
+
+void cumulative(__global const uint* histogram, __global float* cdf)
+{
+	ulong total = 0;
+	for (size_t bin = 0; bin < HISTOGRAM_BINS; bin++) {
+		total += histogram[bin];
+	}
+
+	const float scale = total > 0 ? 1.0f / convert_float(total) : 0.0f;
+
+	ulong running = 0;
+	for (size_t bin = 0; bin < HISTOGRAM_BINS; bin++) {
+		running += histogram[bin];
+		cdf[bin] = convert_float(running) * scale;
+	}
+}
+
+// Turns the merged histogram into a cumulative distribution, single work item
+__kernel void histogram_cdf(__global const uint* histogram,
+	                        __global float* cdf)
+{
+	cumulative(histogram, cdf);
+}
+
+// Colouring kernel, maps the escape fields to the output image
+__kernel void colorize(__global const float* escape,
+	                   __global const float* distance,
+	                   __global const float* cdf,
+	                   uint width,
+	                   uint height,
+	                   uint max_iterations,
+	                   uint coloring,
+	                   float pixel_size,
+	                   __write_only image2d_t image)
+{
+	const size_t x = get_global_id(0);
+	const size_t y = get_global_id(1);
+
+	if (x >= width || y >= height) {
+		return;
+	}
+
+	const float3 colorHSV = valuetohsv(escape[y * width + x], distance[y * width + x],
+		pixel_size, max_iterations, coloring, cdf);
+
+	const float3 colorRGB = hsvtorgb(colorHSV);
+
+	const uint3 colorUI = convert_uint3(colorRGB * 255.0f);
+	const uint4 colorWithAlpha = { colorUI, 0u };
+
+	const int2 coord = { x, y };
+
+	write_imageui(image, coord, colorWithAlpha);
+}
+
+// Atlas version of the mandelbrot kernel, evaluates many small frames in one
+// launch. Dimension 1 picks the frame and dimension 0 the pixel within it, so
+// a work group never straddles frames and gathers into its frame's histogram
+__kernel void mandelbrot_atlas(__global const tile_descriptor* tiles,
+	                           __global const float* axes,
+	                           __global float* escape,
+	                           __global float* distance,
+	                           __global uint* histograms)
+{
+	__local uint local_histogram[HISTOGRAM_BINS];
+
+	const size_t local_id = get_local_id(0);
+	const size_t local_size = get_local_size(0);
+
+	const tile_descriptor tile = tiles[get_global_id(1)];
+	const size_t pixel = get_global_id(0);
+
+	// the same for the whole work group
+	const bool gather = tile.coloring == COLORING_HISTOGRAM;
+
+	if (gather) {
+		clear_histogram(local_histogram, local_id, local_size);
+	}
+	barrier(CLK_LOCAL_MEM_FENCE);
+
+	// global size is padded up to the largest frame
+	if (pixel < tile.width * tile.height) {
+		const float2 c = { axes[tile.reals + pixel % tile.width], axes[tile.imags + pixel / tile.width] };
+
+		uint iterations = 0;
+		const float2 norm_mb = norm_mandelbrot(c, tile.max_iterations, &iterations);
+
+		escape[tile.pixels + pixel] = norm_mb.s0;
+		distance[tile.pixels + pixel] = norm_mb.s1;
+
+		if (gather && norm_mb.s0 >= 0.0f) {
+			atomic_inc(&local_histogram[histogram_bin(norm_mb.s0, tile.max_iterations)]);
+		}
+	}
+	barrier(CLK_LOCAL_MEM_FENCE);
+
+	if (gather) {
+		merge_histogram(local_histogram, histograms + get_global_id(1) * HISTOGRAM_BINS, local_id, local_size);
+	}
+}
+
+// histogram_cdf for every frame of an atlas, one work item per frame
+__kernel void histogram_cdf_atlas(__global const uint* histograms,
+	                              __global float* cdfs,
+	                              uint frames)
+{
+	const size_t frame = get_global_id(0);
+	if (frame >= frames) {
+		return;
+	}
+
+	cumulative(histograms + frame * HISTOGRAM_BINS, cdfs + frame * HISTOGRAM_BINS);
+}
+
+// Colours every frame of an atlas into packed pixels laid out like the escape
+// fields, R | G << 8 | B << 16 as the image of the colorize kernel reads back
+__kernel void colorize_atlas(__global const tile_descriptor* tiles,
+	                         __global const float* escape,
+	                         __global const float* distance,
+	                         __global const float* cdfs,
+	                         __global uint* pixels)
+{
+	const tile_descriptor tile = tiles[get_global_id(1)];
+	const size_t pixel = get_global_id(0);
+
+	if (pixel >= tile.width * tile.height) {
+		return;
+	}
+
+	const size_t index = tile.pixels + pixel;
+	const float3 colorHSV = valuetohsv(escape[index], distance[index], tile.pixel_size,
+		tile.max_iterations, tile.coloring, cdfs + get_global_id(1) * HISTOGRAM_BINS);
+
+	const uint3 colorUI = convert_uint3(hsvtorgb(colorHSV) * 255.0f);
+
+	pixels[index] = colorUI.x | (colorUI.y << 8) | (colorUI.z << 16);
+}
@@ -1,57 +1,132 @@
-#pragma once
-
-#include <vector>
-#include <complex>
-
-namespace mandelbrot {
-	struct input_spec {
-		std::complex<float> center;
-		size_t output_width, output_height;
-		float zoom_level{ 0.0 };
-	};
-	struct host_input {
-		std::vector<float> reals, imags;
-
-		host_input(const input_spec& spec);
-	};
-	struct host_output {
-		size_t width, height;
-		std::vector<uint32_t> out;
-
-		host_output(const host_input& input);
-		host_output(size_t width, size_t height);
-
-		const uint32_t& at(size_t x, size_t y) const { return out[y*width + x]; }
-		uint32_t& at(size_t x, size_t y) { return out[y*width + x]; }
-	};
-}
-namespace util {
-	inline std::vector<float> gen_values(float middle, size_t steps, float zoom_level)
-	{
-		std::vector<float> out;
-		out.reserve(steps);
-
-		float step = 0.002 * pow(10.0, -zoom_level);
-
-		size_t mid_steps = steps / 2;
-		float begin = middle - mid_steps * step;
-		for (size_t i = 0; i < steps; i++){
-			out.push_back(begin + i * step);
-		}
-
-		return out;
-	}
-}
-
-inline mandelbrot::host_input::host_input(const mandelbrot::input_spec& spec)
-	: imags(util::gen_values(spec.center.imag(), spec.output_height, spec.zoom_level))
-	, reals(util::gen_values(spec.center.real(), spec.output_width, spec.zoom_level))
-{}
-
-inline mandelbrot::host_output::host_output(const mandelbrot::host_input& input)
-	: width{ input.reals.size() }, height{ input.imags.size() }, out(width*height, 0u)
-{}
-
-inline mandelbrot::host_output::host_output(size_t _width, size_t _height)
-	: width{ _width }, height{ _height }, out(width*height, 0u)
-{}
\ No newline at end of file
+#pragma once
+
+#include "pool.h"
+
+#include <vector>
+#include <complex>
+#include <cstdint>
+
+namespace mandelbrot {
+	// how escape values are turned into colours, values match COLORING_* in mandelbrot.cl
+	enum class coloring_mode : uint32_t {
+		cyclic = 0,    // fixed hue cycle over the smooth escape count
+		histogram = 1, // hue from the cumulative escape count histogram of the frame
+		distance = 2,  // cyclic hue, brightness from the exterior distance estimate
+	};
+
+	// iterated function, the device only supports mandelbrot
+	enum class formula : uint32_t {
+		mandelbrot = 0, // z^2 + c from z = 0
+		julia = 1,      // z^2 + julia_constant from z = c
+		multibrot = 2,  // z^power + c from z = 0
+	};
+
+	// scalar type the orbit is iterated in, the device only supports single
+	enum class precision : uint32_t {
+		single = 0,
+		double_ = 1,
+	};
+
+	// how pixels are handed to SIMD lanes or device work items, both give the same fields
+	enum class schedule : uint32_t {
+		fixed = 0,     // each lane or work item keeps its pixel until the slowest of its group is done
+		compacted = 1, // finished pixels are replaced between chunks of iterations
+	};
+
+	struct input_spec {
+		std::complex<double> center;
+		size_t output_width, output_height;
+		float zoom_level{ 0.0 };
+		size_t max_iterations{ 1000 };
+		coloring_mode coloring{ coloring_mode::cyclic };
+		mandelbrot::precision precision{ mandelbrot::precision::single };
+		mandelbrot::formula formula{ mandelbrot::formula::mandelbrot };
+		unsigned power{ 3 };
+		std::complex<double> julia_constant{ 0.4, 0.4 };
+		mandelbrot::schedule schedule{ mandelbrot::schedule::compacted };
+	};
+	// Frame storage comes from the buffer pool, so frames of a size seen
+	// before are set up without allocating. Reusing one with assign or
+	// resize does not even touch the pool.
+	struct host_input {
+		util::buffer<float> reals, imags;
+
+		host_input(const input_spec& spec);
+
+		// coordinates of another frame, storage is kept
+		void assign(const input_spec& spec);
+	};
+	struct host_output {
+		size_t width, height;
+		util::buffer<uint32_t> out;
+
+		// smooth escape count (negative inside the set) and exterior distance estimate per pixel
+		util::buffer<float> escape, distance;
+
+		// sized for input, left uninitialised for the compute to overwrite
+		host_output(const host_input& input);
+		// blank, pixels are black and inside the set
+		host_output(size_t width, size_t height);
+
+		// sized for another frame, storage is kept when it does not grow and contents are undefined
+		void resize(size_t width, size_t height);
+
+		const uint32_t& at(size_t x, size_t y) const { return out[y*width + x]; }
+		uint32_t& at(size_t x, size_t y) { return out[y*width + x]; }
+	};
+}
+namespace util {
+	// distance in the complex plane between neighbouring pixels
+	inline double step_size(float zoom_level)
+	{
+		return 0.002 * pow(10.0, -zoom_level);
+	}
+
+	// coordinate of pixel i along an axis centred on middle
+	inline double coordinate(double middle, size_t steps, double step, size_t i)
+	{
+		size_t mid_steps = steps / 2;
+		return middle + (static_cast<double>(i) - static_cast<double>(mid_steps)) * step;
+	}
+
+	inline void gen_values(util::buffer<float>& out, double middle, size_t steps, float zoom_level)
+	{
+		out.resize(steps);
+
+		double step = step_size(zoom_level);
+
+		for (size_t i = 0; i < steps; i++){
+			out[i] = static_cast<float>(coordinate(middle, steps, step, i));
+		}
+	}
+}
+
+inline mandelbrot::host_input::host_input(const mandelbrot::input_spec& spec)
+{
+	assign(spec);
+}
+
+inline void mandelbrot::host_input::assign(const mandelbrot::input_spec& spec)
+{
+	util::gen_values(reals, spec.center.real(), spec.output_width, spec.zoom_level);
+	util::gen_values(imags, spec.center.imag(), spec.output_height, spec.zoom_level);
+}
+
+inline mandelbrot::host_output::host_output(const mandelbrot::host_input& input)
+	: width{ input.reals.size() }, height{ input.imags.size() }
+	, out(width*height), escape(width*height), distance(width*height)
+{}
+
+inline mandelbrot::host_output::host_output(size_t _width, size_t _height)
+	: width{ _width }, height{ _height }, out(width*height, 0u)
+	, escape(width*height, -1.0f), distance(width*height, 0.0f)
+{}
+
+inline void mandelbrot::host_output::resize(size_t _width, size_t _height)
+{
+	width = _width;
+	height = _height;
+	out.resize(width * height);
+	escape.resize(width * height);
+	distance.resize(width * height);
+}
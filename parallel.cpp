@@ -0,0 +1,187 @@
+
+#include "parallel.h"
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <exception>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace {
+	thread_local bool in_chunk = false;
+	thread_local size_t current_worker = 0;
+
+	class worker_pool {
+	private:
+		std::vector<std::thread> _threads;
+
+		// one job at a time
+		std::mutex _submit;
+
+		std::mutex _mutex;
+		std::condition_variable _wake;
+		std::condition_variable _done;
+		size_t _generation{ 0 };
+		size_t _busy{ 0 };
+		bool _stop{ false };
+
+		// current job
+		void* _ctx{ nullptr };
+		util::range_fn _fn{ nullptr };
+		size_t _count{ 0 };
+		size_t _grain{ 1 };
+		std::atomic<size_t> _next{ 0 };
+		std::exception_ptr _error;
+
+		void run_chunks(size_t worker);
+		void worker_loop(size_t worker);
+
+	public:
+		worker_pool();
+		~worker_pool();
+
+		size_t size() const { return _threads.size() + 1; }
+
+		void run(size_t count, size_t grain, void* ctx, util::range_fn fn);
+	};
+
+	worker_pool& shared_pool()
+	{
+		static worker_pool pool;
+		return pool;
+	}
+}
+
+worker_pool::worker_pool()
+{
+	const size_t threads = std::max(1u, std::thread::hardware_concurrency());
+
+	for (size_t worker = 1; worker < threads; worker++) {
+		_threads.emplace_back([this, worker]() { worker_loop(worker); });
+	}
+}
+
+worker_pool::~worker_pool()
+{
+	{
+		std::lock_guard<std::mutex> lock{ _mutex };
+		_stop = true;
+	}
+	_wake.notify_all();
+
+	for (auto& thread : _threads) {
+		thread.join();
+	}
+}
+
+void worker_pool::run_chunks(size_t worker)
+{
+	in_chunk = true;
+	current_worker = worker;
+
+	for (;;) {
+		const size_t begin = _next.fetch_add(_grain);
+		if (begin >= _count) {
+			break;
+		}
+
+		try {
+			_fn(_ctx, begin, std::min(begin + _grain, _count), worker);
+		}
+		catch (...) {
+			std::lock_guard<std::mutex> lock{ _mutex };
+			if (!_error) {
+				_error = std::current_exception();
+			}
+			// skip remaining chunks
+			_next = _count;
+		}
+	}
+
+	in_chunk = false;
+}
+
+void worker_pool::worker_loop(size_t worker)
+{
+	size_t seen = 0;
+
+	for (;;) {
+		{
+			std::unique_lock<std::mutex> lock{ _mutex };
+			_wake.wait(lock, [&]() { return _stop || _generation != seen; });
+			if (_stop) {
+				return;
+			}
+			seen = _generation;
+		}
+
+		run_chunks(worker);
+
+		{
+			std::lock_guard<std::mutex> lock{ _mutex };
+			if (--_busy == 0) {
+				_done.notify_one();
+			}
+		}
+	}
+}
+
+void worker_pool::run(size_t count, size_t grain, void* ctx, util::range_fn fn)
+{
+	std::lock_guard<std::mutex> submit{ _submit };
+
+	{
+		std::lock_guard<std::mutex> lock{ _mutex };
+		_ctx = ctx;
+		_fn = fn;
+		_count = count;
+		_grain = grain;
+		_next = 0;
+		_error = nullptr;
+		_busy = _threads.size();
+		_generation++;
+	}
+	_wake.notify_all();
+
+	run_chunks(0);
+
+	std::exception_ptr error;
+	{
+		std::unique_lock<std::mutex> lock{ _mutex };
+		_done.wait(lock, [&]() { return _busy == 0; });
+		std::swap(error, _error);
+	}
+
+	if (error) {
+		std::rethrow_exception(error);
+	}
+}
+
+size_t util::workers()
+{
+	return shared_pool().size();
+}
+
+void util::parallel_for(size_t count, size_t grain, void* ctx, util::range_fn fn)
+{
+	if (count == 0) {
+		return;
+	}
+
+	grain = std::max<size_t>(grain, 1u);
+
+	if (in_chunk) {
+		// nested call, run inline on the worker that made it
+		fn(ctx, 0, count, current_worker);
+		return;
+	}
+
+	if (count <= grain || shared_pool().size() == 1) {
+		fn(ctx, 0, count, 0);
+		return;
+	}
+
+	shared_pool().run(count, grain, ctx, fn);
+}
@@ -0,0 +1,26 @@
+#pragma once
+
+#include <cstddef>
+#include <type_traits>
+
+namespace util {
+	// number of workers parallel_for spreads work over, the calling thread included
+	size_t workers();
+
+	using range_fn = void(*)(void* ctx, size_t begin, size_t end, size_t worker);
+
+	// Runs fn over [0, count) in chunks of grain on the shared worker pool and
+	// returns once every chunk is done. worker identifies the thread running
+	// the chunk (0 <= worker < workers()) so callers can keep per-thread state.
+	// Calls made from inside a chunk run inline on the calling worker.
+	void parallel_for(size_t count, size_t grain, void* ctx, range_fn fn);
+
+	template<typename F>
+	void parallel_for(size_t count, size_t grain, F&& f)
+	{
+		using type = std::remove_reference_t<F>;
+		parallel_for(count, grain, (void*)&f, [](void* ctx, size_t begin, size_t end, size_t worker) {
+			(*static_cast<type*>(ctx))(begin, end, worker);
+		});
+	}
+}
@@ -0,0 +1,148 @@
+#include "verify.h"
+#include "gpu_compute.h"
+#include "host_compute.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <memory>
+#include <stdexcept>
+#include <string>
+
+// Throughput gate over the standard scene frames. Each frame is rendered on
+// the host in every precision that resolves it, and on the device when there
+// is one, the best of the repeats counts. Fails when a case is slower than the
+// stored baseline by more than the margin, --update records the measurements
+// as the new baseline instead. Baselines belong to one machine, without one
+// the gate exits with skip_status so ctest reports it skipped, not passed.
+//
+//   MandelbrotPerfGate [--baseline FILE] [--margin FRACTION] [--repeats N] [--width N] [--scenes DIR] [--update]
+
+namespace {
+	// the SKIP_RETURN_CODE of the ctest
+	constexpr const int skip_status = 77;
+
+	struct arguments {
+		std::string baseline{ "perf_baseline.txt" };
+		double margin{ 0.1 };
+		size_t repeats{ 3 };
+		size_t width{ 256 };
+		std::string scenes{ MANDELBROT_SOURCE_DIR "/scenes" };
+		bool update{ false };
+	};
+
+	arguments parse(int argc, char* argv[])
+	{
+		arguments result;
+		for (int i = 1; i < argc; i++) {
+			const std::string arg = argv[i];
+			auto value = [&]() -> std::string {
+				if (i + 1 >= argc) {
+					throw std::runtime_error("missing value for " + arg);
+				}
+				return argv[++i];
+			};
+
+			if (arg == "--baseline") result.baseline = value();
+			else if (arg == "--margin") result.margin = std::stod(value());
+			else if (arg == "--repeats") result.repeats = std::max<size_t>(1, std::stoul(value()));
+			else if (arg == "--width") result.width = std::stoul(value());
+			else if (arg == "--scenes") result.scenes = value();
+			else if (arg == "--update") result.update = true;
+			else throw std::runtime_error("unknown argument " + arg);
+		}
+		return result;
+	}
+
+	// best pixels per second of repeats renders after a warm up
+	template<typename Render>
+	double measure(const mandelbrot::input_spec& spec, size_t repeats, Render render)
+	{
+		compute::compute_io_data data{ spec };
+		render(data);
+
+		double best = 0.0;
+		for (size_t i = 0; i < repeats; i++) {
+			const auto start = std::chrono::steady_clock::now();
+			render(data);
+			const double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+			best = std::max(best, double(spec.output_width * spec.output_height) / seconds);
+		}
+		return best;
+	}
+}
+
+int main(int argc, char* argv[])
+{
+	try {
+		const arguments args = parse(argc, argv);
+
+		verify::throughputs measured;
+		for (const verify::frame& frame : verify::standard_frames(args.scenes, args.width)) {
+			for (auto precision : { mandelbrot::precision::single, mandelbrot::precision::double_ }) {
+				if (!verify::resolvable(frame.spec, precision)) {
+					continue;
+				}
+				mandelbrot::input_spec spec = frame.spec;
+				spec.precision = precision;
+				const std::string name = frame.name + (precision == mandelbrot::precision::single ? "/host/single" : "/host/double");
+				measured[name] = measure(spec, args.repeats, [](compute::compute_io_data& data) { compute::host_compute(data); });
+			}
+
+			if (frame.spec.formula != mandelbrot::formula::mandelbrot || !verify::resolvable(frame.spec, mandelbrot::precision::single)) {
+				continue;
+			}
+			std::unique_ptr<compute::gpu_context> context;
+			try {
+				context = std::make_unique<compute::gpu_context>(frame.spec.output_width, frame.spec.output_height);
+			}
+			catch (const compute::gpu_error&) {
+				continue;
+			}
+			mandelbrot::input_spec spec = frame.spec;
+			spec.precision = mandelbrot::precision::single;
+			measured[frame.name + "/gpu/single"] = measure(spec, args.repeats, [&](compute::compute_io_data& data) { compute::compute(data, *context); });
+		}
+
+		const verify::throughputs baseline = verify::read_baseline(args.baseline);
+
+		std::printf("%-32s %14s %14s %8s\n", "case", "baseline", "measured", "change");
+		for (const auto& entry : measured) {
+			auto expected = baseline.find(entry.first);
+			if (expected == baseline.end()) {
+				std::printf("%-32s %14s %9.2f Mp/s\n", entry.first.c_str(), "-", entry.second / 1e6);
+			}
+			else {
+				std::printf("%-32s %9.2f Mp/s %9.2f Mp/s %+7.1f%%\n", entry.first.c_str(), expected->second / 1e6, entry.second / 1e6,
+					(entry.second / expected->second - 1.0) * 100.0);
+			}
+		}
+
+		if (args.update) {
+			verify::write_baseline(args.baseline, measured);
+			std::printf("\nbaseline written to %s\n", args.baseline.c_str());
+			return 0;
+		}
+
+		if (baseline.empty()) {
+			std::printf("\nno baseline at %s, record one with --update\n", args.baseline.c_str());
+			return skip_status;
+		}
+
+		const std::vector<verify::regression> regressions = verify::regressions(baseline, measured, args.margin);
+		if (regressions.empty()) {
+			std::printf("\nno case more than %.0f%% below the baseline\n", args.margin * 100.0);
+			return 0;
+		}
+
+		std::printf("\n%zu cases more than %.0f%% below the baseline\n", regressions.size(), args.margin * 100.0);
+		for (const verify::regression& regression : regressions) {
+			std::printf("  %s %.2f Mp/s, baseline %.2f Mp/s\n", regression.name.c_str(), regression.measured / 1e6, regression.baseline / 1e6);
+		}
+		return 1;
+	}
+	catch (const std::exception& error) {
+		std::fprintf(stderr, "%s\n", error.what());
+		return 1;
+	}
+}
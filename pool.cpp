@@ -0,0 +1,175 @@
+
+#include "pool.h"
+
+#include <algorithm>
+#include <array>
+#include <cstdlib>
+#include <mutex>
+
+#ifdef __linux__
+#include <sys/mman.h>
+#endif
+
+#ifdef _WIN32
+#include <malloc.h>
+#endif
+
+namespace {
+	// released block, the links live in the block itself
+	struct free_block {
+		free_block* next;
+		size_t capacity;
+	};
+
+	// eight size classes for each power of two
+	constexpr const size_t classes_per_doubling = 8;
+	constexpr const size_t class_count = 64 * classes_per_doubling;
+
+	struct pool {
+		std::mutex mutex;
+		// released blocks of each size class, all of one capacity
+		std::array<free_block*, class_count> free{};
+		size_t limit{ util::default_pool_limit };
+		util::pool_statistics stats;
+	};
+
+	// never destroyed, buffers of static objects may be released after main
+	pool& shared_pool()
+	{
+		static pool* shared = new pool{};
+		return *shared;
+	}
+
+	// highest set bit
+	size_t log2_of(size_t value)
+	{
+		size_t result = 0;
+		while (value >>= 1) {
+			result++;
+		}
+		return result;
+	}
+
+	struct size_class {
+		size_t index;
+		size_t capacity;
+	};
+
+	// bytes rounded up to the next of eight steps in (2^p, 2^(p+1)], steps are
+	// at least a cache line, or a huge page for blocks of at least one
+	size_class class_of(size_t bytes)
+	{
+		bytes = std::max(bytes, util::block_alignment);
+		const size_t p = log2_of(bytes - 1);
+		const size_t unit = bytes >= util::huge_page_size ? util::huge_page_size : util::block_alignment;
+		const size_t step = std::max(size_t(1) << (p - 3), unit);
+		const size_t capacity = (bytes + step - 1) / step * step;
+		// capacity >> (p - 3) is one of 9 to 16, steps coarser than 2^(p - 3) leave some out
+		return { p * classes_per_doubling + (capacity >> (p - 3)) - 9, capacity };
+	}
+
+	void* system_allocate(size_t capacity)
+	{
+		const size_t alignment = capacity >= util::huge_page_size ? util::huge_page_size : util::block_alignment;
+
+#ifdef _WIN32
+		void* block = _aligned_malloc(capacity, alignment);
+#else
+		void* block = std::aligned_alloc(alignment, capacity);
+#endif
+		if (!block) {
+			throw std::bad_alloc();
+		}
+
+#ifdef MADV_HUGEPAGE
+		// a hint, transparent huge pages may be disabled
+		if (capacity >= util::huge_page_size) {
+			madvise(block, capacity, MADV_HUGEPAGE);
+		}
+#endif
+
+		return block;
+	}
+
+	void system_free(void* block)
+	{
+#ifdef _WIN32
+		_aligned_free(block);
+#else
+		std::free(block);
+#endif
+	}
+}
+
+void* util::acquire_block(size_t bytes)
+{
+	const size_class size = class_of(bytes);
+	pool& shared = shared_pool();
+
+	{
+		std::lock_guard<std::mutex> lock{ shared.mutex };
+		if (free_block* block = shared.free[size.index]) {
+			shared.free[size.index] = block->next;
+			shared.stats.held_bytes -= size.capacity;
+			return block;
+		}
+		shared.stats.system_allocations++;
+	}
+
+	return system_allocate(size.capacity);
+}
+
+void util::release_block(void* block, size_t bytes)
+{
+	if (!block) {
+		return;
+	}
+
+	const size_class size = class_of(bytes);
+	pool& shared = shared_pool();
+
+	{
+		std::lock_guard<std::mutex> lock{ shared.mutex };
+		if (shared.stats.held_bytes + size.capacity <= shared.limit) {
+			shared.free[size.index] = ::new (block) free_block{ shared.free[size.index], size.capacity };
+			shared.stats.held_bytes += size.capacity;
+			return;
+		}
+	}
+
+	system_free(block);
+}
+
+util::pool_statistics util::pool_stats()
+{
+	pool& shared = shared_pool();
+	std::lock_guard<std::mutex> lock{ shared.mutex };
+	return shared.stats;
+}
+
+void util::set_pool_limit(size_t bytes)
+{
+	pool& shared = shared_pool();
+	std::lock_guard<std::mutex> lock{ shared.mutex };
+	shared.limit = bytes;
+}
+
+void util::trim_pool()
+{
+	pool& shared = shared_pool();
+
+	std::array<free_block*, class_count> blocks{};
+	{
+		std::lock_guard<std::mutex> lock{ shared.mutex };
+		std::swap(blocks, shared.free);
+		shared.stats.held_bytes = 0;
+	}
+
+	for (free_block* block : blocks) {
+		while (block) {
+			free_block* next = block->next;
+			system_free(block);
+			block = next;
+		}
+	}
+}
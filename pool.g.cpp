@@ -0,0 +1,45 @@
+#include "pool.h"
+
+#include <gtest/gtest.h>
+
+TEST(Pool, ReusesReleasedBlocks)
+{
+	const float* first = nullptr;
+	{
+		util::buffer<float> frame(1u << 20);
+		first = frame.data();
+		ASSERT_EQ(0u, reinterpret_cast<uintptr_t>(frame.data()) % util::huge_page_size);
+	}
+
+	const uint64_t system = util::pool_stats().system_allocations;
+	util::buffer<float> again(1u << 20);
+	ASSERT_EQ(first, again.data());
+	ASSERT_EQ(system, util::pool_stats().system_allocations);
+
+	util::buffer<uint32_t> small(100);
+	ASSERT_EQ(0u, reinterpret_cast<uintptr_t>(small.data()) % util::block_alignment);
+}
+
+TEST(Pool, SizeClassesAndLimit)
+{
+	util::trim_pool();
+
+	// sizes of one class share blocks
+	void* block = util::acquire_block(1000);
+	util::release_block(block, 1000);
+	ASSERT_EQ(block, util::acquire_block(1010));
+	util::release_block(block, 1010);
+	ASSERT_EQ(1024u, util::pool_stats().held_bytes);
+
+	// released blocks over the limit go back to the system
+	util::set_pool_limit(size_t(3) << 20);
+	void* first = util::acquire_block(size_t(2) << 20);
+	void* second = util::acquire_block(size_t(2) << 20);
+	util::release_block(first, size_t(2) << 20);
+	util::release_block(second, size_t(2) << 20);
+	ASSERT_EQ(1024u + (size_t(2) << 20), util::pool_stats().held_bytes);
+
+	util::set_pool_limit(util::default_pool_limit);
+	util::trim_pool();
+	ASSERT_EQ(0u, util::pool_stats().held_bytes);
+}
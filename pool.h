@@ -0,0 +1,73 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <new>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+namespace util {
+	// blocks of at least a huge page are aligned to and rounded up to huge pages
+	constexpr const size_t huge_page_size = size_t(2) << 20;
+
+	// alignment and rounding of smaller blocks, a cache line
+	constexpr const size_t block_alignment = 64;
+
+	// released blocks the pool keeps by default, the rest go back to the system
+	constexpr const size_t default_pool_limit = size_t(512) << 20;
+
+	// Process wide pool of frame buffers. Requests are rounded up to one of
+	// eight size classes per power of two, and released blocks are kept per
+	// class and handed out again for requests of the same class, so rendering
+	// frames of one size only takes memory from the system for the first of
+	// them. Released blocks that would take the pool over its limit are freed.
+	// Thread safe, memory is not cleared.
+	void* acquire_block(size_t bytes);
+	void release_block(void* block, size_t bytes);
+
+	struct pool_statistics {
+		// blocks ever taken from the system
+		uint64_t system_allocations{ 0 };
+		// in released blocks waiting to be reused
+		size_t held_bytes{ 0 };
+	};
+	pool_statistics pool_stats();
+
+	// bytes of released blocks kept at most, lowering it does not free blocks already held
+	void set_pool_limit(size_t bytes);
+
+	// gives the released blocks back to the system, at the end of a render or serve loop
+	void trim_pool();
+
+	// allocator over the pool, elements constructed without a value are
+	// default initialised so resizing a buffer of pixels does not clear it
+	template<typename T>
+	struct pool_allocator {
+		using value_type = T;
+
+		pool_allocator() = default;
+
+		template<typename U>
+		pool_allocator(const pool_allocator<U>&) {}
+
+		T* allocate(size_t n) { return static_cast<T*>(acquire_block(n * sizeof(T))); }
+		void deallocate(T* p, size_t n) { release_block(p, n * sizeof(T)); }
+
+		template<typename U>
+		void construct(U* p) noexcept(std::is_nothrow_default_constructible<U>::value) { ::new (static_cast<void*>(p)) U; }
+
+		template<typename U, typename... Args>
+		void construct(U* p, Args&&... args) { ::new (static_cast<void*>(p)) U(std::forward<Args>(args)...); }
+	};
+
+	template<typename T, typename U>
+	bool operator==(const pool_allocator<T>&, const pool_allocator<U>&) { return true; }
+
+	template<typename T, typename U>
+	bool operator!=(const pool_allocator<T>&, const pool_allocator<U>&) { return false; }
+
+	// storage of frame sized arrays
+	template<typename T>
+	using buffer = std::vector<T, pool_allocator<T>>;
+}
@@ -0,0 +1,87 @@
+#include "pool.h"
+#include "host_compute.h"
+#include "sequence.h"
+
+#include <gtest/gtest.h>
+
+#include <atomic>
+#include <cstdlib>
+#include <new>
+#include <ostream>
+
+namespace {
+	std::atomic<uint64_t> heap_allocations{ 0 };
+
+	// discards everything written to it without allocating
+	class null_buffer : public std::streambuf {
+	protected:
+		int overflow(int c) override { return c; }
+		std::streamsize xsputn(const char*, std::streamsize count) override { return count; }
+	};
+
+	mandelbrot::input_spec test_spec(float zoom_level)
+	{
+		mandelbrot::input_spec spec;
+		spec.center = { -0.75, 0.1 };
+		spec.output_width = 256;
+		spec.output_height = 128;
+		spec.zoom_level = zoom_level;
+		spec.max_iterations = 200;
+		spec.coloring = mandelbrot::coloring_mode::histogram;
+		return spec;
+	}
+}
+
+// counts every allocation of this test binary, which holds only this test so
+// the replacement does not reach the other suites
+void* operator new(size_t size)
+{
+	heap_allocations++;
+	if (void* block = std::malloc(size == 0 ? 1 : size)) {
+		return block;
+	}
+	throw std::bad_alloc();
+}
+
+void operator delete(void* block) noexcept { std::free(block); }
+void operator delete(void* block, size_t) noexcept { std::free(block); }
+
+TEST(Pool, SteadyStateRenderDoesNotAllocate)
+{
+	null_buffer discard;
+	std::ostream out{ &discard };
+	raster::y4m_sequence sequence{ out, 256, 128, 30 };
+
+	compute::compute_io_data data{ test_spec(0.0f) };
+
+	// warm up the worker pool, both buffers of the frame writer and a second
+	// set of frame blocks for frames set up from scratch
+	for (size_t frame = 0; frame < 3; frame++) {
+		data.reset(test_spec(0.1f * frame));
+		compute::host_compute(data);
+		sequence.write_frame(data.output);
+	}
+	{
+		compute::compute_io_data fresh{ test_spec(0.0f) };
+	}
+
+	const uint64_t heap = heap_allocations;
+	const uint64_t system = util::pool_stats().system_allocations;
+
+	for (size_t frame = 3; frame < 10; frame++) {
+		data.reset(test_spec(0.1f * frame));
+		compute::host_compute(data);
+		sequence.write_frame(data.output);
+	}
+
+	// frames set up from scratch take the blocks the previous one released
+	for (size_t frame = 0; frame < 3; frame++) {
+		compute::compute_io_data fresh{ test_spec(0.1f * frame) };
+		compute::host_compute(fresh);
+	}
+
+	ASSERT_EQ(heap, heap_allocations);
+	ASSERT_EQ(system, util::pool_stats().system_allocations);
+
+	sequence.close();
+}
@@ -1,16 +1,26 @@
-#include "raster.h"
-
-#include <gtest/gtest.h>
-
-TEST(Raster, SimpleImage)
-{
-	mandelbrot::host_output output{ 100u, 100u };
-	output.at(output.width / 2, output.height / 2) = 100;
-
-	std::ostringstream outStream;
-	std::ostream& out = outStream;
-
-	raster::write_output(out, output);
-
-	ASSERT_NE(0u, outStream.str().size());
-}
\ No newline at end of file
+#include "raster.h"
+
+#include <gtest/gtest.h>
+
+TEST(Raster, SimpleImage)
+{
+	mandelbrot::host_output output{ 100u, 100u };
+	output.at(output.width / 2, output.height / 2) = 100;
+
+	std::ostringstream outStream;
+	std::ostream& out = outStream;
+
+	raster::write_output(out, output);
+
+	ASSERT_NE(0u, outStream.str().size());
+}
+
+TEST(Raster, Png)
+{
+	mandelbrot::host_output output{ 16u, 16u };
+
+	std::ostringstream out;
+	raster::write_png(out, output);
+
+	ASSERT_EQ(std::string("\x89PNG", 4), out.str().substr(0, 4));
+}
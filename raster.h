@@ -1,7 +1,10 @@
-#pragma once
-#include "mandelbrot.h"
-
-namespace raster {
-	void write_output(std::string filename, const mandelbrot::host_output& output);
-	void write_output(std::ostream& out, const mandelbrot::host_output& output);
+#pragma once
+#include "mandelbrot.h"
+
+namespace raster {
+	void write_output(std::string filename, const mandelbrot::host_output& output);
+	void write_output(std::ostream& out, const mandelbrot::host_output& output);
+
+	// png of the frame, level is the zlib compression level, -1 for the default
+	void write_png(std::ostream& out, const mandelbrot::host_output& output, int level = -1);
 }
\ No newline at end of file
@@ -0,0 +1,88 @@
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+#include <stdexcept>
+#include <vector>
+
+namespace rle {
+	// PackBits style run length coding of fixed size elements. A control byte
+	// c < 128 is followed by c + 1 literal elements, c >= 128 by one element
+	// repeated c - 126 times.
+	constexpr const size_t max_run = 129;
+	constexpr const size_t max_literal = 128;
+
+	template<typename T>
+	void encode(const T* data, size_t count, std::vector<uint8_t>& out)
+	{
+		auto put = [&out](const T* element, size_t n) {
+			const uint8_t* bytes = reinterpret_cast<const uint8_t*>(element);
+			out.insert(out.end(), bytes, bytes + sizeof(T) * n);
+		};
+
+		size_t i = 0;
+		while (i < count) {
+			// length of the run starting at i
+			size_t run = 1;
+			while (i + run < count && run < max_run && std::memcmp(&data[i + run], &data[i], sizeof(T)) == 0) {
+				run++;
+			}
+
+			if (run >= 2) {
+				out.push_back(static_cast<uint8_t>(run + 126));
+				put(&data[i], 1);
+				i += run;
+				continue;
+			}
+
+			// literals until the next run of two or more
+			size_t literal = 1;
+			while (i + literal < count && literal < max_literal &&
+				!(i + literal + 1 < count && std::memcmp(&data[i + literal], &data[i + literal + 1], sizeof(T)) == 0)) {
+				literal++;
+			}
+
+			out.push_back(static_cast<uint8_t>(literal - 1));
+			put(&data[i], literal);
+			i += literal;
+		}
+	}
+
+	// bytes encode writes for count elements at most, a control byte for each
+	template<typename T>
+	constexpr size_t max_encoded_size(size_t count) { return (sizeof(T) + 1) * count; }
+
+	// decodes exactly count elements, returns the first byte after them
+	template<typename T>
+	const uint8_t* decode(const uint8_t* in, const uint8_t* end, T* data, size_t count)
+	{
+		size_t i = 0;
+		while (i < count) {
+			if (in >= end) {
+				throw std::runtime_error("rle stream truncated");
+			}
+
+			const uint8_t control = *in++;
+			const size_t n = control < 128 ? control + 1u : control - 126u;
+			const size_t bytes = control < 128 ? sizeof(T) * n : sizeof(T);
+
+			if (i + n > count || static_cast<size_t>(end - in) < bytes) {
+				throw std::runtime_error("rle stream corrupt");
+			}
+
+			if (control < 128) {
+				std::memcpy(&data[i], in, bytes);
+			}
+			else {
+				for (size_t j = 0; j < n; j++) {
+					std::memcpy(&data[i + j], in, sizeof(T));
+				}
+			}
+
+			in += bytes;
+			i += n;
+		}
+
+		return in;
+	}
+}
@@ -0,0 +1,232 @@
+
+#include "scene.h"
+
+#include <algorithm>
+#include <cmath>
+#include <fstream>
+#include <sstream>
+#include <stdexcept>
+
+namespace {
+	template<typename T>
+	T read_value(std::istream& line, const std::string& what)
+	{
+		T value;
+		if (!(line >> value)) {
+			throw std::runtime_error("expected " + what);
+		}
+		return value;
+	}
+
+	size_t read_count(std::istream& line, const std::string& what)
+	{
+		const long long value = read_value<long long>(line, what);
+		if (value < 0) {
+			throw std::runtime_error(what + " must not be negative");
+		}
+		return static_cast<size_t>(value);
+	}
+
+	void parse_keyframe(std::istream& line, scene::keyframe& key)
+	{
+		key.frame = read_count(line, "keyframe frame number");
+
+		std::string name;
+		while (line >> name) {
+			if (name == "center") {
+				const double real = read_value<double>(line, "center real part");
+				const double imag = read_value<double>(line, "center imaginary part");
+				key.center = { real, imag };
+			}
+			else if (name == "zoom") {
+				key.zoom = read_value<double>(line, "zoom level");
+			}
+			else if (name == "iterations") {
+				key.iterations = read_count(line, "iterations");
+				if (key.iterations == 0) {
+					throw std::runtime_error("iterations must be positive");
+				}
+			}
+			else if (name == "coloring") {
+				key.coloring = scene::parse_coloring(read_value<std::string>(line, "coloring mode"));
+			}
+			else if (name == "precision") {
+				key.precision = scene::parse_precision(read_value<std::string>(line, "precision"));
+			}
+			else if (name == "formula") {
+				key.formula = scene::parse_formula(read_value<std::string>(line, "formula"));
+			}
+			else if (name == "power") {
+				key.power = static_cast<unsigned>(read_count(line, "power"));
+			}
+			else if (name == "julia") {
+				const double real = read_value<double>(line, "julia constant real part");
+				const double imag = read_value<double>(line, "julia constant imaginary part");
+				key.julia = { real, imag };
+			}
+			else {
+				throw std::runtime_error("unknown keyframe value " + name);
+			}
+		}
+	}
+
+	double mix(double a, double b, double t) { return a + (b - a) * t; }
+}
+
+mandelbrot::coloring_mode scene::parse_coloring(const std::string& name)
+{
+	if (name == "cyclic") return mandelbrot::coloring_mode::cyclic;
+	if (name == "histogram") return mandelbrot::coloring_mode::histogram;
+	if (name == "distance") return mandelbrot::coloring_mode::distance;
+	throw std::runtime_error("unknown coloring mode " + name);
+}
+
+mandelbrot::precision scene::parse_precision(const std::string& name)
+{
+	if (name == "single") return mandelbrot::precision::single;
+	if (name == "double") return mandelbrot::precision::double_;
+	throw std::runtime_error("unknown precision " + name);
+}
+
+mandelbrot::formula scene::parse_formula(const std::string& name)
+{
+	if (name == "mandelbrot") return mandelbrot::formula::mandelbrot;
+	if (name == "julia") return mandelbrot::formula::julia;
+	if (name == "multibrot") return mandelbrot::formula::multibrot;
+	throw std::runtime_error("unknown formula " + name);
+}
+
+scene::interpolation scene::parse_interpolation(const std::string& name)
+{
+	if (name == "linear") return interpolation::linear;
+	if (name == "exponential") return interpolation::exponential;
+	if (name == "ease") return interpolation::ease;
+	throw std::runtime_error("unknown interpolation " + name);
+}
+
+scene::animation scene::parse(std::istream& in)
+{
+	animation result;
+	keyframe previous;
+
+	std::string text;
+	size_t line_number = 0;
+	while (std::getline(in, text)) {
+		line_number++;
+
+		text = text.substr(0, text.find('#'));
+		std::istringstream line{ text };
+
+		std::string directive;
+		if (!(line >> directive)) {
+			continue;
+		}
+
+		try {
+			if (directive == "resolution") {
+				result.width = read_count(line, "width");
+				result.height = read_count(line, "height");
+				if (result.width == 0 || result.height == 0) {
+					throw std::runtime_error("resolution must be positive");
+				}
+			}
+			else if (directive == "frames") {
+				result.frames = read_count(line, "frame count");
+			}
+			else if (directive == "fps") {
+				result.fps = static_cast<unsigned>(read_count(line, "frames per second"));
+			}
+			else if (directive == "interpolation") {
+				result.interpolation = parse_interpolation(read_value<std::string>(line, "interpolation"));
+			}
+			else if (directive == "keyframe") {
+				parse_keyframe(line, previous);
+				result.keyframes.push_back(previous);
+			}
+			else {
+				throw std::runtime_error("unknown directive " + directive);
+			}
+
+			std::string extra;
+			if (line >> extra) {
+				throw std::runtime_error("unexpected " + extra);
+			}
+		}
+		catch (const std::runtime_error& error) {
+			throw std::runtime_error("scene line " + std::to_string(line_number) + ": " + error.what());
+		}
+	}
+
+	std::stable_sort(result.keyframes.begin(), result.keyframes.end(),
+		[](const keyframe& a, const keyframe& b) { return a.frame < b.frame; });
+
+	for (size_t i = 1; i < result.keyframes.size(); i++) {
+		if (result.keyframes[i].frame == result.keyframes[i - 1].frame) {
+			throw std::runtime_error("scene has two keyframes for frame " + std::to_string(result.keyframes[i].frame));
+		}
+	}
+
+	if (result.keyframes.empty()) {
+		result.keyframes.push_back(previous);
+	}
+
+	return result;
+}
+
+scene::animation scene::load(const std::string& filename)
+{
+	std::ifstream in{ filename };
+	if (!in) {
+		throw std::runtime_error("could not load scene from " + filename);
+	}
+	return parse(in);
+}
+
+size_t scene::animation::frame_count() const
+{
+	if (frames != 0) {
+		return frames;
+	}
+	return keyframes.empty() ? 1 : keyframes.back().frame + 1;
+}
+
+mandelbrot::input_spec scene::animation::frame(size_t index) const
+{
+	if (keyframes.empty()) {
+		throw std::runtime_error("scene has no keyframes");
+	}
+
+	// last keyframe at or before index, clamped to the first
+	auto next = std::upper_bound(keyframes.begin(), keyframes.end(), index,
+		[](size_t i, const keyframe& key) { return i < key.frame; });
+	const keyframe& from = next == keyframes.begin() ? *next : *(next - 1);
+	const keyframe& to = next == keyframes.end() ? from : *next;
+
+	double t = 0.0;
+	if (to.frame > from.frame && index > from.frame) {
+		t = std::min(1.0, double(index - from.frame) / double(to.frame - from.frame));
+	}
+
+	if (interpolation == scene::interpolation::ease) {
+		t = t * t * (3.0 - 2.0 * t);
+	}
+
+	double zoom = mix(from.zoom, to.zoom, t);
+	if (interpolation == scene::interpolation::linear) {
+		zoom = std::log10(mix(std::pow(10.0, from.zoom), std::pow(10.0, to.zoom), t));
+	}
+
+	mandelbrot::input_spec spec;
+	spec.center = { mix(from.center.real(), to.center.real(), t), mix(from.center.imag(), to.center.imag(), t) };
+	spec.output_width = width;
+	spec.output_height = height;
+	spec.zoom_level = static_cast<float>(zoom);
+	spec.max_iterations = static_cast<size_t>(std::llround(mix(double(from.iterations), double(to.iterations), t)));
+	spec.coloring = from.coloring;
+	spec.precision = from.precision;
+	spec.formula = from.formula;
+	spec.power = from.power;
+	spec.julia_constant = from.julia;
+
+	return spec;
+}
@@ -0,0 +1,76 @@
+#include "scene.h"
+
+#include <gtest/gtest.h>
+
+#include <sstream>
+
+TEST(Scene, ParsesKeyframes)
+{
+	std::istringstream in{
+		"# comment\n"
+		"resolution 320 200\n"
+		"fps 30\n"
+		"keyframe 0 center -0.5 0.25 zoom 1 iterations 100 coloring histogram\n"
+		"keyframe 10 zoom 3 # carries over the centre\n" };
+
+	scene::animation animation = scene::parse(in);
+
+	ASSERT_EQ(320u, animation.width);
+	ASSERT_EQ(200u, animation.height);
+	ASSERT_EQ(30u, animation.fps);
+	ASSERT_EQ(11u, animation.frame_count());
+	ASSERT_EQ(2u, animation.keyframes.size());
+	ASSERT_DOUBLE_EQ(-0.5, animation.keyframes[1].center.real());
+	ASSERT_EQ(mandelbrot::coloring_mode::histogram, animation.keyframes[1].coloring);
+}
+
+TEST(Scene, RejectsUnknownDirective)
+{
+	std::istringstream in{ "resolution 10 10\nzoooom 4\n" };
+
+	ASSERT_THROW(scene::parse(in), std::runtime_error);
+}
+
+TEST(Scene, Interpolation)
+{
+	std::istringstream in{
+		"keyframe 0 center 0 0 zoom 1 iterations 100\n"
+		"keyframe 10 center 1 0 zoom 3 iterations 200\n" };
+
+	scene::animation animation = scene::parse(in);
+
+	mandelbrot::input_spec middle = animation.frame(5);
+	ASSERT_FLOAT_EQ(2.0f, middle.zoom_level);
+	ASSERT_DOUBLE_EQ(0.5, middle.center.real());
+	ASSERT_EQ(150u, middle.max_iterations);
+
+	// linear magnification spends most of the time at the wide end
+	animation.interpolation = scene::interpolation::linear;
+	ASSERT_LT(animation.frame(5).zoom_level, 2.8f);
+	ASSERT_GT(animation.frame(5).zoom_level, 2.6f);
+
+	// eased zoom starts slowly
+	animation.interpolation = scene::interpolation::ease;
+	ASSERT_LT(animation.frame(1).zoom_level, 1.2f);
+	ASSERT_FLOAT_EQ(2.0f, animation.frame(5).zoom_level);
+
+	// frames past the last keyframe hold it
+	ASSERT_FLOAT_EQ(3.0f, animation.frame(20).zoom_level);
+}
+
+TEST(Scene, Formula)
+{
+	std::istringstream in{
+		"keyframe 0 formula julia julia -0.8 0.156\n"
+		"keyframe 5 formula multibrot power 4\n" };
+
+	scene::animation animation = scene::parse(in);
+
+	mandelbrot::input_spec julia = animation.frame(0);
+	ASSERT_EQ(mandelbrot::formula::julia, julia.formula);
+	ASSERT_DOUBLE_EQ(-0.8, julia.julia_constant.real());
+
+	mandelbrot::input_spec multibrot = animation.frame(5);
+	ASSERT_EQ(mandelbrot::formula::multibrot, multibrot.formula);
+	ASSERT_EQ(4u, multibrot.power);
+}
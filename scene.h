@@ -0,0 +1,64 @@
+#pragma once
+
+#include "mandelbrot.h"
+
+#include <istream>
+#include <string>
+
+namespace scene {
+	// how zoom_level moves between keyframes
+	enum class interpolation {
+		linear,      // linear in magnification, slows down as it zooms in
+		exponential, // linear in zoom_level, constant apparent zoom speed
+		ease,        // exponential with smoothstep ease in and out
+	};
+
+	struct keyframe {
+		size_t frame{ 0 };
+		std::complex<double> center;
+		double zoom{ 0.0 };
+		size_t iterations{ 1000 };
+		mandelbrot::coloring_mode coloring{ mandelbrot::coloring_mode::cyclic };
+		mandelbrot::precision precision{ mandelbrot::precision::single };
+		mandelbrot::formula formula{ mandelbrot::formula::mandelbrot };
+		unsigned power{ 3 };
+		std::complex<double> julia{ 0.4, 0.4 };
+	};
+
+	// a scene file, one directive per line, # starts a comment
+	//
+	//   resolution 1000 1000
+	//   frames 100
+	//   fps 25
+	//   interpolation exponential
+	//   keyframe 0 center -0.7436438870 0.1318259042 zoom 1 iterations 1000 coloring histogram precision single
+	//   keyframe 99 zoom 6
+	//
+	// other formulas are chosen per keyframe, for example
+	//
+	//   keyframe 0 formula julia julia -0.8 0.156
+	//   keyframe 0 formula multibrot power 3
+	//
+	// keyframe values not given are carried over from the previous keyframe
+	struct animation {
+		size_t width{ 1000 }, height{ 1000 };
+		size_t frames{ 0 };
+		unsigned fps{ 25 };
+		scene::interpolation interpolation{ scene::interpolation::exponential };
+		std::vector<keyframe> keyframes;
+
+		// number of frames, from the last keyframe when frames is not given
+		size_t frame_count() const;
+
+		// spec of frame index, interpolated between the surrounding keyframes
+		mandelbrot::input_spec frame(size_t index) const;
+	};
+
+	animation parse(std::istream& in);
+	animation load(const std::string& filename);
+
+	mandelbrot::coloring_mode parse_coloring(const std::string& name);
+	mandelbrot::precision parse_precision(const std::string& name);
+	mandelbrot::formula parse_formula(const std::string& name);
+	scene::interpolation parse_interpolation(const std::string& name);
+}
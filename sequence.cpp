@@ -0,0 +1,340 @@
+
+#include "sequence.h"
+#include "raster.h"
+#include "parallel.h"
+#include "rle.h"
+
+#include <algorithm>
+#include <stdexcept>
+
+#ifdef _WIN32
+#define popen _popen
+#define pclose _pclose
+#else
+#include <sys/wait.h>
+#endif
+
+namespace {
+	constexpr const char rle_magic[4] = { 'M', 'B', 'R', 'L' };
+	constexpr const uint32_t rle_version = 1;
+
+	void put_u32(std::vector<uint8_t>& out, size_t offset, uint32_t value)
+	{
+		std::memcpy(out.data() + offset, &value, sizeof(value));
+	}
+
+	uint32_t get_u32(const uint8_t* in)
+	{
+		uint32_t value;
+		std::memcpy(&value, in, sizeof(value));
+		return value;
+	}
+
+	void check_size(const mandelbrot::host_output& frame, size_t width, size_t height)
+	{
+		if (frame.width != width || frame.height != height) {
+			throw std::runtime_error("frame size does not match the sequence");
+		}
+	}
+
+	// first row of a band when height rows are split into num_bands
+	size_t band_start(size_t band, size_t num_bands, size_t height)
+	{
+		return band * height / num_bands;
+	}
+}
+
+// tiff sequence
+raster::tiff_sequence::tiff_sequence(std::string prefix, size_t first_frame)
+	: _prefix{ std::move(prefix) }, _frame{ first_frame }
+{
+}
+
+void raster::tiff_sequence::write_frame(const mandelbrot::host_output& frame)
+{
+	write_output(_prefix + std::to_string(_frame++), frame);
+}
+
+// background frame writer
+raster::frame_writer::frame_writer(std::ostream& out)
+	: _out{ out }
+	, _thread{ [this]() { run(); } }
+{
+}
+
+raster::frame_writer::~frame_writer()
+{
+	{
+		std::lock_guard<std::mutex> lock{ _mutex };
+		_stop = true;
+	}
+	_cv.notify_all();
+	_thread.join();
+}
+
+void raster::frame_writer::run()
+{
+	for (;;) {
+		{
+			std::unique_lock<std::mutex> lock{ _mutex };
+			_cv.wait(lock, [this]() { return _pending || _stop; });
+			if (!_pending) {
+				return;
+			}
+		}
+
+		_out.write(reinterpret_cast<const char*>(_back.data()), _back.size());
+
+		{
+			std::lock_guard<std::mutex> lock{ _mutex };
+			if (!_out && !_error) {
+				_error = std::make_exception_ptr(std::runtime_error("error writing frame"));
+			}
+			_pending = false;
+		}
+		_cv.notify_all();
+	}
+}
+
+void raster::frame_writer::submit()
+{
+	{
+		std::unique_lock<std::mutex> lock{ _mutex };
+		_cv.wait(lock, [this]() { return !_pending; });
+		if (_error) {
+			std::rethrow_exception(_error);
+		}
+		std::swap(_front, _back);
+		_pending = true;
+	}
+	_cv.notify_all();
+}
+
+void raster::frame_writer::flush()
+{
+	std::unique_lock<std::mutex> lock{ _mutex };
+	_cv.wait(lock, [this]() { return !_pending; });
+	if (_error) {
+		std::rethrow_exception(_error);
+	}
+	_out.flush();
+}
+
+// y4m
+raster::y4m_sequence::y4m_sequence(std::ostream& out, size_t width, size_t height, unsigned fps)
+	: _writer{ out }, _width{ width }, _height{ height }
+{
+	const std::string header = "YUV4MPEG2 W" + std::to_string(width) + " H" + std::to_string(height)
+		+ " F" + std::to_string(fps) + ":1 Ip A1:1 C444 XCOLORRANGE=FULL\n";
+
+	_writer.buffer().assign(header.begin(), header.end());
+	_writer.submit();
+}
+
+void raster::y4m_sequence::write_frame(const mandelbrot::host_output& frame)
+{
+	check_size(frame, _width, _height);
+
+	static const char frame_header[] = "FRAME\n";
+	const size_t header_size = sizeof(frame_header) - 1;
+	const size_t plane = _width * _height;
+
+	std::vector<uint8_t>& out = _writer.buffer();
+	out.resize(header_size + 3 * plane);
+	std::copy(frame_header, frame_header + header_size, out.begin());
+
+	uint8_t* y_plane = out.data() + header_size;
+	uint8_t* u_plane = y_plane + plane;
+	uint8_t* v_plane = u_plane + plane;
+
+	util::parallel_for(_height, 16u, [&](size_t begin, size_t end, size_t) {
+		for (size_t i = begin * _width; i < end * _width; i++) {
+			const float r = red(frame.out[i]);
+			const float g = green(frame.out[i]);
+			const float b = blue(frame.out[i]);
+
+			// saturated blue and red round to 256 in chroma
+			y_plane[i] = static_cast<uint8_t>(std::min(255.0f, 0.299f * r + 0.587f * g + 0.114f * b + 0.5f));
+			u_plane[i] = static_cast<uint8_t>(std::min(255.0f, 128.5f - 0.168736f * r - 0.331264f * g + 0.5f * b));
+			v_plane[i] = static_cast<uint8_t>(std::min(255.0f, 128.5f + 0.5f * r - 0.418688f * g - 0.081312f * b));
+		}
+	});
+
+	_writer.submit();
+}
+
+void raster::y4m_sequence::close()
+{
+	_writer.flush();
+}
+
+// built in lossless codec
+raster::rle_sequence::rle_sequence(std::ostream& out, size_t width, size_t height, unsigned fps)
+	: _writer{ out }, _width{ width }, _height{ height }, _bands(num_bands)
+{
+	std::vector<uint8_t>& header = _writer.buffer();
+	header.assign(rle_magic, rle_magic + sizeof(rle_magic));
+	header.resize(sizeof(rle_magic) + 4 * sizeof(uint32_t));
+	put_u32(header, 4, rle_version);
+	put_u32(header, 8, static_cast<uint32_t>(width));
+	put_u32(header, 12, static_cast<uint32_t>(height));
+	put_u32(header, 16, fps);
+	_writer.submit();
+}
+
+void raster::rle_sequence::write_frame(const mandelbrot::host_output& frame)
+{
+	check_size(frame, _width, _height);
+
+	util::parallel_for(num_bands, 1u, [&](size_t begin, size_t end, size_t) {
+		for (size_t band = begin; band < end; band++) {
+			const size_t first = band_start(band, num_bands, _height);
+			const size_t last = band_start(band + 1, num_bands, _height);
+
+			_bands[band].clear();
+			rle::encode(frame.out.data() + first * _width, (last - first) * _width, _bands[band]);
+		}
+	});
+
+	// frame record: band count, band sizes, band data
+	std::vector<uint8_t>& out = _writer.buffer();
+	out.resize((1 + num_bands) * sizeof(uint32_t));
+	put_u32(out, 0, static_cast<uint32_t>(num_bands));
+	for (size_t band = 0; band < num_bands; band++) {
+		put_u32(out, (1 + band) * sizeof(uint32_t), static_cast<uint32_t>(_bands[band].size()));
+	}
+	for (const auto& band : _bands) {
+		out.insert(out.end(), band.begin(), band.end());
+	}
+
+	_writer.submit();
+}
+
+void raster::rle_sequence::close()
+{
+	_writer.flush();
+}
+
+raster::rle_reader::rle_reader(std::istream& in)
+	: _in{ in }
+{
+	uint8_t header[sizeof(rle_magic) + 4 * sizeof(uint32_t)];
+	if (!_in.read(reinterpret_cast<char*>(header), sizeof(header))
+		|| !std::equal(rle_magic, rle_magic + sizeof(rle_magic), header)) {
+		throw std::runtime_error("not an rle sequence");
+	}
+
+	if (get_u32(header + 4) != rle_version) {
+		throw std::runtime_error("unsupported rle sequence version");
+	}
+
+	_width = get_u32(header + 8);
+	_height = get_u32(header + 12);
+	_fps = get_u32(header + 16);
+}
+
+bool raster::rle_reader::read_frame(mandelbrot::host_output& frame)
+{
+	uint32_t num_bands = 0;
+	if (!_in.read(reinterpret_cast<char*>(&num_bands), sizeof(num_bands))) {
+		return false;
+	}
+
+	// the writer always splits frames into the same bands
+	if (num_bands != rle_sequence::num_bands) {
+		throw std::runtime_error("rle stream corrupt");
+	}
+
+	std::vector<uint32_t> sizes(num_bands);
+	if (!_in.read(reinterpret_cast<char*>(sizes.data()), num_bands * sizeof(uint32_t))) {
+		throw std::runtime_error("rle frame truncated");
+	}
+
+	std::vector<size_t> offsets(num_bands + 1, 0u);
+	for (size_t band = 0; band < num_bands; band++) {
+		const size_t pixels = (band_start(band + 1, num_bands, _height) - band_start(band, num_bands, _height)) * _width;
+		if (sizes[band] > rle::max_encoded_size<uint32_t>(pixels)) {
+			throw std::runtime_error("rle stream corrupt");
+		}
+		offsets[band + 1] = offsets[band] + sizes[band];
+	}
+
+	_payload.resize(offsets.back());
+	if (!_in.read(reinterpret_cast<char*>(_payload.data()), _payload.size())) {
+		throw std::runtime_error("rle frame truncated");
+	}
+
+	frame.width = _width;
+	frame.height = _height;
+	frame.out.resize(_width * _height);
+
+	util::parallel_for(num_bands, 1u, [&](size_t begin, size_t end, size_t) {
+		for (size_t band = begin; band < end; band++) {
+			const size_t first = band_start(band, num_bands, _height);
+			const size_t last = band_start(band + 1, num_bands, _height);
+
+			rle::decode(_payload.data() + offsets[band], _payload.data() + offsets[band + 1],
+				frame.out.data() + first * _width, (last - first) * _width);
+		}
+	});
+
+	return true;
+}
+
+// child process pipe
+raster::process_stream::process_stream(const std::string& command)
+	: std::ostream{ nullptr }
+#ifdef _WIN32
+	, _pipe{ popen(command.c_str(), "wb") }
+#else
+	, _pipe{ popen(command.c_str(), "w") }
+#endif
+	, _buffer{ _pipe }
+{
+	if (!_pipe) {
+		throw std::runtime_error("unable to start " + command);
+	}
+	rdbuf(&_buffer);
+}
+
+raster::process_stream::~process_stream()
+{
+	close();
+}
+
+int raster::process_stream::close()
+{
+	if (!_pipe) {
+		return 0;
+	}
+
+	flush();
+	const int status = pclose(_pipe);
+	_pipe = nullptr;
+#ifdef _WIN32
+	return status;
+#else
+	if (status == -1) {
+		return -1;
+	}
+	return WIFSIGNALED(status) ? 128 + WTERMSIG(status) : WEXITSTATUS(status);
+#endif
+}
+
+raster::process_stream::buffer::int_type raster::process_stream::buffer::overflow(int_type ch)
+{
+	if (traits_type::eq_int_type(ch, traits_type::eof())) {
+		return traits_type::not_eof(ch);
+	}
+	return std::fputc(ch, _file) == EOF ? traits_type::eof() : ch;
+}
+
+std::streamsize raster::process_stream::buffer::xsputn(const char* data, std::streamsize count)
+{
+	return static_cast<std::streamsize>(std::fwrite(data, 1, static_cast<size_t>(count), _file));
+}
+
+int raster::process_stream::buffer::sync()
+{
+	return std::fflush(_file) == 0 ? 0 : -1;
+}
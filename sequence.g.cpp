@@ -0,0 +1,162 @@
+#include "sequence.h"
+#include "rle.h"
+
+#include <gtest/gtest.h>
+
+#include <cstring>
+#include <sstream>
+
+namespace {
+	mandelbrot::host_output test_frame(size_t width, size_t height, uint32_t seed)
+	{
+		mandelbrot::host_output frame{ width, height };
+		for (size_t y = 0; y < height; y++) {
+			for (size_t x = 0; x < width; x++) {
+				// flat interior plus noisy bands so both runs and literals are coded
+				frame.at(x, y) = x < width / 3 ? 0u : (x * 2654435761u + y * 40503u + seed) & 0xffffffu;
+			}
+		}
+		return frame;
+	}
+}
+
+TEST(Sequence, RleRoundTrip)
+{
+	std::vector<uint32_t> data = { 1, 1, 1, 2, 3, 4, 4, 5 };
+	data.insert(data.end(), 300, 7u);
+	for (uint32_t i = 0; i < 300; i++) {
+		data.push_back(i);
+	}
+
+	std::vector<uint8_t> encoded;
+	rle::encode(data.data(), data.size(), encoded);
+
+	std::vector<uint32_t> decoded(data.size());
+	const uint8_t* end = rle::decode(encoded.data(), encoded.data() + encoded.size(), decoded.data(), decoded.size());
+
+	ASSERT_EQ(encoded.data() + encoded.size(), end);
+	ASSERT_EQ(data, decoded);
+	ASSERT_LT(encoded.size(), data.size() * sizeof(uint32_t));
+}
+
+TEST(Sequence, RleRejectsTruncated)
+{
+	std::vector<uint32_t> data(100, 3u);
+
+	std::vector<uint8_t> encoded;
+	rle::encode(data.data(), data.size(), encoded);
+	encoded.pop_back();
+
+	ASSERT_THROW(rle::decode(encoded.data(), encoded.data() + encoded.size(), data.data(), data.size()), std::runtime_error);
+}
+
+TEST(Sequence, Y4mStream)
+{
+	std::ostringstream out;
+
+	{
+		raster::y4m_sequence sequence{ out, 6u, 4u, 25 };
+		sequence.write_frame(test_frame(6u, 4u, 0u));
+		sequence.write_frame(test_frame(6u, 4u, 1u));
+		sequence.close();
+	}
+
+	const std::string header = "YUV4MPEG2 W6 H4 F25:1 Ip A1:1 C444 XCOLORRANGE=FULL\n";
+	const std::string stream = out.str();
+
+	ASSERT_EQ(header, stream.substr(0, header.size()));
+	ASSERT_EQ(header.size() + 2 * (6 + 3 * 6 * 4), stream.size());
+	ASSERT_EQ("FRAME\n", stream.substr(header.size(), 6));
+}
+
+TEST(Sequence, Y4mSaturatedChroma)
+{
+	mandelbrot::host_output frame{ 2u, 1u };
+	frame.at(0, 0) = 0xff0000u;
+	frame.at(1, 0) = 0x0000ffu;
+
+	std::ostringstream out;
+	raster::y4m_sequence sequence{ out, 2u, 1u, 25 };
+	sequence.write_frame(frame);
+	sequence.close();
+
+	const std::string stream = out.str();
+	const size_t planes = stream.size() - 3 * 2;
+	const uint8_t* u_plane = reinterpret_cast<const uint8_t*>(stream.data()) + planes + 2;
+	const uint8_t* v_plane = u_plane + 2;
+
+	// red has the largest V, blue the largest U
+	ASSERT_EQ(255u, v_plane[0]);
+	ASSERT_EQ(255u, u_plane[1]);
+}
+
+TEST(Sequence, Y4mRejectsWrongSize)
+{
+	std::ostringstream out;
+	raster::y4m_sequence sequence{ out, 6u, 4u, 25 };
+
+	ASSERT_THROW(sequence.write_frame(test_frame(4u, 4u, 0u)), std::runtime_error);
+}
+
+TEST(Sequence, RleReaderRejectsCorruptBands)
+{
+	std::stringstream stream;
+	{
+		raster::rle_sequence sequence{ stream, 8u, 4u, 30 };
+		sequence.write_frame(test_frame(8u, 4u, 0u));
+		sequence.close();
+	}
+	const std::string valid = stream.str();
+	// the first frame record follows the magic and four header fields
+	const size_t record = 4 + 4 * sizeof(uint32_t);
+
+	auto corrupted = [&](size_t offset, uint32_t value) {
+		std::string bytes = valid;
+		std::memcpy(&bytes[offset], &value, sizeof(value));
+		return bytes;
+	};
+
+	// no bands, more bands than the writer makes and a band larger than any encoding
+	for (const std::string& bytes : { corrupted(record, 0u), corrupted(record, 1000000000u), corrupted(record + 4, 0x7fffffffu) }) {
+		std::stringstream in{ bytes };
+		raster::rle_reader reader{ in };
+		mandelbrot::host_output frame{ 0u, 0u };
+		ASSERT_THROW(reader.read_frame(frame), std::runtime_error);
+	}
+}
+
+TEST(Sequence, ProcessStreamExitStatus)
+{
+	raster::process_stream succeeds{ "exit 0" };
+	ASSERT_EQ(0, succeeds.close());
+
+	raster::process_stream fails{ "exit 3" };
+	ASSERT_EQ(3, fails.close());
+	// closing again does not wait a second time
+	ASSERT_EQ(0, fails.close());
+}
+
+TEST(Sequence, RleSequenceRoundTrip)
+{
+	std::stringstream stream;
+
+	{
+		raster::rle_sequence sequence{ stream, 100u, 37u, 30 };
+		for (uint32_t i = 0; i < 3; i++) {
+			sequence.write_frame(test_frame(100u, 37u, i));
+		}
+		sequence.close();
+	}
+
+	raster::rle_reader reader{ stream };
+	ASSERT_EQ(100u, reader.width());
+	ASSERT_EQ(37u, reader.height());
+	ASSERT_EQ(30u, reader.fps());
+
+	mandelbrot::host_output frame{ 0u, 0u };
+	for (uint32_t i = 0; i < 3; i++) {
+		ASSERT_TRUE(reader.read_frame(frame));
+		ASSERT_EQ(test_frame(100u, 37u, i).out, frame.out);
+	}
+	ASSERT_FALSE(reader.read_frame(frame));
+}
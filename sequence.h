@@ -0,0 +1,144 @@
+#pragma once
+#include "mandelbrot.h"
+
+#include <condition_variable>
+#include <cstdio>
+#include <exception>
+#include <istream>
+#include <memory>
+#include <mutex>
+#include <ostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace raster {
+	// receives the frames of an animation in order
+	class sequence_sink {
+	public:
+		virtual ~sequence_sink() = default;
+
+		virtual void write_frame(const mandelbrot::host_output& frame) = 0;
+
+		// waits for queued frames to reach the output
+		virtual void close() {}
+	};
+
+	// one tiff per frame through write_output, named <prefix><frame>.tiff
+	class tiff_sequence : public sequence_sink {
+	private:
+		std::string _prefix;
+		size_t _frame;
+	public:
+		tiff_sequence(std::string prefix, size_t first_frame = 0);
+
+		void write_frame(const mandelbrot::host_output& frame) override;
+	};
+
+	// writes encoded frames to a stream on a background thread so the next
+	// frame can be computed meanwhile, at most one frame is queued
+	class frame_writer {
+	private:
+		std::ostream& _out;
+
+		std::vector<uint8_t> _front, _back;
+
+		std::mutex _mutex;
+		std::condition_variable _cv;
+		bool _pending{ false };
+		bool _stop{ false };
+		std::exception_ptr _error;
+
+		std::thread _thread;
+
+		void run();
+	public:
+		frame_writer(std::ostream& out);
+		~frame_writer();
+
+		// buffer to encode the next frame into
+		std::vector<uint8_t>& buffer() { return _front; }
+
+		// queues buffer() for writing, waits for the previous frame first
+		void submit();
+
+		// waits for the queued frame and flushes the stream
+		void flush();
+	};
+
+	// YUV4MPEG2 stream, 4:4:4 full range BT.601, for piping into any encoder
+	class y4m_sequence : public sequence_sink {
+	private:
+		frame_writer _writer;
+		size_t _width, _height;
+	public:
+		y4m_sequence(std::ostream& out, size_t width, size_t height, unsigned fps);
+
+		void write_frame(const mandelbrot::host_output& frame) override;
+		void close() override;
+	};
+
+	// built in lossless codec, run length coded pixels in independently coded
+	// row bands so frames are encoded and decoded in parallel
+	class rle_sequence : public sequence_sink {
+	private:
+		frame_writer _writer;
+		size_t _width, _height;
+		std::vector<std::vector<uint8_t>> _bands;
+	public:
+		static constexpr const size_t num_bands = 16;
+
+		rle_sequence(std::ostream& out, size_t width, size_t height, unsigned fps);
+
+		void write_frame(const mandelbrot::host_output& frame) override;
+		void close() override;
+	};
+
+	// reads back a stream written by rle_sequence
+	class rle_reader {
+	private:
+		std::istream& _in;
+		size_t _width, _height;
+		unsigned _fps;
+		std::vector<uint8_t> _payload;
+	public:
+		rle_reader(std::istream& in);
+
+		size_t width() const { return _width; }
+		size_t height() const { return _height; }
+		unsigned fps() const { return _fps; }
+
+		// false at the end of the stream
+		bool read_frame(mandelbrot::host_output& frame);
+	};
+
+	// std::ostream over the stdin of a child process, e.g. an encoder
+	class process_stream : public std::ostream {
+	private:
+		class buffer : public std::streambuf {
+		private:
+			std::FILE* _file;
+		protected:
+			int_type overflow(int_type ch) override;
+			std::streamsize xsputn(const char* data, std::streamsize count) override;
+			int sync() override;
+		public:
+			buffer(std::FILE* file) : _file{ file } {}
+		};
+
+		std::FILE* _pipe;
+		buffer _buffer;
+	public:
+		process_stream(const std::string& command);
+		~process_stream();
+
+		// waits for the process to exit, returns its exit status, 128 plus the
+		// signal when it was killed and -1 when it could not be waited for
+		int close();
+	};
+
+	// channels of a packed pixel, in the order libgd reads them so every sink shows the same colours
+	inline uint8_t red(uint32_t pixel) { return static_cast<uint8_t>(pixel >> 16); }
+	inline uint8_t green(uint32_t pixel) { return static_cast<uint8_t>(pixel >> 8); }
+	inline uint8_t blue(uint32_t pixel) { return static_cast<uint8_t>(pixel); }
+}
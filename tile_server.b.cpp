@@ -0,0 +1,196 @@
+#include "tile_server.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <random>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+// Load generator for the tile server. Each connection requests random tiles
+// of levels [0, levels] over keep-alive, one at a time, and the latency of
+// every request is kept for the percentiles. Tiles repeat across connections
+// as on a shared map, so the cache and request coalescing take part. Without
+// a port a server is started in process on a free port.
+//
+//   MandelbrotTileBench [connections] [requests] [levels] [port] [address]
+
+namespace {
+	class http_client {
+	private:
+		int _fd;
+		std::string _buffer;
+
+		void fill()
+		{
+			char chunk[16384];
+			const ssize_t received = recv(_fd, chunk, sizeof(chunk), 0);
+			if (received <= 0) {
+				throw std::runtime_error("connection closed by the server");
+			}
+			_buffer.append(chunk, size_t(received));
+		}
+	public:
+		http_client(const std::string& address, uint16_t port)
+		{
+			sockaddr_in server{};
+			server.sin_family = AF_INET;
+			server.sin_port = htons(port);
+			if (inet_pton(AF_INET, address.c_str(), &server.sin_addr) != 1) {
+				throw std::runtime_error("invalid address " + address);
+			}
+			_fd = socket(AF_INET, SOCK_STREAM, 0);
+			if (_fd < 0 || connect(_fd, reinterpret_cast<sockaddr*>(&server), sizeof(server)) < 0) {
+				const std::string reason = std::strerror(errno);
+				if (_fd >= 0) {
+					close(_fd);
+				}
+				throw std::runtime_error("unable to connect to " + address + ":" + std::to_string(port) + ": " + reason);
+			}
+			const int on = 1;
+			setsockopt(_fd, IPPROTO_TCP, TCP_NODELAY, &on, sizeof(on));
+		}
+
+		~http_client() { close(_fd); }
+
+		// status of the response, body is filled with its content
+		int get(const std::string& path, std::string& body)
+		{
+			const std::string request = "GET " + path + " HTTP/1.1\r\nHost: bench\r\n\r\n";
+			if (send(_fd, request.data(), request.size(), MSG_NOSIGNAL) != ssize_t(request.size())) {
+				throw std::runtime_error("sending the request failed");
+			}
+
+			size_t end;
+			while ((end = _buffer.find("\r\n\r\n")) == std::string::npos) {
+				fill();
+			}
+			const std::string head = _buffer.substr(0, end);
+			_buffer.erase(0, end + 4);
+
+			const int status = std::atoi(head.c_str() + head.find(' ') + 1);
+			const size_t length_at = head.find("Content-Length: ");
+			const size_t length = length_at == std::string::npos ? 0 : std::stoul(head.substr(length_at + 16));
+
+			while (_buffer.size() < length) {
+				fill();
+			}
+			body.assign(_buffer, 0, length);
+			_buffer.erase(0, length);
+			return status;
+		}
+	};
+
+	double percentile(const std::vector<double>& sorted, double p)
+	{
+		if (sorted.empty()) {
+			return 0.0;
+		}
+		const size_t index = std::min(sorted.size() - 1, static_cast<size_t>(p / 100.0 * double(sorted.size())));
+		return sorted[index];
+	}
+}
+
+int main(int argc, char* argv[])
+{
+	const size_t connections = argc > 1 ? std::stoul(argv[1]) : 16;
+	const size_t requests = argc > 2 ? std::stoul(argv[2]) : 200;
+	const unsigned levels = argc > 3 ? static_cast<unsigned>(std::stoul(argv[3])) : 5;
+	const uint16_t given_port = argc > 4 ? static_cast<uint16_t>(std::stoul(argv[4])) : 0;
+	const std::string address = argc > 5 ? argv[5] : "127.0.0.1";
+
+	try {
+		std::unique_ptr<tiles::tile_service> service;
+		std::unique_ptr<tiles::tile_server> server;
+		std::thread serving;
+		uint16_t port = given_port;
+
+		if (given_port == 0) {
+			tiles::tile_settings settings;
+			service = std::make_unique<tiles::tile_service>(settings, tiles::compute_renderer(settings, false));
+			server = std::make_unique<tiles::tile_server>(*service, address, 0);
+			port = server->port();
+			serving = std::thread{ [&]() { server->run(); } };
+		}
+
+		std::vector<std::vector<double>> latencies(connections);
+		std::vector<size_t> errors(connections, 0);
+		std::vector<std::thread> clients;
+
+		const auto start = std::chrono::steady_clock::now();
+		for (size_t i = 0; i < connections; i++) {
+			clients.emplace_back([&, i]() {
+				std::mt19937_64 random{ i + 1 };
+				std::string body;
+				try {
+					http_client client{ address, port };
+					for (size_t r = 0; r < requests; r++) {
+						const unsigned z = std::uniform_int_distribution<unsigned>{ 0, levels }(random);
+						std::uniform_int_distribution<uint64_t> along{ 0, (uint64_t(1) << z) - 1 };
+						const std::string path = "/" + std::to_string(z) + "/" + std::to_string(along(random)) + "/" + std::to_string(along(random)) + ".png";
+
+						const auto sent = std::chrono::steady_clock::now();
+						const int status = client.get(path, body);
+						latencies[i].push_back(std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - sent).count());
+						if (status != 200) {
+							errors[i]++;
+						}
+					}
+				}
+				catch (const std::exception& error) {
+					std::fprintf(stderr, "connection %zu: %s\n", i, error.what());
+					errors[i]++;
+				}
+			});
+		}
+		for (std::thread& client : clients) {
+			client.join();
+		}
+		const double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+		std::vector<double> all;
+		size_t failed = 0;
+		for (size_t i = 0; i < connections; i++) {
+			all.insert(all.end(), latencies[i].begin(), latencies[i].end());
+			failed += errors[i];
+		}
+		std::sort(all.begin(), all.end());
+
+		std::printf("%zu connections, %zu requests over levels 0-%u in %.2f s, %.1f requests/s, %zu errors\n",
+			connections, all.size(), levels, seconds, seconds > 0.0 ? all.size() / seconds : 0.0, failed);
+		std::printf("%-8s %9s %9s %9s %9s %9s\n", "latency", "p50", "p90", "p99", "p99.9", "max");
+		std::printf("%-8s %6.2f ms %6.2f ms %6.2f ms %6.2f ms %6.2f ms\n", "",
+			percentile(all, 50.0), percentile(all, 90.0), percentile(all, 99.0), percentile(all, 99.9),
+			all.empty() ? 0.0 : all.back());
+
+		std::string stats;
+		try {
+			http_client{ address, port }.get("/stats", stats);
+		}
+		catch (const std::exception& error) {
+			stats = std::string(error.what()) + "\n";
+		}
+		std::printf("\nserver\n%s", stats.c_str());
+
+		if (server) {
+			server->stop();
+			serving.join();
+		}
+		return failed == 0 ? 0 : 1;
+	}
+	catch (const std::exception& error) {
+		std::fprintf(stderr, "%s\n", error.what());
+		return 1;
+	}
+}
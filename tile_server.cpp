@@ -0,0 +1,437 @@
+
+#include "tile_server.h"
+
+#include <algorithm>
+#include <cctype>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <utility>
+#include <vector>
+
+#ifndef _WIN32
+#include <arpa/inet.h>
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <unistd.h>
+#endif
+
+namespace {
+	// request heads larger than this are refused
+	constexpr const size_t max_head = 8192;
+
+	// bytes read from a socket at a time
+	constexpr const size_t receive_chunk = 16384;
+
+	std::shared_ptr<const std::string> text(std::string body)
+	{
+		return std::make_shared<const std::string>(std::move(body));
+	}
+
+	std::string lowercase(std::string value)
+	{
+		std::transform(value.begin(), value.end(), value.begin(), [](unsigned char c) { return char(std::tolower(c)); });
+		return value;
+	}
+}
+
+struct tiles::tile_server::mailbox {
+	std::mutex mutex;
+	// tiles finished on the render thread, by connection id
+	std::vector<std::pair<uint64_t, tile_image>> finished;
+	// write end of the wake pipe, -1 once the server is gone
+	int wake{ -1 };
+};
+
+struct tiles::tile_server::connection {
+	uint64_t id;
+	int fd;
+	std::string in;
+
+	// response being sent, head then body
+	std::string head;
+	tile_image body;
+	size_t sent{ 0 };
+
+	bool waiting{ false };
+	bool keep_alive{ true };
+	bool closed{ false };
+
+	bool responding() const { return !head.empty(); }
+};
+
+#ifdef _WIN32
+
+tiles::tile_server::tile_server(tile_service& service, const std::string&, uint16_t)
+	: _service{ service }
+{
+	throw std::runtime_error("the tile server needs POSIX sockets");
+}
+
+tiles::tile_server::~tile_server() = default;
+void tiles::tile_server::run() {}
+void tiles::tile_server::stop() {}
+
+#else
+
+namespace {
+	std::runtime_error system_error(const std::string& what)
+	{
+		return std::runtime_error(what + ": " + std::strerror(errno));
+	}
+
+	void set_nonblocking(int fd)
+	{
+		fcntl(fd, F_SETFL, fcntl(fd, F_GETFL, 0) | O_NONBLOCK);
+	}
+
+	// wakes the loop, when the pipe is full it is woken already
+	void poke(int fd)
+	{
+		const char byte = 0;
+		const ssize_t written = write(fd, &byte, 1);
+		static_cast<void>(written);
+	}
+}
+
+tiles::tile_server::tile_server(tile_service& service, const std::string& address, uint16_t port)
+	: _service{ service }, _mailbox{ std::make_shared<mailbox>() }
+{
+	sockaddr_in bound{};
+	bound.sin_family = AF_INET;
+	bound.sin_port = htons(port);
+	if (inet_pton(AF_INET, address.c_str(), &bound.sin_addr) != 1) {
+		throw std::runtime_error("invalid listen address " + address);
+	}
+
+	_listener = socket(AF_INET, SOCK_STREAM, 0);
+	if (_listener < 0) {
+		throw system_error("socket");
+	}
+	const int on = 1;
+	setsockopt(_listener, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+
+	if (bind(_listener, reinterpret_cast<sockaddr*>(&bound), sizeof(bound)) < 0 || listen(_listener, SOMAXCONN) < 0) {
+		const std::runtime_error error = system_error("listening on " + address + ":" + std::to_string(port));
+		close(_listener);
+		throw error;
+	}
+	set_nonblocking(_listener);
+
+	socklen_t length = sizeof(bound);
+	getsockname(_listener, reinterpret_cast<sockaddr*>(&bound), &length);
+	_port = ntohs(bound.sin_port);
+
+	int pipe_fds[2];
+	if (pipe(pipe_fds) < 0) {
+		close(_listener);
+		throw system_error("pipe");
+	}
+	set_nonblocking(pipe_fds[0]);
+	set_nonblocking(pipe_fds[1]);
+	_wake = pipe_fds[0];
+	_mailbox->wake = pipe_fds[1];
+}
+
+tiles::tile_server::~tile_server()
+{
+	{
+		std::lock_guard<std::mutex> lock{ _mailbox->mutex };
+		close(_mailbox->wake);
+		_mailbox->wake = -1;
+	}
+	close(_wake);
+	close(_listener);
+	for (auto& entry : _connections) {
+		close(entry.second->fd);
+	}
+}
+
+void tiles::tile_server::stop()
+{
+	_stopping = true;
+	std::lock_guard<std::mutex> lock{ _mailbox->mutex };
+	if (_mailbox->wake >= 0) {
+		poke(_mailbox->wake);
+	}
+}
+
+void tiles::tile_server::run()
+{
+	std::vector<pollfd> fds;
+	std::vector<connection*> polled;
+
+	while (!_stopping) {
+		fds.clear();
+		polled.clear();
+		fds.push_back({ _listener, POLLIN, 0 });
+		fds.push_back({ _wake, POLLIN, 0 });
+		for (auto& entry : _connections) {
+			connection& c = *entry.second;
+			const short events = c.responding() ? POLLOUT : c.waiting ? 0 : POLLIN;
+			fds.push_back({ c.fd, events, 0 });
+			polled.push_back(&c);
+		}
+
+		if (poll(fds.data(), fds.size(), -1) < 0) {
+			if (errno == EINTR) {
+				continue;
+			}
+			throw system_error("poll");
+		}
+
+		if (fds[1].revents & POLLIN) {
+			char drain[64];
+			while (read(_wake, drain, sizeof(drain)) > 0) {
+			}
+		}
+
+		for (size_t i = 0; i < polled.size(); i++) {
+			connection& c = *polled[i];
+			const short events = fds[i + 2].revents;
+			if (events & (POLLIN | POLLHUP | POLLERR)) {
+				receive(c);
+			}
+			if (!c.closed && (events & POLLOUT)) {
+				pump(c);
+			}
+		}
+
+		// tiles the render thread finished, and cache hits answered while reading
+		deliver_finished();
+
+		if (fds[0].revents & POLLIN) {
+			accept_all();
+		}
+
+		for (auto entry = _connections.begin(); entry != _connections.end();) {
+			if (entry->second->closed) {
+				close(entry->second->fd);
+				entry = _connections.erase(entry);
+			}
+			else {
+				++entry;
+			}
+		}
+	}
+}
+
+void tiles::tile_server::accept_all()
+{
+	for (;;) {
+		const int fd = accept(_listener, nullptr, nullptr);
+		if (fd < 0) {
+			return;
+		}
+		set_nonblocking(fd);
+		const int on = 1;
+		setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &on, sizeof(on));
+
+		auto c = std::make_unique<connection>();
+		c->id = _next_id++;
+		c->fd = fd;
+		_connections.emplace(c->id, std::move(c));
+	}
+}
+
+void tiles::tile_server::receive(connection& c)
+{
+	char chunk[receive_chunk];
+	for (;;) {
+		const ssize_t received = recv(c.fd, chunk, sizeof(chunk), 0);
+		if (received > 0) {
+			c.in.append(chunk, size_t(received));
+			continue;
+		}
+		if (received < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+			break;
+		}
+		if (received < 0 && errno == EINTR) {
+			continue;
+		}
+		// closed by the client or failed, a tile still rendering for it is dropped
+		c.closed = true;
+		return;
+	}
+	pump(c);
+}
+
+void tiles::tile_server::pump(connection& c)
+{
+	while (!c.closed) {
+		if (c.responding()) {
+			if (!flush(c)) {
+				return;
+			}
+			if (!c.keep_alive) {
+				c.closed = true;
+				return;
+			}
+		}
+		else if (c.waiting || !next_request(c)) {
+			return;
+		}
+	}
+}
+
+bool tiles::tile_server::next_request(connection& c)
+{
+	const size_t end = c.in.find("\r\n\r\n");
+	if (end == std::string::npos) {
+		if (c.in.size() > max_head) {
+			c.keep_alive = false;
+			respond(c, "431 Request Header Fields Too Large", "text/plain", text("request too large\n"));
+			return true;
+		}
+		return false;
+	}
+
+	const std::string head = c.in.substr(0, end);
+	c.in.erase(0, end + 4);
+
+	const size_t line_end = head.find("\r\n");
+	const std::string line = head.substr(0, line_end);
+	const size_t first_space = line.find(' ');
+	const size_t second_space = line.find(' ', first_space + 1);
+	if (first_space == std::string::npos || second_space == std::string::npos) {
+		c.keep_alive = false;
+		respond(c, "400 Bad Request", "text/plain", text("malformed request\n"));
+		return true;
+	}
+	const std::string method = line.substr(0, first_space);
+	const std::string target = line.substr(first_space + 1, second_space - first_space - 1);
+	const std::string version = line.substr(second_space + 1);
+
+	// HTTP/1.1 keeps the connection unless asked to close, 1.0 only when asked to keep it
+	const std::string headers = lowercase(line_end == std::string::npos ? std::string{} : head.substr(line_end));
+	const size_t connection_header = headers.find("\r\nconnection:");
+	const std::string connection_value = connection_header == std::string::npos ? std::string{}
+		: headers.substr(connection_header + 13, headers.find("\r\n", connection_header + 2) - connection_header - 13);
+	c.keep_alive = version == "HTTP/1.1"
+		? connection_value.find("close") == std::string::npos
+		: connection_value.find("keep-alive") != std::string::npos;
+
+	if (method != "GET") {
+		respond(c, "405 Method Not Allowed", "text/plain", text("only GET is served\n"));
+		return true;
+	}
+
+	if (target == "/stats") {
+		const service_stats stats = _service.stats();
+		respond(c, "200 OK", "text/plain", text(
+			"requests " + std::to_string(stats.requests) + "\n"
+			"cache_hits " + std::to_string(stats.cache_hits) + "\n"
+			"coalesced " + std::to_string(stats.coalesced) + "\n"
+			"rendered " + std::to_string(stats.rendered) + "\n"
+			"batches " + std::to_string(stats.batches) + "\n"
+			"failures " + std::to_string(stats.failures) + "\n"
+			"cached_tiles " + std::to_string(stats.cached_tiles) + "\n"
+			"cached_bytes " + std::to_string(stats.cached_bytes) + "\n"
+			"connections " + std::to_string(_connections.size()) + "\n"));
+		return true;
+	}
+
+	tile_key key;
+	if (!parse_tile_path(target, key) || !_service.settings().contains(key)) {
+		respond(c, "404 Not Found", "text/plain", text("no such tile\n"));
+		return true;
+	}
+
+	// answered in deliver_finished, cache hits before the next poll
+	c.waiting = true;
+	const uint64_t id = c.id;
+	std::shared_ptr<mailbox> box = _mailbox;
+	_service.request(key, [box, id](tile_image image) {
+		std::lock_guard<std::mutex> lock{ box->mutex };
+		if (box->wake < 0) {
+			return;
+		}
+		if (box->finished.empty()) {
+			poke(box->wake);
+		}
+		box->finished.emplace_back(id, std::move(image));
+	});
+	return true;
+}
+
+void tiles::tile_server::deliver_finished()
+{
+	std::vector<std::pair<uint64_t, tile_image>> finished;
+	{
+		std::lock_guard<std::mutex> lock{ _mailbox->mutex };
+		finished.swap(_mailbox->finished);
+	}
+
+	for (auto& tile : finished) {
+		auto found = _connections.find(tile.first);
+		if (found == _connections.end() || found->second->closed) {
+			continue;
+		}
+		connection& c = *found->second;
+		c.waiting = false;
+		if (tile.second) {
+			respond(c, "200 OK", "image/png", std::move(tile.second));
+		}
+		else {
+			respond(c, "500 Internal Server Error", "text/plain", text("rendering the tile failed\n"));
+		}
+		pump(c);
+	}
+}
+
+void tiles::tile_server::respond(connection& c, const char* status, const char* type, tile_image body)
+{
+	c.head = std::string("HTTP/1.1 ") + status + "\r\n"
+		"Content-Type: " + type + "\r\n"
+		"Content-Length: " + std::to_string(body->size()) + "\r\n"
+		// tiles never change for a running server
+		"Cache-Control: public, max-age=86400\r\n"
+		"Access-Control-Allow-Origin: *\r\n"
+		"Connection: " + (c.keep_alive ? "keep-alive" : "close") + "\r\n"
+		"\r\n";
+	c.body = std::move(body);
+	c.sent = 0;
+}
+
+bool tiles::tile_server::flush(connection& c)
+{
+	const size_t total = c.head.size() + c.body->size();
+	while (c.sent < total) {
+		iovec parts[2];
+		size_t count = 0;
+		if (c.sent < c.head.size()) {
+			parts[count++] = { const_cast<char*>(c.head.data()) + c.sent, c.head.size() - c.sent };
+		}
+		const size_t body_sent = c.sent > c.head.size() ? c.sent - c.head.size() : 0;
+		parts[count++] = { const_cast<char*>(c.body->data()) + body_sent, c.body->size() - body_sent };
+
+		msghdr message{};
+		message.msg_iov = parts;
+		message.msg_iovlen = count;
+		const ssize_t written = sendmsg(c.fd, &message, MSG_NOSIGNAL);
+		if (written < 0) {
+			if (errno == EAGAIN || errno == EWOULDBLOCK) {
+				return false;
+			}
+			if (errno == EINTR) {
+				continue;
+			}
+			c.closed = true;
+			return false;
+		}
+		c.sent += size_t(written);
+	}
+
+	c.head.clear();
+	c.body.reset();
+	c.sent = 0;
+	return true;
+}
+
+#endif
@@ -0,0 +1,63 @@
+#pragma once
+
+#include "tiles.h"
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <unordered_map>
+
+namespace tiles {
+	// HTTP/1.1 front of a tile_service for slippy map viewers. A single thread
+	// multiplexes the listening socket and every connection with poll, tiles
+	// finished on the render thread are handed back through a pipe. Answers
+	//
+	//   GET /{z}/{x}/{y}.png  the tile as image/png
+	//   GET /stats            the service counters, one "name value" per line
+	//
+	// and keeps connections alive. POSIX only, elsewhere the constructor
+	// throws std::runtime_error
+	class tile_server {
+	private:
+		struct connection;
+		struct mailbox;
+
+		tile_service& _service;
+		int _listener{ -1 };
+		int _wake{ -1 };
+		uint16_t _port{ 0 };
+		std::atomic<bool> _stopping{ false };
+
+		// outlives the server for renders still in flight when it goes
+		std::shared_ptr<mailbox> _mailbox;
+
+		uint64_t _next_id{ 0 };
+		std::unordered_map<uint64_t, std::unique_ptr<connection>> _connections;
+
+		void accept_all();
+		void receive(connection& c);
+		// answers buffered requests and sends until the socket is full or a tile is awaited
+		void pump(connection& c);
+		bool next_request(connection& c);
+		bool flush(connection& c);
+		void respond(connection& c, const char* status, const char* type, tile_image body);
+		void deliver_finished();
+	public:
+		// listens on address, an IPv4 address such as 127.0.0.1 or 0.0.0.0,
+		// port 0 picks a free port
+		tile_server(tile_service& service, const std::string& address, uint16_t port);
+		~tile_server();
+
+		tile_server(const tile_server&) = delete;
+		tile_server& operator=(const tile_server&) = delete;
+
+		uint16_t port() const { return _port; }
+
+		// serves on the calling thread until stop
+		void run();
+
+		// thread safe, run returns soon after
+		void stop();
+	};
+}
@@ -0,0 +1,271 @@
+
+#include "tiles.h"
+#include "host_compute.h"
+#include "parallel.h"
+#include "raster.h"
+
+#include <cmath>
+#include <iostream>
+#include <sstream>
+
+namespace {
+	// decimal number at text[at], at is moved past it
+	bool parse_number(const std::string& text, size_t& at, uint64_t& value)
+	{
+		const size_t start = at;
+		value = 0;
+		while (at < text.size() && text[at] >= '0' && text[at] <= '9') {
+			// 2^63 is far past any level, longer numbers cannot be a tile
+			if (at - start >= 18) {
+				return false;
+			}
+			value = value * 10 + uint64_t(text[at] - '0');
+			at++;
+		}
+		return at > start;
+	}
+
+	bool device_supported(const mandelbrot::input_spec& view)
+	{
+		return view.formula == mandelbrot::formula::mandelbrot && view.precision == mandelbrot::precision::single;
+	}
+}
+
+size_t tiles::tile_key_hash::operator()(const tile_key& key) const
+{
+	return std::hash<uint64_t>{}(key.x * 0x9e3779b97f4a7c15ull ^ key.y * 0xc2b2ae3d27d4eb4full ^ key.z);
+}
+
+bool tiles::parse_tile_path(const std::string& path, tile_key& key)
+{
+	const std::string route = path.substr(0, path.find('?'));
+
+	uint64_t z = 0, x = 0, y = 0;
+	size_t at = 0;
+	const auto separator = [&]() { return at < route.size() && route[at++] == '/'; };
+
+	if (!separator() || !parse_number(route, at, z) || !separator() || !parse_number(route, at, x)
+		|| !separator() || !parse_number(route, at, y) || route.compare(at, std::string::npos, ".png") != 0) {
+		return false;
+	}
+	if (z > 62) {
+		return false;
+	}
+
+	key.z = static_cast<unsigned>(z);
+	key.x = x;
+	key.y = y;
+	return true;
+}
+
+bool tiles::tile_settings::contains(const tile_key& key) const
+{
+	if (key.z > max_level) {
+		return false;
+	}
+	const uint64_t across = uint64_t(1) << key.z;
+	return key.x < across && key.y < across;
+}
+
+mandelbrot::input_spec tiles::tile_spec(const tile_key& key, const tile_settings& settings)
+{
+	const double tile_extent = settings.extent / double(uint64_t(1) << key.z);
+	const double step = tile_extent / double(settings.tile_size);
+	// util::coordinate puts pixel 0 this far before the centre
+	const double half = double(settings.tile_size / 2) * step;
+
+	mandelbrot::input_spec spec = settings.view;
+	spec.output_width = settings.tile_size;
+	spec.output_height = settings.tile_size;
+	spec.zoom_level = static_cast<float>(std::log10(0.002 / step));
+	spec.center = {
+		settings.corner.real() + double(key.x) * tile_extent + half,
+		settings.corner.imag() + double(key.y) * tile_extent + half,
+	};
+	spec.max_iterations = settings.base_iterations + settings.iterations_per_level * key.z;
+	return spec;
+}
+
+tiles::tile_cache::tile_cache(size_t capacity_bytes)
+	: _capacity{ capacity_bytes }
+{
+}
+
+tiles::tile_image tiles::tile_cache::find(const tile_key& key)
+{
+	auto found = _index.find(key);
+	if (found == _index.end()) {
+		return nullptr;
+	}
+	_order.splice(_order.begin(), _order, found->second);
+	return found->second->second;
+}
+
+void tiles::tile_cache::insert(const tile_key& key, tile_image image)
+{
+	auto found = _index.find(key);
+	if (found != _index.end()) {
+		_bytes -= found->second->second->size();
+		_order.erase(found->second);
+		_index.erase(found);
+	}
+
+	if (image->size() > _capacity) {
+		return;
+	}
+
+	_bytes += image->size();
+	_order.emplace_front(key, std::move(image));
+	_index[key] = _order.begin();
+
+	while (_bytes > _capacity) {
+		_bytes -= _order.back().second->size();
+		_index.erase(_order.back().first);
+		_order.pop_back();
+	}
+}
+
+tiles::batch_renderer tiles::compute_renderer(const tile_settings& settings, bool use_gpu)
+{
+	std::shared_ptr<compute::gpu_context> context;
+	if (use_gpu && device_supported(settings.view)) {
+		try {
+			context = std::make_shared<compute::gpu_context>(settings.tile_size, settings.tile_size);
+		}
+		catch (const compute::gpu_error& error) {
+			std::clog << "gpu unavailable, rendering tiles on the host: " << error.what() << '\n';
+		}
+	}
+
+	if (!context) {
+		return [](std::vector<compute::compute_io_data>& frames) { compute::host_compute_batch(frames); };
+	}
+	return [context](std::vector<compute::compute_io_data>& frames) { compute::compute_batch(frames, *context); };
+}
+
+tiles::tile_service::tile_service(const tile_settings& settings, batch_renderer render)
+	: _settings{ settings }, _render{ std::move(render) }, _cache{ settings.cache_bytes }
+{
+	_thread = std::thread{ [this]() { run(); } };
+}
+
+tiles::tile_service::~tile_service()
+{
+	{
+		std::lock_guard<std::mutex> lock{ _mutex };
+		_stopping = true;
+	}
+	_wake.notify_one();
+	_thread.join();
+}
+
+void tiles::tile_service::request(const tile_key& key, callback done)
+{
+	tile_image image;
+	{
+		std::lock_guard<std::mutex> lock{ _mutex };
+		_stats.requests++;
+
+		image = _cache.find(key);
+		if (image) {
+			_stats.cache_hits++;
+		}
+		else {
+			auto pending = _pending.find(key);
+			if (pending != _pending.end()) {
+				_stats.coalesced++;
+				pending->second.push_back(std::move(done));
+				return;
+			}
+			_pending[key].push_back(std::move(done));
+			_queue.push_back(key);
+		}
+	}
+
+	if (!image) {
+		_wake.notify_one();
+		return;
+	}
+	done(std::move(image));
+}
+
+tiles::service_stats tiles::tile_service::stats()
+{
+	std::lock_guard<std::mutex> lock{ _mutex };
+	service_stats stats = _stats;
+	stats.cached_tiles = _cache.size();
+	stats.cached_bytes = _cache.bytes();
+	return stats;
+}
+
+void tiles::tile_service::run()
+{
+	std::vector<tile_key> batch;
+	std::vector<tile_image> images;
+	std::vector<std::pair<tile_image, std::vector<callback>>> answers;
+
+	for (;;) {
+		{
+			std::unique_lock<std::mutex> lock{ _mutex };
+			_wake.wait(lock, [this]() { return _stopping || !_queue.empty(); });
+			if (_queue.empty()) {
+				return;
+			}
+
+			batch.clear();
+			while (!_queue.empty() && batch.size() < _settings.max_batch) {
+				batch.push_back(_queue.front());
+				_queue.pop_front();
+			}
+		}
+
+		images.assign(batch.size(), nullptr);
+		try {
+			std::vector<compute::compute_io_data> frames;
+			frames.reserve(batch.size());
+			for (const tile_key& key : batch) {
+				frames.emplace_back(tile_spec(key, _settings));
+			}
+
+			_render(frames);
+
+			util::parallel_for(frames.size(), 1, [&](size_t begin, size_t end, size_t) {
+				for (size_t i = begin; i < end; i++) {
+					std::ostringstream png;
+					raster::write_png(png, frames[i].output, _settings.png_level);
+					images[i] = std::make_shared<const std::string>(png.str());
+				}
+			});
+		}
+		catch (const std::exception& error) {
+			std::clog << "rendering " << batch.size() << " tiles failed: " << error.what() << '\n';
+			images.assign(batch.size(), nullptr);
+		}
+
+		// failed tiles are not cached, a later request renders them again
+		answers.clear();
+		{
+			std::lock_guard<std::mutex> lock{ _mutex };
+			_stats.batches++;
+			for (size_t i = 0; i < batch.size(); i++) {
+				if (images[i]) {
+					_cache.insert(batch[i], images[i]);
+					_stats.rendered++;
+				}
+				else {
+					_stats.failures++;
+				}
+
+				auto pending = _pending.find(batch[i]);
+				answers.emplace_back(images[i], std::move(pending->second));
+				_pending.erase(pending);
+			}
+		}
+
+		for (auto& answer : answers) {
+			for (callback& done : answer.second) {
+				done(answer.first);
+			}
+		}
+	}
+}
@@ -0,0 +1,245 @@
+#include "tiles.h"
+#include "tile_server.h"
+#include "host_compute.h"
+
+#include <gtest/gtest.h>
+
+#include <condition_variable>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+#ifndef _WIN32
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#endif
+
+namespace {
+	tiles::tile_settings small_tiles()
+	{
+		tiles::tile_settings settings;
+		settings.tile_size = 16;
+		settings.base_iterations = 50;
+		settings.iterations_per_level = 10;
+		return settings;
+	}
+
+	// pixel i of a tile along one axis
+	double coordinate(double middle, const tiles::tile_settings& settings, const mandelbrot::input_spec& spec, size_t i)
+	{
+		return util::coordinate(middle, settings.tile_size, util::step_size(spec.zoom_level), i);
+	}
+
+	// counts answers and waits for them
+	struct answers {
+		std::mutex mutex;
+		std::condition_variable done;
+		std::vector<tiles::tile_image> images;
+
+		tiles::tile_service::callback collect()
+		{
+			return [this](tiles::tile_image image) {
+				std::lock_guard<std::mutex> lock{ mutex };
+				images.push_back(std::move(image));
+				done.notify_all();
+			};
+		}
+
+		void wait_for(size_t count)
+		{
+			std::unique_lock<std::mutex> lock{ mutex };
+			done.wait(lock, [&]() { return images.size() >= count; });
+		}
+	};
+}
+
+TEST(Tiles, ParsesPaths)
+{
+	tiles::tile_key key;
+	ASSERT_TRUE(tiles::parse_tile_path("/3/2/5.png", key));
+	ASSERT_EQ(3u, key.z);
+	ASSERT_EQ(2u, key.x);
+	ASSERT_EQ(5u, key.y);
+
+	ASSERT_TRUE(tiles::parse_tile_path("/0/0/0.png?v=2", key));
+	ASSERT_EQ(0u, key.z);
+
+	ASSERT_FALSE(tiles::parse_tile_path("/3/2/5.jpg", key));
+	ASSERT_FALSE(tiles::parse_tile_path("/3/2.png", key));
+	ASSERT_FALSE(tiles::parse_tile_path("/3/-2/5.png", key));
+	ASSERT_FALSE(tiles::parse_tile_path("3/2/5.png", key));
+	ASSERT_FALSE(tiles::parse_tile_path("/3/2/5.png/", key));
+	ASSERT_FALSE(tiles::parse_tile_path("/99999999999999999999/0/0.png", key));
+
+	const tiles::tile_settings settings{};
+	ASSERT_TRUE(settings.contains({ 2, 3, 3 }));
+	ASSERT_FALSE(settings.contains({ 2, 4, 0 }));
+	ASSERT_FALSE(settings.contains({ settings.max_level + 1, 0, 0 }));
+}
+
+TEST(Tiles, NeighboursMeet)
+{
+	const tiles::tile_settings settings{};
+
+	const mandelbrot::input_spec tile = tiles::tile_spec({ 5, 12, 20 }, settings);
+	const mandelbrot::input_spec right = tiles::tile_spec({ 5, 13, 20 }, settings);
+	const mandelbrot::input_spec below = tiles::tile_spec({ 5, 12, 21 }, settings);
+	const double step = util::step_size(tile.zoom_level);
+
+	ASSERT_EQ(settings.tile_size, tile.output_width);
+	ASSERT_EQ(settings.base_iterations + 5 * settings.iterations_per_level, tile.max_iterations);
+	ASSERT_NEAR(settings.extent / 32.0 / settings.tile_size, step, step * 1e-6);
+
+	const double last_real = coordinate(tile.center.real(), settings, tile, settings.tile_size - 1);
+	ASSERT_NEAR(last_real + step, coordinate(right.center.real(), settings, right, 0), step * 1e-3);
+	const double last_imag = coordinate(tile.center.imag(), settings, tile, settings.tile_size - 1);
+	ASSERT_NEAR(last_imag + step, coordinate(below.center.imag(), settings, below, 0), step * 1e-3);
+
+	// the single tile of level 0 starts at the corner
+	const mandelbrot::input_spec top = tiles::tile_spec({ 0, 0, 0 }, settings);
+	ASSERT_NEAR(settings.corner.real(), coordinate(top.center.real(), settings, top, 0), 1e-6);
+	ASSERT_NEAR(settings.corner.imag(), coordinate(top.center.imag(), settings, top, 0), 1e-6);
+}
+
+TEST(Tiles, CacheEvictsLeastRecentlyUsed)
+{
+	tiles::tile_cache cache{ 30 };
+	const auto image = [](size_t bytes) { return std::make_shared<const std::string>(bytes, 'x'); };
+
+	cache.insert({ 1, 0, 0 }, image(10));
+	cache.insert({ 1, 1, 0 }, image(10));
+	cache.insert({ 1, 0, 1 }, image(10));
+	ASSERT_EQ(30u, cache.bytes());
+
+	// touching the first makes the second the oldest
+	ASSERT_NE(nullptr, cache.find({ 1, 0, 0 }));
+	cache.insert({ 1, 1, 1 }, image(10));
+
+	ASSERT_EQ(3u, cache.size());
+	ASSERT_EQ(nullptr, cache.find({ 1, 1, 0 }));
+	ASSERT_NE(nullptr, cache.find({ 1, 0, 0 }));
+	ASSERT_NE(nullptr, cache.find({ 1, 1, 1 }));
+
+	// larger than the whole budget, not kept
+	cache.insert({ 2, 0, 0 }, image(31));
+	ASSERT_EQ(nullptr, cache.find({ 2, 0, 0 }));
+	ASSERT_EQ(30u, cache.bytes());
+}
+
+TEST(Tiles, DuplicateRequestsRenderOnce)
+{
+	std::mutex mutex;
+	std::condition_variable opened;
+	bool open = false;
+	size_t rendered = 0;
+
+	// holds the renders until every request is made
+	tiles::tile_service service{ small_tiles(), [&](std::vector<compute::compute_io_data>& frames) {
+		std::unique_lock<std::mutex> lock{ mutex };
+		opened.wait(lock, [&]() { return open; });
+		rendered += frames.size();
+		compute::host_compute_batch(frames);
+	} };
+
+	answers answered;
+	for (size_t i = 0; i < 5; i++) {
+		service.request({ 2, 1, 1 }, answered.collect());
+	}
+	service.request({ 2, 3, 0 }, answered.collect());
+
+	{
+		std::lock_guard<std::mutex> lock{ mutex };
+		open = true;
+	}
+	opened.notify_all();
+	answered.wait_for(6);
+
+	ASSERT_EQ(2u, rendered);
+	for (const tiles::tile_image& image : answered.images) {
+		ASSERT_NE(nullptr, image);
+		ASSERT_EQ(std::string("\x89PNG", 4), image->substr(0, 4));
+	}
+
+	// answered from the cache before request returns
+	const size_t before = answered.images.size();
+	service.request({ 2, 1, 1 }, answered.collect());
+	ASSERT_EQ(before + 1, answered.images.size());
+
+	const tiles::service_stats stats = service.stats();
+	ASSERT_EQ(7u, stats.requests);
+	ASSERT_EQ(4u, stats.coalesced);
+	ASSERT_EQ(1u, stats.cache_hits);
+	ASSERT_EQ(2u, stats.rendered);
+	ASSERT_EQ(2u, stats.cached_tiles);
+}
+
+TEST(Tiles, FailedRendersAreRetried)
+{
+	size_t attempts = 0;
+	tiles::tile_service service{ small_tiles(), [&](std::vector<compute::compute_io_data>& frames) {
+		if (attempts++ == 0) {
+			throw std::runtime_error("device lost");
+		}
+		compute::host_compute_batch(frames);
+	} };
+
+	answers answered;
+	service.request({ 1, 0, 0 }, answered.collect());
+	answered.wait_for(1);
+	ASSERT_EQ(nullptr, answered.images[0]);
+
+	service.request({ 1, 0, 0 }, answered.collect());
+	answered.wait_for(2);
+	ASSERT_NE(nullptr, answered.images[1]);
+
+	ASSERT_EQ(1u, service.stats().failures);
+	ASSERT_EQ(1u, service.stats().rendered);
+}
+
+#ifndef _WIN32
+TEST(Tiles, ServesOverHttp)
+{
+	tiles::tile_service service{ small_tiles(), tiles::compute_renderer(small_tiles(), false) };
+	tiles::tile_server server{ service, "127.0.0.1", 0 };
+	std::thread serving{ [&]() { server.run(); } };
+
+	sockaddr_in address{};
+	address.sin_family = AF_INET;
+	address.sin_port = htons(server.port());
+	inet_pton(AF_INET, "127.0.0.1", &address.sin_addr);
+	const int fd = socket(AF_INET, SOCK_STREAM, 0);
+	ASSERT_EQ(0, connect(fd, reinterpret_cast<sockaddr*>(&address), sizeof(address)));
+
+	// pipelined on one connection, answered in order
+	const std::string requests =
+		"GET /1/1/0.png HTTP/1.1\r\nHost: test\r\n\r\n"
+		"GET /1/2/0.png HTTP/1.1\r\nHost: test\r\n\r\n"
+		"GET /stats HTTP/1.1\r\nHost: test\r\nConnection: close\r\n\r\n";
+	ASSERT_EQ(ssize_t(requests.size()), send(fd, requests.data(), requests.size(), 0));
+
+	std::string response;
+	char chunk[4096];
+	ssize_t received;
+	while ((received = recv(fd, chunk, sizeof(chunk), 0)) > 0) {
+		response.append(chunk, size_t(received));
+	}
+	close(fd);
+
+	server.stop();
+	serving.join();
+
+	const size_t tile = response.find("HTTP/1.1 200 OK\r\nContent-Type: image/png");
+	const size_t missing = response.find("HTTP/1.1 404 Not Found");
+	const size_t stats = response.find("requests 1\n");
+	ASSERT_NE(std::string::npos, tile);
+	ASSERT_NE(std::string::npos, missing);
+	ASSERT_NE(std::string::npos, stats);
+	ASSERT_LT(tile, missing);
+	ASSERT_LT(missing, stats);
+	ASSERT_NE(std::string::npos, response.find("\x89PNG"));
+}
+#endif
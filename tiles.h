@@ -0,0 +1,148 @@
+#pragma once
+
+#include "gpu_compute.h"
+
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+namespace tiles {
+	// tile x, y of level z in slippy map numbering, level z is 2^z tiles across
+	// and x grows right, y grows down
+	struct tile_key {
+		unsigned z{ 0 };
+		uint64_t x{ 0 }, y{ 0 };
+
+		bool operator==(const tile_key& other) const { return z == other.z && x == other.x && y == other.y; }
+	};
+
+	struct tile_key_hash {
+		size_t operator()(const tile_key& key) const;
+	};
+
+	// parses /{z}/{x}/{y}.png, a query string is ignored
+	bool parse_tile_path(const std::string& path, tile_key& key);
+
+	struct tile_settings {
+		// pixels along each side of a tile
+		size_t tile_size{ 256 };
+
+		// the square of the plane the single tile of level 0 covers, the
+		// imaginary axis grows down like the rows of a frame
+		std::complex<double> corner{ -2.5, -2.0 };
+		double extent{ 4.0 };
+
+		// deepest level served, single precision runs out of resolution past 16
+		unsigned max_level{ 16 };
+
+		// iterations at level 0 and added per level
+		size_t base_iterations{ 256 };
+		size_t iterations_per_level{ 64 };
+
+		// colouring, formula and precision of every tile, only the view is
+		// replaced. Histogram colouring is per tile and shows seams
+		mandelbrot::input_spec view;
+
+		// tiles rendered in one batch at most
+		size_t max_batch{ 16 };
+
+		// encoded tiles kept in memory
+		size_t cache_bytes{ size_t(256) << 20 };
+
+		// zlib level of the encoded tiles, low levels trade size for latency
+		int png_level{ 1 };
+
+		bool contains(const tile_key& key) const;
+	};
+
+	// the frame a tile shows, neighbouring tiles meet without a gap or overlap
+	mandelbrot::input_spec tile_spec(const tile_key& key, const tile_settings& settings);
+
+	// an encoded png, shared between the cache and the responses being sent
+	using tile_image = std::shared_ptr<const std::string>;
+
+	// encoded tiles, least recently used first out once over the byte budget
+	class tile_cache {
+	private:
+		using entry = std::pair<tile_key, tile_image>;
+
+		size_t _capacity;
+		size_t _bytes{ 0 };
+		// most recently used first
+		std::list<entry> _order;
+		std::unordered_map<tile_key, std::list<entry>::iterator, tile_key_hash> _index;
+	public:
+		explicit tile_cache(size_t capacity_bytes);
+
+		// null when the tile is not cached, a hit makes it the most recently used
+		tile_image find(const tile_key& key);
+		void insert(const tile_key& key, tile_image image);
+
+		size_t size() const { return _order.size(); }
+		size_t bytes() const { return _bytes; }
+	};
+
+	// renders the frames of a batch in place
+	using batch_renderer = std::function<void(std::vector<compute::compute_io_data>&)>;
+
+	// compute_batch on the device when use_gpu and a context can be made,
+	// host_compute_batch otherwise
+	batch_renderer compute_renderer(const tile_settings& settings, bool use_gpu);
+
+	struct service_stats {
+		uint64_t requests{ 0 };
+		uint64_t cache_hits{ 0 };
+		// requests that joined a render already queued or running
+		uint64_t coalesced{ 0 };
+		uint64_t rendered{ 0 };
+		uint64_t batches{ 0 };
+		uint64_t failures{ 0 };
+		size_t cached_tiles{ 0 };
+		size_t cached_bytes{ 0 };
+	};
+
+	// Answers tile requests from the cache or by rendering them on its own
+	// thread. Requests for a tile that is already queued or rendering wait for
+	// that render instead of starting another, and queued tiles are rendered
+	// together in batches of up to max_batch. Thread safe.
+	class tile_service {
+	public:
+		// called once with the png, or null when rendering failed
+		using callback = std::function<void(tile_image)>;
+	private:
+		tile_settings _settings;
+		batch_renderer _render;
+
+		std::mutex _mutex;
+		std::condition_variable _wake;
+		tile_cache _cache;
+		std::unordered_map<tile_key, std::vector<callback>, tile_key_hash> _pending;
+		std::deque<tile_key> _queue;
+		service_stats _stats;
+		bool _stopping{ false };
+
+		std::thread _thread;
+
+		void run();
+	public:
+		tile_service(const tile_settings& settings, batch_renderer render);
+		// renders what is queued and answers its requests before returning
+		~tile_service();
+
+		const tile_settings& settings() const { return _settings; }
+
+		// done runs on the calling thread for cached tiles and on the render
+		// thread otherwise, key must be contained in the settings
+		void request(const tile_key& key, callback done);
+
+		service_stats stats();
+	};
+}
@@ -0,0 +1,185 @@
+
+#include "verify.h"
+#include "archive.h"
+#include "scene.h"
+
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+#include <filesystem>
+#include <fstream>
+#include <sstream>
+#include <stdexcept>
+
+namespace {
+	// units in the last place between neighbouring pixels for a precision to
+	// resolve a frame, rounding grows over the orbit so a few are not enough
+	constexpr const double resolution_ulps = 256.0;
+}
+
+mandelbrot::input_spec verify::scaled(const mandelbrot::input_spec& spec, size_t width)
+{
+	mandelbrot::input_spec result = spec;
+	const double factor = double(spec.output_width) / double(width);
+	result.output_width = width;
+	result.output_height = std::max<size_t>(1, static_cast<size_t>(std::lround(double(spec.output_height) / factor)));
+	// pixels factor times wider
+	result.zoom_level = static_cast<float>(spec.zoom_level - std::log10(factor));
+	return result;
+}
+
+std::vector<verify::frame> verify::standard_frames(const std::string& scene_dir, size_t width)
+{
+	std::vector<std::filesystem::path> files;
+	for (const auto& entry : std::filesystem::directory_iterator(scene_dir)) {
+		if (entry.path().extension() == ".scene") {
+			files.push_back(entry.path());
+		}
+	}
+	std::sort(files.begin(), files.end());
+
+	std::vector<frame> frames;
+	for (const std::filesystem::path& file : files) {
+		const scene::animation animation = scene::load(file.string());
+		const size_t count = animation.frame_count();
+		size_t chosen[] = { 0, count / 2, count - 1 };
+		const size_t* end = std::unique(std::begin(chosen), std::end(chosen));
+
+		for (const size_t* index = chosen; index != end; index++) {
+			mandelbrot::input_spec spec = animation.frame(*index);
+			spec.output_width = animation.width;
+			spec.output_height = animation.height;
+			frames.push_back({ file.stem().string() + "." + std::to_string(*index), scaled(spec, width) });
+		}
+	}
+	return frames;
+}
+
+bool verify::resolvable(const mandelbrot::input_spec& spec, mandelbrot::precision precision)
+{
+	const double step = util::step_size(spec.zoom_level);
+	const double reach = step * double(std::max(spec.output_width, spec.output_height)) / 2.0;
+	const double magnitude = std::max(std::abs(spec.center.real()), std::abs(spec.center.imag())) + reach;
+	const double epsilon = precision == mandelbrot::precision::single ? FLT_EPSILON : DBL_EPSILON;
+	return step > resolution_ulps * epsilon * magnitude;
+}
+
+verify::comparison verify::compare(const std::vector<float>& expected, const float* actual, size_t count, const verify::tolerance& tolerance)
+{
+	if (expected.size() != count) {
+		throw std::runtime_error("compared fields differ in size");
+	}
+
+	comparison result;
+	result.pixels = count;
+	for (size_t i = 0; i < count; i++) {
+		const bool expected_inside = expected[i] < 0.0f;
+		const bool actual_inside = actual[i] < 0.0f;
+		if (expected_inside != actual_inside) {
+			result.mismatched++;
+			continue;
+		}
+		if (expected_inside) {
+			continue;
+		}
+
+		const float difference = std::abs(expected[i] - actual[i]);
+		result.max_difference = std::max(result.max_difference, difference);
+		if (difference > tolerance.escape) {
+			result.mismatched++;
+		}
+	}
+	return result;
+}
+
+std::string verify::golden_path(const std::string& golden_dir, const frame& frame)
+{
+	return golden_dir + "/" + frame.name + ".mbf";
+}
+
+void verify::write_golden(const std::string& path, const mandelbrot::input_spec& spec, const float* escape)
+{
+	const std::filesystem::path parent = std::filesystem::path(path).parent_path();
+	if (!parent.empty()) {
+		std::filesystem::create_directories(parent);
+	}
+
+	archive::layout layout;
+	layout.width = spec.output_width;
+	layout.height = spec.output_height;
+	layout.tile_size = std::max(spec.output_width, spec.output_height);
+	layout.sample = archive::sample_type::uint16;
+
+	archive::writer writer{ path, layout, archive::from_spec(spec) };
+	writer.write_field(escape, spec.output_width * spec.output_height);
+	writer.close();
+}
+
+std::vector<float> verify::read_golden(const std::string& path, const mandelbrot::input_spec& spec)
+{
+	if (!std::filesystem::exists(path)) {
+		throw std::runtime_error("no golden field " + path);
+	}
+
+	archive::reader reader{ path };
+	const archive::metadata& metadata = reader.metadata();
+	if (reader.layout().width != spec.output_width || reader.layout().height != spec.output_height
+		|| metadata.center != spec.center || metadata.zoom_level != spec.zoom_level || metadata.max_iterations != spec.max_iterations) {
+		throw std::runtime_error("golden field " + path + " shows another view");
+	}
+	return reader.level(0);
+}
+
+verify::throughputs verify::read_baseline(const std::string& path)
+{
+	throughputs result;
+	std::ifstream in{ path };
+	std::string line;
+	while (std::getline(in, line)) {
+		line = line.substr(0, line.find('#'));
+		std::istringstream fields{ line };
+		std::string name;
+		double value = 0.0;
+		if (!(fields >> name)) {
+			continue;
+		}
+		if (!(fields >> value) || value <= 0.0) {
+			throw std::runtime_error("invalid baseline line '" + line + "' in " + path);
+		}
+		result[name] = value;
+	}
+	return result;
+}
+
+void verify::write_baseline(const std::string& path, const throughputs& measured)
+{
+	const std::filesystem::path parent = std::filesystem::path(path).parent_path();
+	if (!parent.empty()) {
+		std::filesystem::create_directories(parent);
+	}
+
+	std::ofstream out{ path, std::ios_base::out | std::ios_base::trunc };
+	if (!out) {
+		throw std::runtime_error("unable to write baseline " + path);
+	}
+	out << "# pixels per second of each MandelbrotPerfGate case, best of its repeats\n";
+	out.precision(6);
+	for (const auto& entry : measured) {
+		out << entry.first << ' ' << std::fixed << entry.second << '\n';
+	}
+}
+
+std::vector<verify::regression> verify::regressions(const throughputs& baseline, const throughputs& measured, double margin)
+{
+	std::vector<regression> result;
+	for (const auto& entry : measured) {
+		auto expected = baseline.find(entry.first);
+		if (expected == baseline.end()) {
+			continue;
+		}
+		if (entry.second < expected->second * (1.0 - margin)) {
+			result.push_back({ entry.first, expected->second, entry.second });
+		}
+	}
+	return result;
+}
@@ -0,0 +1,201 @@
+#include "verify.h"
+#include "gpu_compute.h"
+#include "host_compute.h"
+
+#include <gtest/gtest.h>
+
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+
+namespace {
+	// golden frames are this wide
+	constexpr const size_t golden_width = 128;
+
+	const std::string scene_dir = MANDELBROT_SOURCE_DIR "/scenes";
+	const std::string golden_dir = MANDELBROT_SOURCE_DIR "/golden";
+
+	// escape counts of other backends and kernels, in double precision only
+	// rounding is left, in single precision pixels near the boundary escape
+	// at other iterations or not at all
+	verify::tolerance tolerance_of(mandelbrot::precision precision)
+	{
+		return precision == mandelbrot::precision::double_ ? verify::tolerance{ 1.0f, 0.001 } : verify::tolerance{ 1.0f, 0.03 };
+	}
+
+	// MANDELBROT_UPDATE_GOLDEN=1 rewrites the golden fields from the reference instead of comparing
+	bool updating()
+	{
+		const char* update = std::getenv("MANDELBROT_UPDATE_GOLDEN");
+		return update && *update && std::string(update) != "0";
+	}
+
+	// the reference the golden fields hold, the branching host kernel in double precision
+	compute::compute_io_data reference(const verify::frame& frame)
+	{
+		mandelbrot::input_spec spec = frame.spec;
+		spec.precision = mandelbrot::precision::double_;
+		compute::compute_io_data data{ spec };
+		compute::host_compute_generic(data);
+		return data;
+	}
+
+	std::string describe(const verify::comparison& comparison)
+	{
+		return std::to_string(comparison.mismatched) + " of " + std::to_string(comparison.pixels)
+			+ " pixels differ, largest difference " + std::to_string(comparison.max_difference);
+	}
+
+	void expect_golden(const verify::frame& frame, const compute::compute_io_data& data, const std::string& configuration)
+	{
+		const std::vector<float> expected = verify::read_golden(verify::golden_path(golden_dir, frame), frame.spec);
+		const verify::tolerance tolerance = tolerance_of(data.spec.precision);
+		const verify::comparison comparison = verify::compare(expected, data.output.escape.data(), data.output.escape.size(), tolerance);
+		EXPECT_TRUE(comparison.within(tolerance)) << frame.name << ' ' << configuration << ": " << describe(comparison);
+	}
+}
+
+TEST(Verify, Compare)
+{
+	const std::vector<float> expected{ -1.0f, 10.0f, 20.0f, 30.0f };
+
+	const float same[] = { -1.0f, 10.4f, 19.8f, 30.0f };
+	verify::comparison comparison = verify::compare(expected, same, 4, { 0.5f, 0.0 });
+	ASSERT_EQ(0u, comparison.mismatched);
+	ASSERT_NEAR(0.4f, comparison.max_difference, 1e-5f);
+
+	// one escapes that should not, one is off by too much
+	const float off[] = { 5.0f, 10.0f, 25.0f, 30.0f };
+	comparison = verify::compare(expected, off, 4, { 0.5f, 0.0 });
+	ASSERT_EQ(2u, comparison.mismatched);
+	ASSERT_FALSE(comparison.within({ 0.5f, 0.25 }));
+	ASSERT_TRUE(comparison.within({ 0.5f, 0.5 }));
+}
+
+TEST(Verify, ScaledKeepsView)
+{
+	mandelbrot::input_spec spec;
+	spec.center = { -0.74, 0.13 };
+	spec.output_width = 1920;
+	spec.output_height = 1080;
+	spec.zoom_level = 3.0f;
+
+	const mandelbrot::input_spec small = verify::scaled(spec, 128);
+
+	ASSERT_EQ(128u, small.output_width);
+	ASSERT_EQ(72u, small.output_height);
+	const double wide = util::step_size(spec.zoom_level) * spec.output_width;
+	ASSERT_NEAR(wide, util::step_size(small.zoom_level) * small.output_width, wide * 1e-5);
+
+	ASSERT_TRUE(verify::resolvable(small, mandelbrot::precision::single));
+	spec.zoom_level = 8.0f;
+	ASSERT_FALSE(verify::resolvable(spec, mandelbrot::precision::single));
+	ASSERT_TRUE(verify::resolvable(spec, mandelbrot::precision::double_));
+}
+
+TEST(Verify, Baseline)
+{
+	const std::string path = "verify_test_baseline.txt";
+	verify::write_baseline(path, { { "a/host/single", 2.0e6 }, { "b/host/double", 1.0e6 } });
+
+	const verify::throughputs baseline = verify::read_baseline(path);
+	std::remove(path.c_str());
+	ASSERT_EQ(2u, baseline.size());
+	ASSERT_DOUBLE_EQ(2.0e6, baseline.at("a/host/single"));
+
+	// a within the margin, b below it, c has no baseline
+	const std::vector<verify::regression> regressions = verify::regressions(baseline,
+		{ { "a/host/single", 1.85e6 }, { "b/host/double", 0.8e6 }, { "c/gpu/single", 1.0 } }, 0.1);
+	ASSERT_EQ(1u, regressions.size());
+	ASSERT_EQ("b/host/double", regressions[0].name);
+
+	ASSERT_TRUE(verify::read_baseline("no_such_baseline.txt").empty());
+}
+
+TEST(Verify, GoldenReference)
+{
+	const std::vector<verify::frame> frames = verify::standard_frames(scene_dir, golden_width);
+	ASSERT_FALSE(frames.empty());
+
+	// the reference itself only differs by the rounding to whole counts
+	const verify::tolerance rounding{ 0.501f, 0.001 };
+
+	for (const verify::frame& frame : frames) {
+		const compute::compute_io_data data = reference(frame);
+		const std::string path = verify::golden_path(golden_dir, frame);
+
+		if (updating()) {
+			verify::write_golden(path, frame.spec, data.output.escape.data());
+			continue;
+		}
+
+		const std::vector<float> expected = verify::read_golden(path, frame.spec);
+		const verify::comparison comparison = verify::compare(expected, data.output.escape.data(), data.output.escape.size(), rounding);
+		EXPECT_TRUE(comparison.within(rounding)) << frame.name << ": " << describe(comparison);
+	}
+}
+
+TEST(Verify, HostMatchesGolden)
+{
+	const mandelbrot::precision precisions[] = { mandelbrot::precision::single, mandelbrot::precision::double_ };
+	const mandelbrot::schedule schedules[] = { mandelbrot::schedule::fixed, mandelbrot::schedule::compacted };
+
+	for (const verify::frame& frame : verify::standard_frames(scene_dir, golden_width)) {
+		for (auto precision : precisions) {
+			if (!verify::resolvable(frame.spec, precision)) {
+				continue;
+			}
+			const char* name = precision == mandelbrot::precision::single ? "single" : "double";
+
+			for (auto schedule : schedules) {
+				mandelbrot::input_spec spec = frame.spec;
+				spec.precision = precision;
+				spec.schedule = schedule;
+				compute::compute_io_data data{ spec };
+				compute::host_compute(data);
+				expect_golden(frame, data, std::string("host ") + name + (schedule == mandelbrot::schedule::fixed ? " fixed" : " compacted"));
+			}
+
+			mandelbrot::input_spec spec = frame.spec;
+			spec.precision = precision;
+			compute::compute_io_data data{ spec };
+			compute::host_compute_generic(data);
+			expect_golden(frame, data, std::string("host generic ") + name);
+		}
+	}
+}
+
+TEST(Verify, DeviceMatchesGolden)
+{
+	std::unique_ptr<compute::gpu_context> context;
+	try {
+		context = std::make_unique<compute::gpu_context>(golden_width, golden_width);
+	}
+	catch (const compute::gpu_error& error) {
+		GTEST_SKIP() << "no OpenCL device: " << error.what();
+	}
+
+	std::vector<verify::frame> device_frames;
+	std::vector<compute::compute_io_data> batch;
+	for (const verify::frame& frame : verify::standard_frames(scene_dir, golden_width)) {
+		if (frame.spec.formula != mandelbrot::formula::mandelbrot || !verify::resolvable(frame.spec, mandelbrot::precision::single)) {
+			continue;
+		}
+		mandelbrot::input_spec spec = frame.spec;
+		spec.precision = mandelbrot::precision::single;
+
+		// single frames need a context of their size
+		compute::gpu_context sized{ spec.output_width, spec.output_height };
+		compute::compute_io_data data{ spec };
+		compute::compute(data, sized);
+		expect_golden(frame, data, "device");
+
+		device_frames.push_back(frame);
+		batch.emplace_back(spec);
+	}
+
+	compute::compute_batch(batch, *context);
+	for (size_t i = 0; i < batch.size(); i++) {
+		expect_golden(device_frames[i], batch[i], "device batch");
+	}
+}
@@ -0,0 +1,70 @@
+#pragma once
+
+#include "mandelbrot.h"
+
+#include <map>
+#include <string>
+#include <vector>
+
+namespace verify {
+	// a frame of a standard scene at a reduced size, named <scene>.<frame>
+	struct frame {
+		std::string name;
+		mandelbrot::input_spec spec;
+	};
+
+	// spec resized to width, height follows the aspect and the view keeps
+	// the same part of the plane
+	mandelbrot::input_spec scaled(const mandelbrot::input_spec& spec, size_t width);
+
+	// first, middle and last frame of every *.scene in scene_dir, in name order
+	std::vector<frame> standard_frames(const std::string& scene_dir, size_t width);
+
+	// whether neighbouring pixels of the frame have distinct coordinates in precision
+	bool resolvable(const mandelbrot::input_spec& spec, mandelbrot::precision precision);
+
+	struct tolerance {
+		// escape counts of pixels exterior in both may differ this much
+		float escape{ 1.0f };
+		// pixels beyond that or inside in only one, pixels on the boundary
+		// change sides between precisions and backends
+		double mismatch_fraction{ 0.01 };
+	};
+
+	struct comparison {
+		size_t pixels{ 0 };
+		size_t mismatched{ 0 };
+		// largest escape count difference of pixels exterior in both
+		float max_difference{ 0.0f };
+
+		double mismatch_fraction() const { return pixels == 0 ? 0.0 : double(mismatched) / double(pixels); }
+		bool within(const verify::tolerance& tolerance) const { return mismatch_fraction() <= tolerance.mismatch_fraction; }
+	};
+
+	comparison compare(const std::vector<float>& expected, const float* actual, size_t count, const verify::tolerance& tolerance);
+
+	// Golden escape fields are archives of whole escape counts, one per
+	// frame as <golden_dir>/<name>.mbf, compared with the tolerance of
+	// their rounding at least
+	std::string golden_path(const std::string& golden_dir, const frame& frame);
+	void write_golden(const std::string& path, const mandelbrot::input_spec& spec, const float* escape);
+	// throws std::runtime_error when missing or of another view
+	std::vector<float> read_golden(const std::string& path, const mandelbrot::input_spec& spec);
+
+	// Baselines are text, one "<case> <pixels per second>" per line, # starts a comment
+	using throughputs = std::map<std::string, double>;
+
+	// empty when the file does not exist
+	throughputs read_baseline(const std::string& path);
+	void write_baseline(const std::string& path, const throughputs& measured);
+
+	struct regression {
+		std::string name;
+		double baseline{ 0.0 };
+		double measured{ 0.0 };
+	};
+
+	// cases measured slower than the baseline by more than margin, a
+	// fraction, cases missing on either side are not compared
+	std::vector<regression> regressions(const throughputs& baseline, const throughputs& measured, double margin);
+}